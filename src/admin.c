@@ -41,15 +41,20 @@ int cmd_algorithm(char *);
 int cmd_hri(char *);
 int cmd_hrs(char *);
 int cmd_hrt(char *);
+int cmd_accept(char *);
+int cmd_buffer(char *, char *);
 int cmd_monitor(char *);
 int cmd_clone_mode(char *);
 int cmd_overload_mode(char *);
 int cmd_info();
 int cmd_kill();
+int cmd_upgrade();
+int cmd_reload();
 int cmd_standby(char *, char *);
 int cmd_delete(char *, char *);
 int cmd_maxl(char *, char *, char *);
 int cmd_maxc(char *, char *, char *);
+int cmd_weight(char *, char *, char *);
 int cmd_enable(char *, char *);
 int cmd_disable(char *, char *);
 int cmd_reset(char *, char *);
@@ -57,6 +62,7 @@ int cmd_examples();
 int cmd_help();
 int cmd_snmp(char *);
 int cmd_show();
+unsigned long long latency_bound(int);
 int cmd_debug(char *);
 int set_subject(char *, char *, int, int);
 
@@ -424,6 +430,26 @@ int command_prompt() {
 				continue;
 			}
 		}
+		/* ACCEPT (accept budget) command */
+		else if(!strncmp(argument_1, "accept",6)) {
+			if(number_of_args == 2) {
+				command_return_value=cmd_accept(argument_2);
+			}
+			else {
+				printf("ERROR: incorrect arguments\n");
+				continue;
+			}
+		}
+		/* BUFFER (session buffer size and mode) command */
+		else if(!strncmp(argument_1, "buffer",6)) {
+			if(number_of_args == 3) {
+				command_return_value=cmd_buffer(argument_2, argument_3);
+			}
+			else {
+				printf("ERROR: incorrect arguments\n");
+				continue;
+			}
+		}
 		/* INFO command */
 		else if(!strncmp(argument_1, "i",1)) {
 			command_return_value=cmd_info();
@@ -439,6 +465,12 @@ int command_prompt() {
 			}
 		}
 		/* KILL command */
+		else if(!strncmp(argument_1, "upgrade", 7)) {
+			command_return_value=cmd_upgrade();
+		}
+		else if(!strncmp(argument_1, "reload", 6)) {
+			command_return_value=cmd_reload();
+		}
 		else if(!strncmp(argument_1, "kill", 4)) {
 			command_return_value=cmd_kill();
 		}
@@ -482,6 +514,19 @@ int command_prompt() {
 				continue;
 			}
 		}
+		/* WEIGHT command */
+		else if(!strncmp(argument_1, "weight",6)) {
+			if(number_of_args == 3) {
+				command_return_value=cmd_weight(MEMBER_ARG, argument_2, argument_3);
+			}
+			else if(number_of_args == 4) {
+				command_return_value=cmd_weight(argument_2, argument_3, argument_4);
+			}
+			else {
+				printf("ERROR: incorrect arguments\n");
+				continue;
+			}
+		}
 		/* RESET command */
 		else if(!strncmp(argument_1, "r",1)) {
 			if(number_of_args == 2) {
@@ -643,7 +688,7 @@ int cmd_create(char *type, char *name, char *ip, char *port) {
 		return -1;
 	}
 	/*ok we've validated our input now make a new server */
-	status=create_balancer_server(cloneServer, serverName, serverStatus, STANDBY_STATE_FALSE, serverPort, &serverIP, serverMaxc, servermaxl);
+	status=create_balancer_server(cloneServer, serverName, serverStatus, STANDBY_STATE_FALSE, serverPort, &serverIP, serverMaxc, servermaxl, DEFAULT_WEIGHT);
 	if(status==0) {
 		if(cloneServer==SERVER_CLONE_FALSE) {
 			printf("created member server \"%s\" successfully\n",serverName);
@@ -667,17 +712,38 @@ int cmd_algorithm(char *value) {
 	}
 	else if(!strncmp(value, "rr",2)) {
 		balancer->algorithm=ALGORITHM_RR;
+		SERVERS_CHANGED();
 		printf("Set balancing algorithm to roundrobin\n");
 		return 0;
 	}
 	else if(!strncmp(value, "lc",2)) {
 		balancer->algorithm=ALGORITHM_LC;
+		SERVERS_CHANGED();
 		printf("Set balancing algorithm to least connections\n");
 		return 0;
 	}
+	else if(!strncmp(value, "wrr",3)) {
+		balancer->algorithm=ALGORITHM_WRR;
+		SERVERS_CHANGED();
+		printf("Set balancing algorithm to weighted roundrobin\n");
+		return 0;
+	}
+	else if(!strncmp(value, "wlc",3)) {
+		balancer->algorithm=ALGORITHM_WLC;
+		SERVERS_CHANGED();
+		printf("Set balancing algorithm to weighted least connections\n");
+		return 0;
+	}
+	else if(!strncmp(value, "p2c",3)) {
+		balancer->algorithm=ALGORITHM_P2C;
+		SERVERS_CHANGED();
+		printf("Set balancing algorithm to power of two choices\n");
+		return 0;
+	}
 	else if(!strncmp(value, "ll",2)) {
 		#ifdef USE_SNMP
 		balancer->algorithm=ALGORITHM_LL;
+		SERVERS_CHANGED();
 		printf("Set balancing algorithm to least load\n");
 		#else
 		printf("ERROR: Cannot use Least Load algorithm unless SNMP support is enabled at compile time\n");
@@ -687,11 +753,13 @@ int cmd_algorithm(char *value) {
 	}
 	else if(!strncmp(value, "hash",4)) {
 		balancer->algorithm=ALGORITHM_HASH;
+		SERVERS_CHANGED();
 		printf("Set balancing algorithm to uri hashing\n");
 		return 0;
 	}
 	else if(!strncmp(value, "static",5)) {
 		balancer->algorithm=ALGORITHM_STATIC;
+		SERVERS_CHANGED();
 		printf("Set balancing algorithm to uri static hashing\n");
 		return 0;
 	}
@@ -727,6 +795,83 @@ int cmd_hri(char *value) {
 	return 0;
 }
 
+/* sets the number of connections each worker accepts per listener wakeup */
+int cmd_accept(char *value) {
+	char *endptr;
+	if(readonly==1) {
+		printf("ERROR: This command not available in read-only mode!\n");
+		return -1;
+	}
+	errno=0;
+	v1=strtol(value, &endptr, 10);
+	if ((errno == ERANGE && (v1 == LONG_MAX || v1 == LONG_MIN)) || (errno != 0 && v1 == 0) || (endptr == value)) {
+		printf("ERROR: Invalid parameter (budget)\n");
+		return -1;
+	}
+	if((v1 < 0) || (v1 > INT_MAX)) {
+		printf("ERROR: invalid budget (must be 0 or more)\n");
+		return -1;
+	}
+	balancer->accept_budget=v1;
+	if(v1==0) {
+		printf("Set accept budget to unlimited\n");
+	}
+	else {
+		printf("Set accept budget to %d connections per wakeup\n", balancer->accept_budget);
+	}
+	return 0;
+}
+
+/* sets the session buffer size, the adaptive size cap or the buffer mode. Sessions pick up the change the
+ * next time one of their buffers is attached
+ */
+int cmd_buffer(char *setting, char *value) {
+	char *endptr;
+	if(readonly==1) {
+		printf("ERROR: This command not available in read-only mode!\n");
+		return -1;
+	}
+	if(!strncmp(setting, "mode", 4)) {
+		if(!strncmp(value, "f", 1)) {
+			balancer->buffer_mode=BUFFER_MODE_FIXED;
+		}
+		else if(!strncmp(value, "a", 1)) {
+			balancer->buffer_mode=BUFFER_MODE_ADAPTIVE;
+		}
+		else {
+			printf("ERROR: invalid buffer mode (must be fixed or adaptive)\n");
+			return -1;
+		}
+		printf("Set buffer mode to %s\n", buffer_mode_status[balancer->buffer_mode]);
+		return 0;
+	}
+	errno=0;
+	v1=strtol(value, &endptr, 10);
+	if ((errno == ERANGE && (v1 == LONG_MAX || v1 == LONG_MIN)) || (errno != 0 && v1 == 0) || (endptr == value)) {
+		printf("ERROR: Invalid parameter (bytes)\n");
+		return -1;
+	}
+	if((v1 < BUFFER_SIZE_MIN) || (v1 > BUFFER_SIZE_MAX)) {
+		printf("ERROR: invalid buffer size (must be between %d and %d bytes)\n", BUFFER_SIZE_MIN, BUFFER_SIZE_MAX);
+		return -1;
+	}
+	/* buffers come in power of two sizes */
+	v1=BUFFER_CLASS_SIZE(buffer_class(v1));
+	if(!strncmp(setting, "size", 4)) {
+		balancer->buffer_size=v1;
+		printf("Set buffer size to %d bytes\n", balancer->buffer_size);
+	}
+	else if(!strncmp(setting, "max", 3)) {
+		balancer->buffer_size_max=v1;
+		printf("Set maximum adaptive buffer size to %d bytes\n", balancer->buffer_size_max);
+	}
+	else {
+		printf("ERROR: unknown buffer setting (must be size, max or mode)\n");
+		return -1;
+	}
+	return 0;
+}
+
 /* this command handles the hash rebalance size setting */
 int cmd_hrs(char *value) {
 	char *endptr;
@@ -815,10 +960,12 @@ int cmd_clone_mode(char *value) {
 	}
 	if(!strncmp(value, "e",1)) {
 		balancer->clone_mode=CLONE_MODE_ON;
+		SERVERS_CHANGED();
 		printf("Enabling clone mode\n");
 	}
 	else if(!strncmp(value, "d",1)) {
 		balancer->clone_mode=CLONE_MODE_OFF;
+		SERVERS_CHANGED();
 		printf("Disabling clone mode\n");
 	}
 	else {
@@ -837,10 +984,12 @@ int cmd_overload_mode(char *value) {
 	}
 	if(!strncmp(value, "r",1)) {
 		balancer->overload_mode=OVERLOAD_MODE_RELAXED;
+		SERVERS_CHANGED();
 		printf("Set overload mode to RELAXED\n");
 	}
 	else if(!strncmp(value, "s",1)) {
 		balancer->overload_mode=OVERLOAD_MODE_STRICT;
+		SERVERS_CHANGED();
 		printf("Set overload mode to STRICT\n");
 	}
 	else {
@@ -853,11 +1002,42 @@ int cmd_overload_mode(char *value) {
 /* shows balancer information */
 int cmd_info() {
 	int i;
+	unsigned long long epoll_mod_calls;
+	unsigned long long epoll_mod_saved;
+	unsigned long long accept_wakeups;
+	unsigned long long accepts;
+	unsigned long long event_syscalls;
+	unsigned long long uring_sqes;
+	unsigned long long io_syscalls;
+	unsigned long long inline_writes;
+	unsigned long long http_requests;
+	unsigned long long http_switches;
+	unsigned long long connect_failovers;
+	unsigned long long available_builds;
+	unsigned long long fastopen_accepts;
+	unsigned long long early_reads;
+	unsigned long long latency[LATENCY_BUCKETS];
+	unsigned long long timed;
+	unsigned long long seen;
+	int bucket;
+	unsigned long long client_timeouts;
+	unsigned long long member_timeouts;
+	unsigned long long lifetime_timeouts;
+	unsigned long long inline_fallbacks;
+	unsigned long long buffer_bytes;
+	unsigned long long buffer_blocks_used;
+	unsigned long long buffer_bytes_used;
+	unsigned long long buffer_bytes_peak;
+	unsigned long long buffer_waits;
 	printf("Process info\n");
 	printf("============\n");
 	printf("Octopus version :	%s\n", balancer->version);
 	printf("Balancer PID:		%d\n", balancer->master_pid);
 	printf("Monitor PID:		%d\n", balancer->monitor_pid);
+	printf("Workers:		%d\n", balancer->workers);
+	for(i=1; i<balancer->workers; i++) {
+		printf("Worker %2d PID:		%d\n", i, balancer->worker_pids[i]);
+	}
 	printf("Shared Memory ID:	%d\n", balancer->shmid);
 	printf("Shared Memory file:	%s\n", balancer->shm_run_file_fullname);
 	printf("Debug Level:		%d\n", balancer->debug_level);
@@ -873,10 +1053,202 @@ int cmd_info() {
 	printf("Session Limit:		%d\n", balancer->session_limit);
 	printf("\n");
 
+	printf("Event loop info\n");
+	printf("===============\n");
+	printf("I/O backend:		%s\n", io_backend_status[balancer->io_backend]);
+	printf("Epoll mode:		%s\n", epoll_mode_status[balancer->epoll_mode]);
+	printf("Inline writes:		%s\n", inline_writes_status[balancer->inline_writes]);
+	epoll_mod_calls=0;
+	epoll_mod_saved=0;
+	accept_wakeups=0;
+	accepts=0;
+	event_syscalls=0;
+	uring_sqes=0;
+	io_syscalls=0;
+	inline_writes=0;
+	inline_fallbacks=0;
+	for(i=0; i<balancer->workers; i++) {
+		epoll_mod_calls += balancer->worker_stats[i].epoll_mod_calls;
+		epoll_mod_saved += balancer->worker_stats[i].epoll_mod_saved;
+		accept_wakeups += balancer->worker_stats[i].accept_wakeups;
+		accepts += balancer->worker_stats[i].accepts;
+		event_syscalls += balancer->worker_stats[i].event_syscalls;
+		uring_sqes += balancer->worker_stats[i].uring_sqes;
+		io_syscalls += balancer->worker_stats[i].io_syscalls;
+		inline_writes += balancer->worker_stats[i].inline_writes;
+		inline_fallbacks += balancer->worker_stats[i].inline_fallbacks;
+	}
+	printf("epoll_ctl MOD calls:	%llu\n", epoll_mod_calls);
+	printf("epoll_ctl MOD saved:	%llu\n", epoll_mod_saved);
+	if(balancer->accept_budget == 0) {
+		printf("Accept budget:		unlimited\n");
+	}
+	else {
+		printf("Accept budget:		%d\n", balancer->accept_budget);
+	}
+	printf("Accept wakeups:		%llu\n", accept_wakeups);
+	printf("Accepted connections:	%llu\n", accepts);
+	if(accept_wakeups > 0) {
+		printf("Accepts per wakeup:	%.2f\n", (double)accepts / accept_wakeups);
+	}
+	if((balancer->algorithm == ALGORITHM_HASH) || (balancer->algorithm == ALGORITHM_STATIC)) {
+		early_reads=0;
+		for(i=0; i<balancer->workers; i++) {
+			early_reads += balancer->worker_stats[i].early_reads;
+		}
+		if(balancer->defer_accept > 0) {
+			printf("Deferred accept:	%d seconds, %llu requests read on accept\n", balancer->defer_accept, early_reads);
+		}
+		else {
+			printf("Deferred accept:	Disabled\n");
+		}
+	}
+	/* the median accept to member connect time, from the merged histograms of the workers */
+	memset(latency, '\0', sizeof(latency));
+	timed=0;
+	for(i=0; i<balancer->workers; i++) {
+		for(bucket=0; bucket < LATENCY_BUCKETS; bucket++) {
+			latency[bucket] += balancer->worker_stats[i].connect_latency[bucket];
+			timed += balancer->worker_stats[i].connect_latency[bucket];
+		}
+	}
+	if(timed > 0) {
+		seen=0;
+		for(bucket=0; bucket < LATENCY_BUCKETS; bucket++) {
+			seen += latency[bucket];
+			if((seen * 2) >= timed) {
+				break;
+			}
+		}
+		printf("Accept to connect:	median %llu-%llu us over %llu sessions\n", latency_bound(bucket), latency_bound(bucket + 1), timed);
+	}
+	printf("Event loop syscalls:	%llu\n", event_syscalls);
+	if(accepts > 0) {
+		printf("Syscalls per conn:	%.2f\n", (double)event_syscalls / accepts);
+	}
+	/* the session data and connects, which the io_uring backend submits to the ring instead */
+	printf("Session I/O syscalls:	%llu\n", io_syscalls);
+	if(balancer->io_backend != IO_BACKEND_EPOLL) {
+		printf("io_uring submissions:	%llu\n", uring_sqes);
+	}
+	printf("Inline write attempts:	%llu\n", inline_writes);
+	printf("Inline write fallbacks:	%llu\n", inline_fallbacks);
+	printf("\n");
+
+	printf("Buffer info\n");
+	printf("===========\n");
+	buffer_bytes=0;
+	buffer_blocks_used=0;
+	buffer_bytes_used=0;
+	buffer_bytes_peak=0;
+	buffer_waits=0;
+	for(i=0; i<balancer->workers; i++) {
+		buffer_bytes += balancer->worker_stats[i].buffer_bytes;
+		buffer_blocks_used += balancer->worker_stats[i].buffer_blocks_used;
+		buffer_bytes_used += balancer->worker_stats[i].buffer_bytes_used;
+		buffer_bytes_peak += balancer->worker_stats[i].buffer_bytes_peak;
+		buffer_waits += balancer->worker_stats[i].buffer_waits;
+	}
+	if(balancer->buffer_memory == 0) {
+		printf("Buffer memory budget:	unlimited\n");
+	}
+	else {
+		printf("Buffer memory budget:	%d MB\n", balancer->buffer_memory);
+	}
+	printf("Buffer mode:		%s\n", buffer_mode_status[balancer->buffer_mode]);
+	printf("Buffer size:		%d bytes\n", balancer->buffer_size);
+	if(balancer->buffer_mode == BUFFER_MODE_ADAPTIVE) {
+		printf("Buffer size max:	%d bytes\n", balancer->buffer_size_max);
+	}
+	printf("Buffer memory:		%llu KB\n", buffer_bytes / 1024);
+	printf("Buffers in use:		%llu (%llu KB)\n", buffer_blocks_used, buffer_bytes_used / 1024);
+	printf("Buffer memory peak:	%llu KB\n", buffer_bytes_peak / 1024);
+	printf("Buffer waits:		%llu\n", buffer_waits);
+	printf("\n");
+
 	printf("Balancing algorithm info\n");
 	printf("========================\n");
 	printf("Algorithm:		%s\n", algorithm_status[balancer->algorithm - 1]);
 	printf("Clone mode:		%s\n", cloning_status[balancer->clone_mode]);
+	printf("Relay mode:		%s\n", relay_mode_status[balancer->relay_mode]);
+	printf("HTTP balancing:		%s\n", http_balancing_status[balancer->http_balancing]);
+	if(balancer->http_balancing == HTTP_BALANCING_REQUEST) {
+		http_requests=0;
+		http_switches=0;
+		for(i=0; i<balancer->workers; i++) {
+			http_requests += balancer->worker_stats[i].http_requests;
+			http_switches += balancer->worker_stats[i].http_switches;
+		}
+		printf("Requests rebalanced:	%llu\n", http_requests);
+		printf("Member switches:	%llu\n", http_switches);
+	}
+	connect_failovers=0;
+	for(i=0; i<balancer->workers; i++) {
+		connect_failovers += balancer->worker_stats[i].connect_failovers;
+	}
+	printf("Connect failovers:	%llu\n", connect_failovers);
+	available_builds=0;
+	for(i=0; i<balancer->workers; i++) {
+		available_builds += balancer->worker_stats[i].available_builds;
+	}
+	printf("Server set rebuilds:	%llu\n", available_builds);
+	if(balancer->listen_fastopen > 0) {
+		fastopen_accepts=0;
+		for(i=0; i<balancer->workers; i++) {
+			fastopen_accepts += balancer->worker_stats[i].fastopen_accepts;
+		}
+		printf("Listener Fast Open:	queue of %d, %llu clients sent data with the SYN\n", balancer->listen_fastopen, fastopen_accepts);
+	}
+	else {
+		printf("Listener Fast Open:	Disabled\n");
+	}
+	printf("Member Fast Open:	%s\n", member_fastopen_status[balancer->member_fastopen]);
+	client_timeouts=0;
+	member_timeouts=0;
+	lifetime_timeouts=0;
+	for(i=0; i<balancer->workers; i++) {
+		client_timeouts += balancer->worker_stats[i].client_timeouts;
+		member_timeouts += balancer->worker_stats[i].member_timeouts;
+		lifetime_timeouts += balancer->worker_stats[i].lifetime_timeouts;
+	}
+	if(balancer->client_timeout > 0) {
+		printf("Client timeout:		%d seconds, %llu sessions ended\n", balancer->client_timeout, client_timeouts);
+	}
+	else {
+		printf("Client timeout:		Disabled\n");
+	}
+	if(balancer->member_timeout > 0) {
+		printf("Member timeout:		%d seconds, %llu sessions ended\n", balancer->member_timeout, member_timeouts);
+	}
+	else {
+		printf("Member timeout:		Disabled\n");
+	}
+	if(balancer->session_lifetime > 0) {
+		printf("Session lifetime:	%d seconds, %llu sessions ended\n", balancer->session_lifetime, lifetime_timeouts);
+	}
+	else {
+		printf("Session lifetime:	Disabled\n");
+	}
+	if(balancer->drain_timeout > 0) {
+		printf("Upgrade drain timeout:	%d seconds\n", balancer->drain_timeout);
+	}
+	else {
+		printf("Upgrade drain timeout:	Disabled\n");
+	}
+	printf("Clone lag allowance:	%d bytes\n", balancer->clone_lag);
+	if(balancer->keepalive_pool > 0) {
+		printf("Keep-alive pool:	%d per member and worker\n", balancer->keepalive_pool);
+		printf("Keep-alive timeout:	%d seconds\n", balancer->keepalive_timeout);
+	}
+	else {
+		printf("Keep-alive pool:	Disabled\n");
+	}
+	if(balancer->warm_pool > 0) {
+		printf("Warm pool:		%d per member and worker\n", balancer->warm_pool);
+	}
+	else {
+		printf("Warm pool:		Disabled\n");
+	}
 	printf("Overload mode:		%s\n", overload_status[balancer->overload_mode]);
 	printf("Session Weight:		%f\n", balancer->session_weight);
 	printf("Default max conn limit:	%d\n", balancer->default_maxc);
@@ -925,6 +1297,32 @@ int cmd_kill() {
 	exit(0);
 }
 
+/* makes the server start its binary again, which takes over the listener and the state. The old
+ * processes finish their sessions and the admin has to connect to the new instance */
+int cmd_upgrade() {
+	if(readonly==1) {
+		printf("ERROR: This command not available in read-only mode!\n");
+		return -1;
+	}
+	printf("Upgrading server with master pid %d. Reconnect once the new binary has taken over\n", balancer->master_pid);
+	kill(balancer->master_pid, SIGUSR2);
+	exit(0);
+}
+
+/* makes the server read its configuration file again. The outcome is in the server's log */
+int cmd_reload() {
+	if(readonly==1) {
+		printf("ERROR: This command not available in read-only mode!\n");
+		return -1;
+	}
+	if(kill(balancer->master_pid, SIGHUP) != 0) {
+		printf("ERROR: unable to signal the server with master pid %d: %s\n", balancer->master_pid, strerror(errno));
+		return -1;
+	}
+	printf("Asked the server with master pid %d to reload its configuration file, see its log for the changes\n", balancer->master_pid);
+	return 0;
+}
+
 /* toggles a servers 'standby' flag */
 int cmd_standby(char *type, char *id) {
 	int status=0;
@@ -941,6 +1339,7 @@ int cmd_standby(char *type, char *id) {
 		printf("Creating standby status for %s\n", subject[0]->name);
 		subject[0]->standby_state= STANDBY_STATE_TRUE;
 	}
+	SERVERS_CHANGED();
 	return 0;
 }
 
@@ -953,6 +1352,7 @@ int cmd_delete(char *type, char *id) {
 		return -1;
 	}
 	subject[0]->status=SERVER_STATE_DELETED;
+	SERVERS_CHANGED();
 	printf("Deleting server \"%s\"\n", subject[0]->name);
 	return 0;
 }
@@ -979,10 +1379,30 @@ int cmd_maxc(char *type, char *id, char *value) {
 		return -1;
 	}
 	subject[0]->maxc=atoi(value);
+	SERVERS_CHANGED();
 	printf("Setting maximum connections to %d for server \"%s\"\n", subject[0]->maxc, subject[0]->name);
 	return 0;
 }
 
+/* sets a server's weight for the weighted algorithms */
+int cmd_weight(char *type, char *id, char *value) {
+	int status=0;
+	int weight=atoi(value);
+	if(!((weight >= 1) && (weight <= WEIGHT_MAX))) {
+		printf("ERROR: weight must be from 1 to %d\n", WEIGHT_MAX);
+		return -1;
+	}
+	status=set_subject(type, id, ADMIN_REQ_TRUE, SINGLE_TARGET_CMD);
+	if (status != 0) {
+		/* set_subject handles error notification */
+		return -1;
+	}
+	subject[0]->weight=weight;
+	SERVERS_CHANGED();
+	printf("Setting weight to %d for server \"%s\"\n", subject[0]->weight, subject[0]->name);
+	return 0;
+}
+
 /* enable a server */
 int cmd_enable(char *type, char *id) {
 	int i;
@@ -995,6 +1415,7 @@ int cmd_enable(char *type, char *id) {
 	for(i=0;i<subject_count;i++) {
 		if(subject[i]->status==SERVER_STATE_DISABLED) {
 			subject[i]->status=SERVER_STATE_ENABLED;
+			SERVERS_CHANGED();
 			printf("Enabling server \"%s\"\n",subject[i]->name);
 		}
 	}
@@ -1014,6 +1435,7 @@ int cmd_disable(char *type, char *id) {
 	for(i=0;i<subject_count;i++) {
 		if((subject[i]->status==SERVER_STATE_ENABLED) || (subject[i]->status==SERVER_STATE_FAILED)) {
 			subject[i]->status=SERVER_STATE_DISABLED;
+			SERVERS_CHANGED();
 			printf("Disabling server \"%s\"\n",subject[i]->name);
 		}
 	}
@@ -1034,6 +1456,9 @@ int cmd_reset(char *type, char *id) {
 		subject[i]->bsent=0;
 		subject[i]->brecv=0;
 		subject[i]->completed_c=0;
+		subject[i]->connect_failures=0;
+		subject[i]->connect_timeouts=0;
+		memset(subject[i]->buffer_reads, '\0', sizeof(subject[i]->buffer_reads));
 	}
 	if(subject_count > 1) {
 		printf("Reset all counters\n");
@@ -1059,6 +1484,9 @@ int cmd_examples() {
 	printf("Setting the maximum load we will allow for \"Hercules\" which has id # of 2\n");
 	printf("$ maxl m 2 4.0\n");
 	printf("\n");
+	printf("Sending \"Hercules\" which has id # of 2 four times the sessions of a weight 1 server under WRR and WLC\n");
+	printf("$ weight m 2 4\n");
+	printf("\n");
 	printf("Creating a new clone webserver named \"David\" @ 10.1.1.5 on tcp/80:\n");
 	printf("$ create clone David 10.1.1.5 80\n");
 	printf("\n");
@@ -1094,26 +1522,31 @@ int cmd_help() {
 		printf("[e]nable [a]ll / (<[c]lone/[m]ember> <#>)	enables all (or specified member or clone) servers\n");
 		printf("[maxc] <[c]lone/[m]ember> <#> <value>		sets the maximum number of connections for the specified member or clone\n");
 		printf("[standby] <[c]lone/[m]ember> <#>		toggles the standby state of specified member or clone\n");
+		printf("[weight] <[c]lone/[m]ember> <#> <value>	sets the weight (1 to %d) of the specified member or clone for wrr and wlc\n", WEIGHT_MAX);
 		if(balancer->snmp_status != SNMP_NOT_INCLUDED) {
 			printf("[maxl] <[c]lone/[m]ember> <#> <value>		sets the maximum load for the specified member or clone\n");
 			printf("[o]verload <[s]trict/[r]elaxed>			set the overload mode\n");
-			printf("[a]lgorithm <[rr]/[lc]/[ll]/[hash]/[static]>	set the balancing algorithm\n");
+			printf("[a]lgorithm <[rr]/[lc]/[wrr]/[wlc]/[p2c]/[ll]/[hash]/[static]>	set the balancing algorithm\n");
 			printf("[hrt] <value>	  				set the hash rebalance threshold to <value>%%\n");
 			printf("[hrs] <value>  					set the hash rebalance size to <value>%%\n");
 			printf("[hri] <value>	  				set the hash rebalance interval to <value> seconds\n");
 			printf("[snmp] <on/off>					set snmp monitoring on or off\n");
 		}
 		else {
-			printf("[a]lgorithm <[rr]/[lc]/[hash]>			set the balancing algorithm\n");
+			printf("[a]lgorithm <[rr]/[lc]/[wrr]/[wlc]/[p2c]/[hash]>	set the balancing algorithm\n");
 		}
 		printf("[clone] <[e]nable/[d]isable>			set the cloning mode\n");
 		printf("[monitor] <seconds>				set the time period between runs of the monitor process\n");
+		printf("[accept] <value>				set the number of connections accepted per wakeup (0 is unlimited)\n");
+		printf("[buffer] <size/max> <bytes> | mode <fixed/adaptive>	set the session buffer size, adaptive size cap or mode\n");
 		printf("[r]eset <[a]ll> / <[c]lone/[m]ember> <#>	resets counters for member, clone or all servers\n");
 		printf("[i]nfo						overview of load balancer configuration\n");
 		printf("[scan]						search for and connect to other instances of octopus running on same host\n");
 		printf("[debug] <level>					set the debug level. <level> is an integer ranging from 0 (no debug) to 6 (extremely verbose)\n");
 		printf("[q]uit						quit the admin interface\n");
 		printf("[kill]						kill server process (and admin)\n");
+		printf("[upgrade]					start the server binary again without closing the listener (and quit admin)\n");
+		printf("[reload]					read the configuration file again, keeping the sessions\n");
 		printf("[ex]amples					show some usage examples\n");
 		printf("[x]tended output mode toggle			toggles extra columns like bytes in/out, handled connections and raw SNMP load\n");
 		printf("[?]						this screen\n");
@@ -1148,22 +1581,38 @@ int cmd_snmp(char *value) {
 	return 0;
 }
 
+/* returns the lowest time in microseconds counted in a bucket of the accept to connect histogram, see
+ * connect_latency() in connect.c
+ */
+unsigned long long latency_bound(int bucket) {
+	if(bucket < 4) {
+		return (unsigned long long)bucket;
+	}
+	return (unsigned long long)(4 + (bucket % 4)) << ((bucket / 4) - 1);
+}
+
 /* show current state of balancer */
 int cmd_show() {
 	int i;
+	int j;
+	int min_class;
+	int max_class;
+	unsigned long reads;
+	unsigned long hits;
+	unsigned long misses;
 	/* prints out CSV output when requested */
 	if(csv==1) {
 		for(i=0; i<balancer->nmembers; i++) {
 			if(balancer->members[i].status == SERVER_STATE_FREE) {
 				continue;
 			}
-			printf("%s,%d,%s,%s,%s,%s,%d,%d,%d,%lu,%lu,%lu,%f,%f,%d\n","Member", i, balancer->members[i].name, server_status[balancer->members[i].status], standby_status[balancer->members[i].standby_state], inet_ntoa(balancer->members[i].myaddr.sin_addr), balancer->members[i].port, balancer->members[i].c, balancer->members[i].maxc, balancer->members[i].completed_c, balancer->members[i].bsent, balancer->members[i].brecv, balancer->members[i].load, balancer->members[i].maxl, balancer->members[i].e_load);
+			printf("%s,%d,%s,%s,%s,%s,%d,%d,%d,%lu,%lu,%lu,%f,%f,%d,%d,%lu,%lu,%lu,%lu,%d,%lu,%lu,%lu,%lu,%lu,%d\n","Member", i, balancer->members[i].name, server_status[balancer->members[i].status], standby_status[balancer->members[i].standby_state], inet_ntoa(balancer->members[i].myaddr.sin_addr), balancer->members[i].port, balancer->members[i].c, balancer->members[i].maxc, balancer->members[i].completed_c, balancer->members[i].bsent, balancer->members[i].brecv, balancer->members[i].load, balancer->members[i].maxl, balancer->members[i].e_load, balancer->members[i].pool_idle, balancer->members[i].pool_hits, balancer->members[i].pool_misses, balancer->members[i].connect_failures, balancer->members[i].connect_timeouts, balancer->members[i].warm_idle, balancer->members[i].warm_hits, balancer->members[i].warm_misses, balancer->members[i].warm_stale, balancer->members[i].fastopen_sent, balancer->members[i].fastopen_acked, balancer->members[i].weight);
 		}
 		for(i=0; i<balancer->nclones; i++) {
 			if(balancer->clones[i].status == SERVER_STATE_FREE) {
 				continue;
 			}
-			printf("%s,%d,%s,%s,%s,%s,%d,%d,%d,%lu,%lu,%lu,%f,%f,%d\n","Clone", i, balancer->clones[i].name, server_status[balancer->clones[i].status], standby_status[balancer->clones[i].standby_state], inet_ntoa(balancer->clones[i].myaddr.sin_addr), balancer->clones[i].port, balancer->clones[i].c, balancer->clones[i].maxc, balancer->clones[i].completed_c, balancer->clones[i].bsent, balancer->clones[i].brecv, balancer->clones[i].load, balancer->clones[i].maxl, balancer->clones[i].e_load );
+			printf("%s,%d,%s,%s,%s,%s,%d,%d,%d,%lu,%lu,%lu,%f,%f,%d,%d\n","Clone", i, balancer->clones[i].name, server_status[balancer->clones[i].status], standby_status[balancer->clones[i].standby_state], inet_ntoa(balancer->clones[i].myaddr.sin_addr), balancer->clones[i].port, balancer->clones[i].c, balancer->clones[i].maxc, balancer->clones[i].completed_c, balancer->clones[i].bsent, balancer->clones[i].brecv, balancer->clones[i].load, balancer->clones[i].maxl, balancer->clones[i].e_load, balancer->clones[i].weight);
 		}
 	}
 	/* when the user asks for SHOW we suppress different column heads if they're not required (ie. load column is irrelevant is SNMP is not compiled in */
@@ -1182,9 +1631,12 @@ int cmd_show() {
 
 		/* COLUMN HEADINGS */
 		printf("%9s %3s %16s  %8s %16s %4s %5s ","type", "#", "name", "status", "ip-address", "port", "c");
+		if((balancer->algorithm == ALGORITHM_WRR) || (balancer->algorithm == ALGORITHM_WLC)) {
+			printf("%3s ", "wt");
+		}
 
 		if(extended_output_mode == 1) {
-			printf("%5s %7s %12s %12s","maxc", "hc", "bsent", "brecv");
+			printf("%5s %7s %12s %12s %6s %6s","maxc", "hc", "bsent", "brecv", "cfail", "ctmo");
 		}
 		if(balancer->snmp_status==SNMP_ENABLED) {
 			if(extended_output_mode == 1) {
@@ -1192,6 +1644,18 @@ int cmd_show() {
 			}
 			printf("%7s", "loading");
 		}
+		if(balancer->keepalive_pool > 0) {
+			printf(" %5s %6s", "idle", "reuse");
+		}
+		if(balancer->warm_pool > 0) {
+			printf(" %5s %6s", "warm", "whit");
+			if(extended_output_mode == 1) {
+				printf(" %6s", "stale");
+			}
+		}
+		if(balancer->member_fastopen == MEMBER_FASTOPEN_ON) {
+			printf(" %6s %6s", "tfo", "tfoack");
+		}
 		printf("\n");
 
 
@@ -1201,8 +1665,11 @@ int cmd_show() {
 				continue;
 			}
 			printf("%3s%6s %3d %16s  %8s %16s %4d %5d ", standby_status[balancer->members[i].standby_state], "Member",i, balancer->members[i].name, server_status[balancer->members[i].status], inet_ntoa(balancer->members[i].myaddr.sin_addr), balancer->members[i].port, balancer->members[i].c);
+			if((balancer->algorithm == ALGORITHM_WRR) || (balancer->algorithm == ALGORITHM_WLC)) {
+				printf("%3d ", balancer->members[i].weight);
+			}
 			if(extended_output_mode == 1) {
-				printf("%5d %7lu %12lu %12lu", balancer->members[i].maxc, balancer->members[i].completed_c, balancer->members[i].bsent, balancer->members[i].brecv);
+				printf("%5d %7lu %12lu %12lu %6lu %6lu", balancer->members[i].maxc, balancer->members[i].completed_c, balancer->members[i].bsent, balancer->members[i].brecv, balancer->members[i].connect_failures, balancer->members[i].connect_timeouts);
 			}
 			if(balancer->snmp_status==SNMP_ENABLED) {
 				if(extended_output_mode == 1) {
@@ -1221,6 +1688,37 @@ int cmd_show() {
 					printf("   %3d%%", balancer->members[i].e_load);
 				}
 			}
+			/* keep-alive pool: idle connections and the share of sessions that got one */
+			if(balancer->keepalive_pool > 0) {
+				hits=balancer->members[i].pool_hits;
+				misses=balancer->members[i].pool_misses;
+				printf(" %5d", balancer->members[i].pool_idle);
+				if((hits + misses) > 0) {
+					printf(" %5.1f%%", (double)hits * 100 / (hits + misses));
+				}
+				else {
+					printf(" %6s", "-");
+				}
+			}
+			/* warm pool: connections made in advance, the share of sessions that got one and the ones thrown away */
+			if(balancer->warm_pool > 0) {
+				hits=balancer->members[i].warm_hits;
+				misses=balancer->members[i].warm_misses;
+				printf(" %5d", balancer->members[i].warm_idle);
+				if((hits + misses) > 0) {
+					printf(" %5.1f%%", (double)hits * 100 / (hits + misses));
+				}
+				else {
+					printf(" %6s", "-");
+				}
+				if(extended_output_mode == 1) {
+					printf(" %6lu", balancer->members[i].warm_stale);
+				}
+			}
+			/* Fast Open: connects that sent data with the SYN and the ones the member took it for */
+			if(balancer->member_fastopen == MEMBER_FASTOPEN_ON) {
+				printf(" %6lu %6lu", balancer->members[i].fastopen_sent, balancer->members[i].fastopen_acked);
+			}
 			printf("\n");
 		}
 		/* CLONE SERVER INFO LINES */
@@ -1229,8 +1727,12 @@ int cmd_show() {
 				continue;
 			}
 			printf(" %3s%5s %3d %16s  %8s %16s %4d %5d ", standby_status[balancer->clones[i].standby_state], "Clone",i, balancer->clones[i].name, server_status[balancer->clones[i].status], inet_ntoa(balancer->clones[i].myaddr.sin_addr), balancer->clones[i].port, balancer->clones[i].c);
+			if((balancer->algorithm == ALGORITHM_WRR) || (balancer->algorithm == ALGORITHM_WLC)) {
+				printf("%3d ", balancer->clones[i].weight);
+			}
 			if(extended_output_mode == 1) {
-				printf("%5d %7lu %12lu %12lu", balancer->clones[i].maxc, balancer->clones[i].completed_c, balancer->clones[i].bsent, balancer->clones[i].brecv);
+				/* clone connects aren't failed over */
+				printf("%5d %7lu %12lu %12lu %6s %6s", balancer->clones[i].maxc, balancer->clones[i].completed_c, balancer->clones[i].bsent, balancer->clones[i].brecv, "-", "-");
 			}
 			if(balancer->snmp_status==SNMP_ENABLED) {
 				if(extended_output_mode == 1) {
@@ -1251,6 +1753,51 @@ int cmd_show() {
 			}
 			printf("\n");
 		}
+		/* BUFFER SIZE HISTOGRAM, only the size classes that have been used get a column */
+		if(extended_output_mode == 1) {
+			min_class=BUFFER_CLASSES;
+			max_class=-1;
+			for(i=0; i<balancer->nmembers; i++) {
+				for(j=0; j<BUFFER_CLASSES; j++) {
+					if(balancer->members[i].buffer_reads[j] > 0) {
+						if(j < min_class) {
+							min_class=j;
+						}
+						if(j > max_class) {
+							max_class=j;
+						}
+					}
+				}
+			}
+			if(max_class >= 0) {
+				printf("\nSession buffer reads by buffer size\n");
+				printf("%9s %3s %16s ", "type", "#", "name");
+				for(j=min_class; j<=max_class; j++) {
+					if(BUFFER_CLASS_SIZE(j) >= 1048576) {
+						printf(" %9dM", BUFFER_CLASS_SIZE(j) / 1048576);
+					}
+					else {
+						printf(" %9dK", BUFFER_CLASS_SIZE(j) / 1024);
+					}
+				}
+				printf(" %10s\n", "reads/MB");
+				for(i=0; i<balancer->nmembers; i++) {
+					if(balancer->members[i].status == SERVER_STATE_FREE) {
+						continue;
+					}
+					reads=0;
+					printf("%9s %3d %16s ", "Member", i, balancer->members[i].name);
+					for(j=min_class; j<=max_class; j++) {
+						printf(" %10lu", balancer->members[i].buffer_reads[j]);
+						reads += balancer->members[i].buffer_reads[j];
+					}
+					if((balancer->members[i].bsent + balancer->members[i].brecv) > 0) {
+						printf(" %10.1f", (double)reads * 1048576 / (balancer->members[i].bsent + balancer->members[i].brecv));
+					}
+					printf("\n");
+				}
+			}
+		}
 	}
 	return 0;
 }
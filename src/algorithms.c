@@ -11,14 +11,26 @@
  */
 
 
-int get_available_servers() {
+/* builds the worker's sets of available members and clones from the SHM: the servers a new session may be sent
+ * to, or the standbys when there are none of those. Each server's place in its set is kept too, so round robin
+ * can step on from the last one chosen without a search. The sets are only built again when server_gen shows
+ * that something they depend on has changed. Sets built while a reload is writing the servers may mix old and new
+ * settings, so they are only used for the pick at hand and built again at the next one
+ */
+int build_available_servers() {
+	unsigned int seq;
 	int i=0;
-	int status;
-	using_member_standby=0;
-	using_clone_standby=0;
+	seq=balancer->server_seq;
+	__sync_synchronize();
+	available_gen=balancer->server_gen;
+	available_ready=1;
+	worker_stats->available_builds++;
+	available_member_standby=0;
+	available_clone_standby=0;
 	available_members_count=0;
 	available_clones_count=0;
-	use_clone=0;
+	memset(available_member_pos, 0xff, sizeof(available_member_pos));
+	memset(available_clone_pos, 0xff, sizeof(available_clone_pos));
 
 	for (i=0; i < balancer->nmembers; i++) {
 		/*if the candidate has exceeded its maximum load, is a standby server, or is invalid, then don't consider it */
@@ -28,6 +40,7 @@ int get_available_servers() {
 		if((balancer->overload_mode == OVERLOAD_MODE_STRICT) && (balancer->members[i].e_load > 100)) {
 			continue;
 		}
+		available_member_pos[i]=available_members_count;
 		available_members[available_members_count++] = i;
 	}
 	/* if there were no ready servers then we scan again but this time relaxing the "standby" condition as this is what standbys are for */
@@ -39,24 +52,10 @@ int get_available_servers() {
 			if((balancer->overload_mode == OVERLOAD_MODE_STRICT) && (balancer->members[i].e_load > 100)) {
 				continue;
 			}
+			available_member_pos[i]=available_members_count;
 			available_members[available_members_count++] = i;
+			available_member_standby=1;
 		}
-		/* if we still can't get a server then we return an error */
-		if (available_members_count == 0) {
-			return -1;
-		}
-		else {
-			using_member_standby=1;
-		}
-	}
-	status=verify_server(&(balancer->members[next_member]));
-	/* if the current next_member is invalid then set the first valid server we have */
-	if(status == -1) {
-		next_member=available_members[0];
-	}
-	/* if the current next_member is a standby but we have normal members available then use the normal one */
-	if((status == 1) && (using_member_standby == 0)) {
-		next_member=available_members[0];
 	}
 
 	if(balancer->clone_mode == CLONE_MODE_ON) {
@@ -68,6 +67,7 @@ int get_available_servers() {
 			if((balancer->overload_mode == OVERLOAD_MODE_STRICT) && (balancer->clones[i].e_load > 100)) {
 				continue;
 			}
+			available_clone_pos[i]=available_clones_count;
 			available_clones[available_clones_count++] = i;
 		}
 		/* if there were no ready servers then we scan again but this time relaxing the "standby" condition as this is what standbys are for */
@@ -79,20 +79,58 @@ int get_available_servers() {
 				if((balancer->overload_mode == OVERLOAD_MODE_STRICT) && (balancer->clones[i].e_load > 100)) {
 					continue;
 				}
+				available_clone_pos[i]=available_clones_count;
 				available_clones[available_clones_count++] = i;
-				using_clone_standby=1;
+				available_clone_standby=1;
 			}
 		}
-		if (available_clones_count > 0) {
-			use_clone=1;
-			status=verify_server(&(balancer->clones[next_clone]));
-			if(status == -1) {
-				next_clone=available_clones[0];
-			}
-			/* if the current next_clone is a standby but we have normal members available then use the normal one */
-			if((status == 1) && (using_member_standby == 0)) {
-				next_member=available_members[0];
-			}
+	}
+	if(balancer->algorithm == ALGORITHM_WRR) {
+		wrr_refresh(&wrr_members, balancer->members, available_member_pos, balancer->nmembers);
+		wrr_refresh(&wrr_clones, balancer->clones, available_clone_pos, balancer->nclones);
+	}
+	__sync_synchronize();
+	if((seq & 1) || (seq != balancer->server_seq)) {
+		available_ready=0;
+	}
+	return 0;
+}
+
+/* makes sure next_member (and next_clone) are in the available servers, building them again first if they are
+ * out of date
+ * returns -1 if there is no member available
+ */
+int get_available_servers() {
+	int status;
+	if(!available_ready || (available_gen != balancer->server_gen)) {
+		build_available_servers();
+	}
+	using_member_standby=available_member_standby;
+	using_clone_standby=available_clone_standby;
+	use_clone=0;
+	/* if we still can't get a server then we return an error */
+	if (available_members_count == 0) {
+		return -1;
+	}
+	status=verify_server(&(balancer->members[next_member]));
+	/* if the current next_member is invalid then set the first valid server we have */
+	if(status == -1) {
+		next_member=available_members[0];
+	}
+	/* if the current next_member is a standby but we have normal members available then use the normal one */
+	if((status == 1) && (using_member_standby == 0)) {
+		next_member=available_members[0];
+	}
+
+	if((balancer->clone_mode == CLONE_MODE_ON) && (available_clones_count > 0)) {
+		use_clone=1;
+		status=verify_server(&(balancer->clones[next_clone]));
+		if(status == -1) {
+			next_clone=available_clones[0];
+		}
+		/* if the current next_clone is a standby but we have normal members available then use the normal one */
+		if((status == 1) && (using_member_standby == 0)) {
+			next_member=available_members[0];
 		}
 	}
 	return 0;
@@ -131,10 +169,65 @@ unsigned short int DJBHash(char* str, unsigned int len) {
 
 int choose_server(SESSION *session) {
 	int status;
-	status=get_available_servers();
+	status=choose_member(session);
 	if(status != 0) {
 		return -1;
 	}
+	status=connect_server(session);
+	return status;
+}
+
+/* sets next_member (and next_clone) with the balancing algorithm. Least connections, weighted or not, picks
+ * from its index, the others from the available servers
+ * returns -1 if no member is available
+ */
+int choose_member(SESSION *session) {
+	if((balancer->algorithm == ALGORITHM_LC) || (balancer->algorithm == ALGORITHM_WLC)) {
+		return lc_choose();
+	}
+	if(get_available_servers() != 0) {
+		return -1;
+	}
+	set_server(session);
+	return 0;
+}
+
+/* per-request balancing: chooses the member for a new request on a kept-alive client connection whose earlier
+ * requests have all been answered, and moves the session to it if it isn't the current one. The old member
+ * connection goes to the keep-alive pool when it can. The session stays where it is if no member is available.
+ * returns -1 if the session was left without a member
+ */
+int choose_server_request(SESSION *session) {
+	int status;
+	SERVER *current=session->member;
+
+	/* the session's own connection doesn't count against its member while choosing */
+	server_count_add(current, -1);
+	status=choose_member(session);
+	server_count_add(current, 1);
+	worker_stats->http_requests++;
+	if((status != 0) || (&balancer->members[next_member] == current)) {
+		return 0;
+	}
+	worker_stats->http_switches++;
+	if(balancer->debug_level > 2) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: choose_server_request: moving request from member %s to %s", current->name, balancer->members[next_member].name);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	if(keepalive_put(session) != 0) {
+		disconnect_member(session);
+	}
+	session->state &= ~(STATE_MEM_CAN_READ | STATE_MEM_CAN_WRITE);
+	/* the clone keeps its connection, it is sent the whole of the client's stream */
+	use_clone=0;
+	if(connect_server(session) == -1) {
+		return -1;
+	}
+	return 0;
+}
+
+/* sets next_member (and next_clone) with the balancing algorithm */
+int set_server(SESSION *session) {
 	if(balancer->algorithm == ALGORITHM_RR) {
 		set_rr_server();
 	}
@@ -150,8 +243,16 @@ int choose_server(SESSION *session) {
 	else if(balancer->algorithm == ALGORITHM_STATIC) {
 		set_static_server(session);
 	}
-	status=connect_server(session);
-	return status;
+	else if(balancer->algorithm == ALGORITHM_WRR) {
+		set_wrr_server();
+	}
+	else if(balancer->algorithm == ALGORITHM_WLC) {
+		set_lc_server();
+	}
+	else if(balancer->algorithm == ALGORITHM_P2C) {
+		set_p2c_server();
+	}
+	return 0;
 }
 
 int set_static_server(SESSION *session) {
@@ -162,7 +263,11 @@ int set_static_server(SESSION *session) {
 	char *uri = NULL;
 
 	/* copy up to URI_LINE_LEN characters from the first line of the request */
-	memccpy(request_line, session->client_read_buffer, '\n', URI_LINE_LEN);
+	buffer_peek(&session->client_buffer, request_line, URI_LINE_LEN - 1);
+	uri_start=strchr(request_line, '\n');
+	if(uri_start != NULL) {
+		*(uri_start + 1)='\0';
+	}
 	/* get a pointer to the second word of the request */
 	uri_start=strchr(request_line, ' ');
 	if(uri_start != NULL) {
@@ -210,7 +315,11 @@ int set_hash_server(SESSION *session) {
 	char *uri = NULL;
 
 	/* copy up to URI_LINE_LEN characters from the first line of the request */
-	memccpy(request_line, session->client_read_buffer, '\n', URI_LINE_LEN);
+	buffer_peek(&session->client_buffer, request_line, URI_LINE_LEN - 1);
+	uri_start=strchr(request_line, '\n');
+	if(uri_start != NULL) {
+		*(uri_start + 1)='\0';
+	}
 	/* get a pointer to the second word of the request */
 	uri_start=strchr(request_line, ' ');
 	if(uri_start != NULL) {
@@ -266,9 +375,9 @@ int set_hash_server(SESSION *session) {
 			/* then choose a new next_member */
 			set_lc_server();
 			/* for accounting, decrement the dead server's amount of hashes */
-			candidate->hash_table_usage --;
+			COUNTER_SUB(candidate->hash_table_usage, 1);
 			/* for accounting, the new server gets assigned another hash */
-			balancer->members[next_member].hash_table_usage ++;
+			COUNTER_ADD(balancer->members[next_member].hash_table_usage, 1);
 			/* finally, update the actual hash table */
 			balancer->hash_table[hash]=next_member;
 
@@ -284,7 +393,7 @@ int set_hash_server(SESSION *session) {
 		/* when we have to choose a server, use LC as the selection algorithm. */
 		set_lc_server();
 		/*for accounting, the new server gets assigned another hash */
-		balancer->members[next_member].hash_table_usage ++;
+		COUNTER_ADD(balancer->members[next_member].hash_table_usage, 1);
 		/*finally, update the actual hash table */
 		balancer->hash_table[hash]=next_member;
 	}
@@ -316,8 +425,28 @@ int set_ll_server() {
 }
 
 /* sets the next_member and next_clone variables for the least connection algorithm */
-/* the member and clone with the lowest number of active connections is the next_member and next_ghost respectively */
+/* the member and clone with the lowest number of active connections is the next_member and next_ghost respectively.
+ * Used where another algorithm falls back to least connections, get_available_servers() has decided on the clone
+ */
 int set_lc_server() {
+	int i;
+	lc_sync();
+	i=lc_pick(&lc_members, balancer->members, balancer->nmembers, next_member);
+	if(i >= 0) {
+		next_member=i;
+	}
+	if(use_clone==1) {
+		i=lc_pick(&lc_clones, balancer->clones, balancer->nclones, next_clone);
+		if(i >= 0) {
+			next_clone=i;
+		}
+	}
+	return 0;
+}
+
+/* least connections, weighted under WLC, among available_members and available_clones, for a failover where the
+ * list has been narrowed down to the members not tried yet */
+int set_lc_list() {
 	unsigned short int i;
 	/* use roundrobin to set the next_member to the next server in list, this is useful when sessions are at zero or are even. It spreads out
 	 * the requests which looks nicer in the interface to prevent scary looking skewing and also provides some better server load balancing
@@ -328,7 +457,7 @@ int set_lc_server() {
 	for (i=0; i < available_members_count; i++) {
 		candidate=&(balancer->members[available_members[i]]);
 		/*if the candidate has less active connections than the current next_member and it is alive, then it becomes the new next_member */
-		if(candidate->c < balancer->members[next_member].c) {
+		if(lc_key(candidate) < lc_key(&balancer->members[next_member])) {
 			next_member=candidate->id;
 		}
 	}
@@ -336,7 +465,7 @@ int set_lc_server() {
 		for (i=0; i < available_clones_count; i++) {
 			candidate=&(balancer->clones[available_clones[i]]);
 			/*if the candidate has less active connections than the current next_clone and it is alive, then it becomes the new next_clone */
-			if(candidate->c < balancer->clones[next_clone].c) {
+			if(lc_key(candidate) < lc_key(&balancer->clones[next_clone])) {
 				next_clone=candidate->id;
 			}
 		}
@@ -344,26 +473,356 @@ int set_lc_server() {
 	return 0;
 }
 
+/* The least connections index.
+ *
+ * Each worker keeps a tournament tree over the member slots, and one over the clone slots. A leaf holds the
+ * server's connection count, LC_KEY_STANDBY more for a standby, or LC_KEY_NONE if the server can't be chosen
+ * (not enabled, at maxc, or overloaded in strict mode), and every node above holds the smaller of its two
+ * children. The root is the lowest count, so a pick walks down one path to the first server with it after the
+ * last one chosen, ties going round robin, and a standby only comes up when no normal server is left.
+ *
+ * The worker updates a leaf whenever it changes a server's count. The state the monitor and the admin change
+ * bumps server_gen, and the index is rebuilt from the SHM at the next pick. The other workers' connections are
+ * picked up in two ways: the server a pick lands on is checked against the SHM and its leaf corrected if it was
+ * out of date, and the whole index is rebuilt every LC_INDEX_REFRESH milliseconds, which also finds servers
+ * whose count has dropped.
+ *
+ * Under WLC a leaf holds the connections the server would have with one more session, per unit of weight, so
+ * a server of weight 4 takes four times the sessions of one of weight 1 before they come level.
+ */
+
+/* the key of a server in the index */
+int lc_key(SERVER *server) {
+	int key=server->c;
+	if((server->status != SERVER_STATE_ENABLED) || (server->c >= server->maxc)) {
+		return LC_KEY_NONE;
+	}
+	if((balancer->overload_mode == OVERLOAD_MODE_STRICT) && (server->e_load > 100)) {
+		return LC_KEY_NONE;
+	}
+	if(balancer->algorithm == ALGORITHM_WLC) {
+		key=((server->c + 1) * WEIGHT_MAX) / server->weight;
+	}
+	if(server->standby_state == STANDBY_STATE_TRUE) {
+		return LC_KEY_STANDBY + key;
+	}
+	return key;
+}
+
+/* sets a leaf and the nodes above it */
+int lc_set(LC_INDEX *index, int slot, int key) {
+	int node=index->size + slot;
+	index->key[node]=key;
+	for(node >>= 1; node > 0; node >>= 1) {
+		index->key[node]=(index->key[2 * node] < index->key[2 * node + 1]) ? index->key[2 * node] : index->key[2 * node + 1];
+	}
+	return 0;
+}
+
+/* builds the index from the SHM */
+int lc_refresh(LC_INDEX *index, SERVER *servers, int n) {
+	int node;
+	int i;
+	/* the tree is only as wide as the servers need */
+	for(index->size=1; index->size < n; index->size <<= 1);
+	for(i=0; i < index->size; i++) {
+		index->key[index->size + i]=(i < n) ? lc_key(&servers[i]) : LC_KEY_NONE;
+	}
+	for(node=index->size - 1; node > 0; node--) {
+		index->key[node]=(index->key[2 * node] < index->key[2 * node + 1]) ? index->key[2 * node] : index->key[2 * node + 1];
+	}
+	index->n=n;
+	index->gen=balancer->server_gen;
+	index->built=timer_now;
+	index->ready=1;
+	return 0;
+}
+
+/* rebuilds the indexes if they are due, or the servers have changed */
+int lc_sync() {
+	if(!lc_members.ready || (lc_members.gen != balancer->server_gen) || (lc_members.n != balancer->nmembers) || ((timer_now - lc_members.built) >= LC_INDEX_REFRESH)) {
+		lc_refresh(&lc_members, balancer->members, balancer->nmembers);
+	}
+	if(!lc_clones.ready || (lc_clones.gen != balancer->server_gen) || (lc_clones.n != balancer->nclones) || ((timer_now - lc_clones.built) >= LC_INDEX_REFRESH)) {
+		lc_refresh(&lc_clones, balancer->clones, balancer->nclones);
+	}
+	return 0;
+}
+
+/* called after the worker has changed a server's connection count */
+int lc_update(SERVER *server) {
+	int slot;
+	if((server >= balancer->members) && (server < balancer->members + MAXSERVERS)) {
+		slot=server - balancer->members;
+		if(lc_members.ready && (slot < lc_members.n)) {
+			lc_set(&lc_members, slot, lc_key(server));
+		}
+	}
+	else {
+		slot=server - balancer->clones;
+		if(lc_clones.ready && (slot < lc_clones.n)) {
+			lc_set(&lc_clones, slot, lc_key(server));
+		}
+	}
+	return 0;
+}
+
+/* changes a server's connection count by n. The worker's least connections index follows it, and reaching maxc
+ * or dropping back under it changes the servers available to every worker
+ */
+int server_count_add(SERVER *server, int n) {
+	int c=COUNTER_ADD(server->c, n);
+	if((c < server->maxc) != ((c + n) < server->maxc)) {
+		SERVERS_CHANGED();
+	}
+	lc_update(server);
+	return 0;
+}
+
+/* the first slot from 'from' on below node, which covers slots lo to hi, whose key is key. Only the subtrees
+ * holding key are walked into */
+int lc_find(LC_INDEX *index, int node, int lo, int hi, int from, int key) {
+	int mid;
+	int slot;
+	if((hi < from) || (index->key[node] != key)) {
+		return -1;
+	}
+	if(lo == hi) {
+		return lo;
+	}
+	mid=(lo + hi) / 2;
+	slot=lc_find(index, 2 * node, lo, mid, from, key);
+	if(slot >= 0) {
+		return slot;
+	}
+	return lc_find(index, 2 * node + 1, mid + 1, hi, from, key);
+}
+
+/* the server with the fewest connections, the first one after last on a tie, or -1 if none can be chosen */
+int lc_pick(LC_INDEX *index, SERVER *servers, int n, int last) {
+	int tries;
+	int slot;
+	int key;
+
+	for(tries=0; tries <= LC_PICK_RETRIES; tries++) {
+		/* the last try is on an index just built */
+		if(tries == LC_PICK_RETRIES) {
+			lc_refresh(index, servers, n);
+		}
+		if(index->key[1] == LC_KEY_NONE) {
+			return -1;
+		}
+		slot=lc_find(index, 1, 0, index->size - 1, last + 1, index->key[1]);
+		if(slot < 0) {
+			slot=lc_find(index, 1, 0, index->size - 1, 0, index->key[1]);
+		}
+		key=lc_key(&servers[slot]);
+		if(key == index->key[index->size + slot]) {
+			break;
+		}
+		/* another worker or the monitor has changed the server since its leaf was set */
+		lc_set(index, slot, key);
+	}
+	return slot;
+}
+
+/* least connections for a new session: sets next_member and, in clone mode, next_clone from the indexes
+ * returns -1 if no member is available
+ */
+int lc_choose() {
+	int i;
+	lc_sync();
+	i=lc_pick(&lc_members, balancer->members, balancer->nmembers, next_member);
+	if(i < 0) {
+		return -1;
+	}
+	next_member=i;
+	using_member_standby=(lc_members.key[lc_members.size + i] >= LC_KEY_STANDBY);
+	use_clone=0;
+	using_clone_standby=0;
+	if(balancer->clone_mode == CLONE_MODE_ON) {
+		i=lc_pick(&lc_clones, balancer->clones, balancer->nclones, next_clone);
+		if(i >= 0) {
+			next_clone=i;
+			use_clone=1;
+			using_clone_standby=(lc_clones.key[lc_clones.size + i] >= LC_KEY_STANDBY);
+		}
+	}
+	return 0;
+}
+
 /* sets the next_member and next_clone variables for the round robin algorithm */
 /* returns 0 if both member and clone are valid */
 /* returns 1 if the member is valid but the clone is not */
 /* returns -1 if member is invalid */
 int set_rr_server() {
 	int i;
-	for (i=0; i < available_members_count; i++) {
-		if (available_members[i]==next_member) {
-			next_member=balancer->members[(available_members[((i+1) % available_members_count)])].id;
-			break;
-		}
+	i=available_member_pos[next_member];
+	if(i >= 0) {
+		next_member=balancer->members[(available_members[((i+1) % available_members_count)])].id;
 	}
 	if(use_clone==1) {
-		for (i=0; i < available_clones_count; i++) {
-			if (available_clones[i]==next_clone) {
-				next_clone=balancer->clones[(available_clones[((i+1) % available_clones_count)])].id;
-				break;
+		i=available_clone_pos[next_clone];
+		if(i >= 0) {
+			next_clone=balancer->clones[(available_clones[((i+1) % available_clones_count)])].id;
+		}
+	}
+	return 0;
+}
+
+/* Smooth weighted round robin.
+ *
+ * Each server has a pass, and the one with the lowest pass is chosen next and moves on by WRR_STRIDE divided by
+ * its weight. A server of weight 3 moves a third as far as one of weight 1 so it is chosen three times as often,
+ * and the servers' sessions are spread through the round rather than each taking its weight in a row. Ties go
+ * to the first server after the last one chosen.
+ *
+ * The passes are kept in a tree like the least connections index, with a leaf for each server in the available
+ * set and WRR_PASS_NONE for the others, so a pick costs a walk down one path. The tree is built again with the
+ * available servers. A server joining the set starts part of its stride on from the pass of the last server
+ * chosen, so one coming back isn't sent a run of sessions to catch up on the ones it missed. The part is the
+ * slot times the golden ratio, less the whole strides, which puts servers that join together at different
+ * points of the round rather than all tied at its start.
+ */
+
+/* sets a leaf and the nodes above it */
+int wrr_set(WRR_INDEX *index, int slot, long long key) {
+	int node=index->size + slot;
+	index->key[node]=key;
+	for(node >>= 1; node > 0; node >>= 1) {
+		index->key[node]=(index->key[2 * node] < index->key[2 * node + 1]) ? index->key[2 * node] : index->key[2 * node + 1];
+	}
+	return 0;
+}
+
+/* builds the schedule over the servers whose place in the available servers, pos, isn't -1 */
+int wrr_refresh(WRR_INDEX *index, SERVER *servers, int *pos, int n) {
+	long long start;
+	int node;
+	int i;
+	for(index->size=1; index->size < n; index->size <<= 1);
+	for(i=0; i < index->size; i++) {
+		if((i < n) && (pos[i] >= 0)) {
+			start=index->now + (((long long)(WRR_STRIDE / servers[i].weight) * ((i * WRR_SPREAD) & 0xffff)) >> 16);
+			if(!index->in[i] && (index->pass[i] < start)) {
+				index->pass[i]=start;
 			}
+			index->in[i]=1;
+			index->key[index->size + i]=index->pass[i];
 		}
+		else {
+			index->in[i]=0;
+			index->key[index->size + i]=WRR_PASS_NONE;
+		}
+	}
+	for(node=index->size - 1; node > 0; node--) {
+		index->key[node]=(index->key[2 * node] < index->key[2 * node + 1]) ? index->key[2 * node] : index->key[2 * node + 1];
+	}
+	return 0;
+}
 
+/* the first slot from 'from' on below node, which covers slots lo to hi, whose pass is key */
+int wrr_find(WRR_INDEX *index, int node, int lo, int hi, int from, long long key) {
+	int mid;
+	int slot;
+	if((hi < from) || (index->key[node] != key)) {
+		return -1;
+	}
+	if(lo == hi) {
+		return lo;
+	}
+	mid=(lo + hi) / 2;
+	slot=wrr_find(index, 2 * node, lo, mid, from, key);
+	if(slot >= 0) {
+		return slot;
+	}
+	return wrr_find(index, 2 * node + 1, mid + 1, hi, from, key);
+}
+
+/* the server with the lowest pass, the first one after last on a tie, or -1 if none can be chosen. Its pass
+ * moves on by its stride */
+int wrr_pick(WRR_INDEX *index, SERVER *servers, int last) {
+	int slot;
+	long long key=index->key[1];
+	if(key == WRR_PASS_NONE) {
+		return -1;
+	}
+	slot=wrr_find(index, 1, 0, index->size - 1, last + 1, key);
+	if(slot < 0) {
+		slot=wrr_find(index, 1, 0, index->size - 1, 0, key);
+	}
+	index->now=key;
+	index->pass[slot]=key + (WRR_STRIDE / servers[slot].weight);
+	wrr_set(index, slot, index->pass[slot]);
+	return slot;
+}
+
+/* sets the next_member and next_clone variables for the smooth weighted round robin algorithm */
+int set_wrr_server() {
+	int i;
+	i=wrr_pick(&wrr_members, balancer->members, next_member);
+	if(i >= 0) {
+		next_member=i;
+	}
+	if(use_clone==1) {
+		i=wrr_pick(&wrr_clones, balancer->clones, next_clone);
+		if(i >= 0) {
+			next_clone=i;
+		}
+	}
+	return 0;
+}
+
+/* Power of two choices.
+ *
+ * Two of the available servers are drawn at random and the one with fewer connections is chosen, or the lower
+ * of LL's load plus connections times session_weight when SNMP has a load for both. A pick looks at two servers
+ * whatever the number of members. Least connections sends every new session to the server with the lowest
+ * count, and while the counts it sees are behind (tied, or not yet showing the other workers' sessions) that is
+ * the same server each time. The draws send those sessions to different servers, and still never to the
+ * busiest of the two.
+ */
+
+/* xorshift, the seed is set per worker so the workers don't draw the same servers */
+unsigned int p2c_random() {
+	p2c_seed ^= p2c_seed << 13;
+	p2c_seed ^= p2c_seed >> 17;
+	p2c_seed ^= p2c_seed << 5;
+	return p2c_seed;
+}
+
+/* returns 1 if a is less busy than b */
+int p2c_less(SERVER *a, SERVER *b) {
+	if((balancer->snmp_status == SNMP_ENABLED) && (a->load >= 0) && (b->load >= 0)) {
+		return (a->load + (a->c * balancer->session_weight)) < (b->load + (b->c * balancer->session_weight));
+	}
+	return a->c < b->c;
+}
+
+/* the less busy of two different servers drawn from the n in list */
+int p2c_pick(int *list, int n, SERVER *servers) {
+	int a;
+	int b;
+	if(n == 1) {
+		return list[0];
+	}
+	a=p2c_random() % n;
+	b=p2c_random() % (n - 1);
+	if(b >= a) {
+		b++;
+	}
+	/* a tie goes to the first one drawn */
+	if(p2c_less(&servers[list[b]], &servers[list[a]])) {
+		return list[b];
+	}
+	return list[a];
+}
+
+/* sets the next_member and next_clone variables for the power of two choices algorithm */
+int set_p2c_server() {
+	next_member=p2c_pick(available_members, available_members_count, balancer->members);
+	if(use_clone==1) {
+		next_clone=p2c_pick(available_clones, available_clones_count, balancer->clones);
 	}
 	return 0;
 }
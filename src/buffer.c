@@ -0,0 +1,441 @@
+/*
+ * Octopus Load Balancer - Session buffer functions.
+ *
+ * Copyright 2008-2011 Alistair Reay <alreay1@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+/* Session buffers are circular. 'head' is the offset of the oldest byte and 'used' the number of bytes held,
+ * so the data and the free space are each at most two segments of the array. Reads fill both free segments
+ * with readv() and writes drain both data segments with writev(), which means a partial write never has to
+ * move the remaining data to the front of the buffer.
+ *
+ * The arrays themselves come from a per-worker pool. A buffer only holds an array while it has data in it:
+ * one is attached when a read or append needs room and handed back as soon as a write drains the buffer, so
+ * idle sessions cost no buffer memory. Arrays come in power of two size classes and each class grows a slab
+ * at a time up to the worker's share of the buffer_memory budget. When the budget is used up a buffer makes
+ * do with a smaller free array, and if there is none the read is put off and the session waits in a FIFO
+ * list until another session hands an array back.
+ *
+ * In adaptive mode each buffer keeps the size it would like its next array to be. Streams that keep filling
+ * their buffer move up a size class, ones that only trickle move back down.
+ *
+ * With io_backend io_uring the reads and writes are submitted to the ring with the same segments, and the
+ * array stays attached until they have completed even if the session has ended in the meantime. A completion
+ * is accounted for as it arrives and its result waits in the buffer for buffer_read() or buffer_write(),
+ * which hand it to the handler instead of making the system call.
+ */
+
+/* empties a buffer and returns its array to the pool */
+int buffer_reset(BUFFER *buffer) {
+	buffer->head=0;
+	buffer->used=0;
+	buffer->want=0;
+	buffer->streak=0;
+	buffer->ring &= ~(BUFFER_RING_READ_DONE | BUFFER_RING_WRITE_DONE);
+	buffer_release(buffer);
+	return 0;
+}
+
+/* adds a slab of arrays of the given size class to the pool, as far as the budget allows.
+ * returns -1 if nothing could be added
+ */
+int buffer_grow(int class) {
+	char *slab;
+	long long size;
+	int count;
+	int i;
+
+	size=BUFFER_CLASS_SIZE(class);
+	count=BUFFER_SLAB_SIZE / size;
+	if(count < 1) {
+		count=1;
+	}
+	if(buffer_pool.max_bytes > 0) {
+		if(count > ((buffer_pool.max_bytes - buffer_pool.bytes) / size)) {
+			count=(buffer_pool.max_bytes - buffer_pool.bytes) / size;
+		}
+		if(count < 1) {
+			return -1;
+		}
+	}
+	slab=malloc(count * size);
+	if(slab == NULL) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: buffer_grow: unable to grow buffer pool - %s", strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+		return -1;
+	}
+	/* chain the new arrays onto the free list */
+	for(i=0; i<count; i++) {
+		*(char **)(slab + i * size)=buffer_pool.free_list[class];
+		buffer_pool.free_list[class]=slab + i * size;
+	}
+	buffer_pool.free_blocks[class] += count;
+	buffer_pool.bytes += count * size;
+	worker_stats->buffer_bytes=buffer_pool.bytes;
+	return 0;
+}
+
+/* attaches an array from the pool to an empty buffer. The array is buffer_size bytes, or in adaptive mode
+ * the size the buffer wants, but a smaller one is taken if the budget doesn't allow for that size.
+ * returns -1 if no array is available
+ */
+int buffer_acquire(BUFFER *buffer) {
+	int size;
+
+	if(buffer->data != NULL) {
+		return 0;
+	}
+	size=balancer->buffer_size;
+	if((balancer->buffer_mode == BUFFER_MODE_ADAPTIVE) && (buffer->want > size)) {
+		size=buffer->want;
+		if(size > balancer->buffer_size_max) {
+			size=balancer->buffer_size_max;
+		}
+		/* the cap may have been set below buffer_size */
+		if(size < balancer->buffer_size) {
+			size=balancer->buffer_size;
+		}
+	}
+	return buffer_attach(buffer, size);
+}
+
+/* attaches an array of at least size bytes to an empty buffer, or the largest smaller one the budget allows.
+ * returns -1 if no array is available
+ */
+int buffer_attach(BUFFER *buffer, int size) {
+	int class;
+
+	if(buffer->data != NULL) {
+		return 0;
+	}
+	for(class=buffer_class(size); class >= 0; class--) {
+		if((buffer_pool.free_list[class] != NULL) || (buffer_grow(class) == 0)) {
+			break;
+		}
+	}
+	if(class < 0) {
+		return -1;
+	}
+	buffer->data=buffer_pool.free_list[class];
+	buffer_pool.free_list[class]=*(char **)buffer->data;
+	buffer_pool.free_blocks[class]--;
+	buffer->size=BUFFER_CLASS_SIZE(class);
+	buffer->head=0;
+	worker_stats->buffer_blocks_used++;
+	worker_stats->buffer_bytes_used += buffer->size;
+	if(worker_stats->buffer_bytes_used > worker_stats->buffer_bytes_peak) {
+		worker_stats->buffer_bytes_peak=worker_stats->buffer_bytes_used;
+	}
+	return 0;
+}
+
+/* returns the array of an empty buffer to the pool, unless the ring is still using it */
+int buffer_release(BUFFER *buffer) {
+	int class;
+
+	if((buffer->data == NULL) || (buffer->used > 0) || (buffer->ring & (BUFFER_RING_READ | BUFFER_RING_WRITE))) {
+		return 0;
+	}
+	class=buffer_class(buffer->size);
+	*(char **)buffer->data=buffer_pool.free_list[class];
+	buffer_pool.free_list[class]=buffer->data;
+	buffer_pool.free_blocks[class]++;
+	worker_stats->buffer_blocks_used--;
+	worker_stats->buffer_bytes_used -= buffer->size;
+	buffer->data=NULL;
+	buffer->size=0;
+	buffer->head=0;
+	return 0;
+}
+
+/* true when the buffer holds limit bytes, or as much as its array can take */
+int buffer_full(BUFFER *buffer, int limit) {
+	if((buffer->data != NULL) && (buffer->size < limit)) {
+		limit=buffer->size;
+	}
+	return buffer->used >= limit;
+}
+
+/* adaptive mode: works out the size of the buffer's next array from how full the last read left it */
+int buffer_adapt(BUFFER *buffer, int nbytes) {
+	if(buffer->used >= buffer->size) {
+		buffer->streak=(buffer->streak > 0) ? buffer->streak + 1 : 1;
+		if(buffer->streak >= BUFFER_GROW_FILLS) {
+			buffer->want=buffer->size * 2;
+			buffer->streak=0;
+		}
+	}
+	else if(nbytes < (buffer->size / 4)) {
+		buffer->streak=(buffer->streak < 0) ? buffer->streak - 1 : -1;
+		if(buffer->streak <= -BUFFER_SHRINK_READS) {
+			buffer->want=buffer->size / 2;
+			buffer->streak=0;
+		}
+	}
+	else {
+		buffer->want=buffer->size;
+		buffer->streak=0;
+	}
+	return 0;
+}
+
+/* puts a session at the back of the list of sessions waiting for a buffer. flag records which
+ * direction is waiting, a session is only listed once however many directions are waiting
+ */
+int buffer_wait(SESSION *session, int flag) {
+	if(!(session->state & (STATE_CLI_BUFF_WAIT | STATE_MEM_BUFF_WAIT))) {
+		session->wait_next=-1;
+		session->wait_prev=buffer_pool.wait_tail;
+		if(buffer_pool.wait_tail >= 0) {
+			sessions[buffer_pool.wait_tail].wait_next=session->id;
+		}
+		else {
+			buffer_pool.wait_head=session->id;
+		}
+		buffer_pool.wait_tail=session->id;
+	}
+	session->state |= flag;
+	worker_stats->buffer_waits++;
+	return 0;
+}
+
+/* takes a session out of the list of sessions waiting for a buffer */
+int buffer_unwait(SESSION *session) {
+	if(!(session->state & (STATE_CLI_BUFF_WAIT | STATE_MEM_BUFF_WAIT))) {
+		return 0;
+	}
+	if(session->wait_prev >= 0) {
+		sessions[session->wait_prev].wait_next=session->wait_next;
+	}
+	else {
+		buffer_pool.wait_head=session->wait_next;
+	}
+	if(session->wait_next >= 0) {
+		sessions[session->wait_next].wait_prev=session->wait_prev;
+	}
+	else {
+		buffer_pool.wait_tail=session->wait_prev;
+	}
+	session->wait_prev=-1;
+	session->wait_next=-1;
+	session->state &= ~(STATE_CLI_BUFF_WAIT | STATE_MEM_BUFF_WAIT);
+	return 0;
+}
+
+/* called from the event loop once a batch of events has been handled. Lets as many waiting sessions
+ * read again as there are arrays available, oldest first. A session that still can't get one waits again.
+ */
+int buffer_wake() {
+	SESSION *session;
+	unsigned int waiting;
+	int available;
+	int class;
+
+	/* without a budget the pool only runs dry when malloc() fails, so every waiting session tries again */
+	if(buffer_pool.max_bytes == 0) {
+		available=worker_session_limit * 2;
+	}
+	else {
+		available=(int)((buffer_pool.max_bytes - buffer_pool.bytes) / BUFFER_CLASS_SIZE(0));
+		for(class=0; class < BUFFER_CLASSES; class++) {
+			available += buffer_pool.free_blocks[class];
+		}
+	}
+	while((available > 0) && (buffer_pool.wait_head >= 0)) {
+		session=&sessions[buffer_pool.wait_head];
+		waiting=session->state & (STATE_CLI_BUFF_WAIT | STATE_MEM_BUFF_WAIT);
+		buffer_unwait(session);
+		if((waiting & STATE_CLI_BUFF_WAIT) && (session->state & STATE_CLI_CONNECTED)) {
+			session->state |= STATE_CLI_READ_READY;
+			epoll_mod(session, EVENT_ROLE_CLIENT, (session->state & STATE_CLI_WRITE_READY) ? &rw_ev : &ro_ev);
+			available--;
+		}
+		if((waiting & STATE_MEM_BUFF_WAIT) && (session->state & STATE_MEM_CONNECTED)) {
+			session->state |= STATE_MEM_READ_READY;
+			epoll_mod(session, EVENT_ROLE_MEMBER, (session->state & STATE_MEM_WRITE_READY) ? &rw_ev : &ro_ev);
+			available--;
+		}
+		/* edge-triggered sockets won't be reported again, so the reads are done now */
+		if(balancer->epoll_mode == EPOLL_MODE_EDGE) {
+			session_pump(session);
+		}
+	}
+	return 0;
+}
+
+/* fills iov with the free space of the buffer, never letting the buffer hold more than limit bytes.
+ * returns the number of segments
+ */
+int buffer_space_iov(BUFFER *buffer, int limit, struct iovec *iov) {
+	int tail;
+	int space;
+
+	if(limit > buffer->size) {
+		limit=buffer->size;
+	}
+	space=limit - buffer->used;
+	if(space <= 0) {
+		return 0;
+	}
+	tail=(buffer->head + buffer->used) % buffer->size;
+	iov[0].iov_base=buffer->data + tail;
+	/* free space runs to the end of the array, then wraps around to the head */
+	if(tail + space > buffer->size) {
+		iov[0].iov_len=buffer->size - tail;
+		iov[1].iov_base=buffer->data;
+		iov[1].iov_len=space - iov[0].iov_len;
+		return 2;
+	}
+	iov[0].iov_len=space;
+	return 1;
+}
+
+/* fills iov with the data held in the buffer, returns the number of segments */
+int buffer_data_iov(BUFFER *buffer, struct iovec *iov) {
+	if(buffer->used <= 0) {
+		return 0;
+	}
+	iov[0].iov_base=buffer->data + buffer->head;
+	/* data runs to the end of the array, then wraps around to the start */
+	if(buffer->head + buffer->used > buffer->size) {
+		iov[0].iov_len=buffer->size - buffer->head;
+		iov[1].iov_base=buffer->data;
+		iov[1].iov_len=buffer->used - iov[0].iov_len;
+		return 2;
+	}
+	iov[0].iov_len=buffer->used;
+	return 1;
+}
+
+/* accounts for nbytes read into the free space */
+int buffer_commit(BUFFER *buffer, int nbytes) {
+	buffer->used += nbytes;
+	if(balancer->buffer_mode == BUFFER_MODE_ADAPTIVE) {
+		buffer_adapt(buffer, nbytes);
+	}
+	return 0;
+}
+
+/* removes nbytes that have been written from the front of the buffer */
+int buffer_consume(BUFFER *buffer, int nbytes) {
+	buffer->head=(buffer->head + nbytes) % buffer->size;
+	buffer->used -= nbytes;
+	/* a drained buffer gives its array back */
+	if(buffer->used == 0) {
+		buffer_release(buffer);
+	}
+	return 0;
+}
+
+/* reads from fd into the free space of the buffer, never letting the buffer hold more than limit bytes.
+ * returns the result of readv() and on success accounts for the new data
+ */
+ssize_t buffer_read(BUFFER *buffer, int fd, int limit) {
+	struct iovec iov[2];
+	ssize_t result;
+
+#ifdef USE_IO_URING
+	if(balancer->io_backend == IO_BACKEND_URING) {
+		return uring_result(&buffer->ring, BUFFER_RING_READ_DONE, buffer->ring_read);
+	}
+#endif
+	if(buffer->data == NULL) {
+		if(buffer_acquire(buffer) != 0) {
+			errno=ENOBUFS;
+			return -1;
+		}
+	}
+	worker_stats->io_syscalls++;
+	result=readv(fd, iov, buffer_space_iov(buffer, limit, iov));
+	if(result > 0) {
+		buffer_commit(buffer, (int)result);
+	}
+	/* nothing was read into a freshly attached array */
+	else if(buffer->used == 0) {
+		buffer_release(buffer);
+	}
+	return result;
+}
+
+/* writes as much of the buffered data to fd as possible. Returns the result of writev() and on success
+ * removes the written data from the buffer
+ */
+ssize_t buffer_write(BUFFER *buffer, int fd) {
+	struct iovec iov[2];
+	ssize_t result;
+
+#ifdef USE_IO_URING
+	if(balancer->io_backend == IO_BACKEND_URING) {
+		return uring_result(&buffer->ring, BUFFER_RING_WRITE_DONE, buffer->ring_write);
+	}
+#endif
+	worker_stats->io_syscalls++;
+	result=writev(fd, iov, buffer_data_iov(buffer, iov));
+	if(result > 0) {
+		buffer_consume(buffer, (int)result);
+	}
+	return result;
+}
+
+/* appends len bytes of src, starting offset bytes after its head, to dst. Returns -1 if dst doesn't have room */
+int buffer_append(BUFFER *dst, BUFFER *src, int offset, int len) {
+	int from;
+	int to;
+	int chunk;
+
+	if(dst->data == NULL) {
+		if(buffer_acquire(dst) != 0) {
+			return -1;
+		}
+	}
+	if(len > (dst->size - dst->used)) {
+		return -1;
+	}
+	from=(src->head + offset) % src->size;
+	to=(dst->head + dst->used) % dst->size;
+	while(len > 0) {
+		/* copy up to whichever of the two arrays wraps first */
+		chunk=len;
+		if(chunk > (src->size - from)) {
+			chunk=src->size - from;
+		}
+		if(chunk > (dst->size - to)) {
+			chunk=dst->size - to;
+		}
+		memcpy(dst->data + to, src->data + from, chunk);
+		from=(from + chunk) % src->size;
+		to=(to + chunk) % dst->size;
+		dst->used += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+/* copies up to len bytes from the front of the buffer into dest without consuming them.
+ * returns the number of bytes copied
+ */
+int buffer_peek(BUFFER *buffer, char *dest, int len) {
+	int first;
+
+	if(len > buffer->used) {
+		len=buffer->used;
+	}
+	if(len <= 0) {
+		return 0;
+	}
+	first=len;
+	if(buffer->head + first > buffer->size) {
+		first=buffer->size - buffer->head;
+	}
+	memcpy(dest, buffer->data + buffer->head, first);
+	if(first < len) {
+		memcpy(dest + first, buffer->data, len - first);
+	}
+	return len;
+}
@@ -47,6 +47,7 @@ int parse_config_file(const char *conf_file) {
 	int serverPort=80;
 	int serverMaxc=balancer->default_maxc;
 	float serverMaxl=balancer->default_maxl;
+	int serverWeight=DEFAULT_WEIGHT;
 	struct in_addr serverIP;
 	char serverName[SERVERNAME_MAX_LENGTH];
 
@@ -103,6 +104,22 @@ int parse_config_file(const char *conf_file) {
 						write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 					}
 				}
+				if (!strncmp(directive, "weight",6)) {
+					errno=0;
+					serverWeight=strtol(value, (char **)NULL, 10);
+					if (errno !=0) {
+						snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parse_config_file: line %d: weight value invalid: %s", lineCounter, strerror(errno));
+						write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+					}
+					if(!((serverWeight >= 1) && (serverWeight <= WEIGHT_MAX))) {
+						snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parse_config_file: line %d: weight must be from 1 to %d", lineCounter, WEIGHT_MAX);
+						write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+					}
+					if(balancer->debug_level > 0) {
+						snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting weight to: %d",serverWeight);
+						write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+					}
+				}
 				if (!strncmp(directive, "status",5)) {
 					if (!strncmp(value, "enabled",7)) {
 						serverStatus=SERVER_STATE_ENABLED;
@@ -190,7 +207,7 @@ int parse_config_file(const char *conf_file) {
 					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 				}
 				inServerSection=0;
-				status = create_balancer_server(serverClone, serverName, serverStatus, standbyState, serverPort, &serverIP, serverMaxc, serverMaxl);
+				status = create_balancer_server(serverClone, serverName, serverStatus, standbyState, serverPort, &serverIP, serverMaxc, serverMaxl, serverWeight);
 				if(status < 0) {
 					if(status==-1) {
 						fprintf(stderr, "ERROR: memory allocation error\n");
@@ -207,6 +224,7 @@ int parse_config_file(const char *conf_file) {
 					fprintf(stderr, "  -IP      = %s", inet_ntoa(serverIP));
 					fprintf(stderr, "  -Maxc    = %d\n", serverMaxc);
 					fprintf(stderr, "  -Maxl = %f\n", serverMaxl);
+					fprintf(stderr, "  -Weight  = %d\n", serverWeight);
 					exit(1);
 				}
 				/* reset the values for the next server */
@@ -215,6 +233,7 @@ int parse_config_file(const char *conf_file) {
 				serverClone=SERVER_CLONE_FALSE;
 				serverMaxc=balancer->default_maxc;
 				serverMaxl=balancer->default_maxl;
+				serverWeight=DEFAULT_WEIGHT;
 				serverStatus=SERVER_STATE_ENABLED;
 				standbyState=STANDBY_STATE_FALSE;
 				continue;
@@ -340,6 +359,27 @@ int parse_config_file(const char *conf_file) {
 					}
 					balancer->algorithm= ALGORITHM_STATIC;
 				}
+				else if (!strncmp(value, "WRR", 3)) {
+					if(balancer->debug_level > 0) {
+						snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting balancing algorithm to \"Weighted Round-Robin\"");
+						write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+					}
+					balancer->algorithm= ALGORITHM_WRR;
+				}
+				else if (!strncmp(value, "WLC", 3)) {
+					if(balancer->debug_level > 0) {
+						snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting balancing algorithm to \"Weighted Least-Connections\"");
+						write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+					}
+					balancer->algorithm= ALGORITHM_WLC;
+				}
+				else if (!strncmp(value, "P2C", 3)) {
+					if(balancer->debug_level > 0) {
+						snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting balancing algorithm to \"Power of Two Choices\"");
+						write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+					}
+					balancer->algorithm= ALGORITHM_P2C;
+				}
 				else {
 					fprintf(stderr, "ERROR: parsing config file at line %d: unsupported allocation algorithm!!", lineCounter);
 					exit(1);
@@ -361,6 +401,239 @@ int parse_config_file(const char *conf_file) {
 					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 				}
 			}
+			if (!strncmp(directive, "clone_lag",9)) {
+				v1=strtol(value, &c1, 10);
+	            if((value != c1) && (v1 >= BUFFER_SIZE_MIN) && (v1 <= BUFFER_SIZE_MAX)) {
+					balancer->clone_lag=v1;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: clone_lag value invalid, must be between %d and %d", lineCounter, BUFFER_SIZE_MIN, BUFFER_SIZE_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting clone_lag to: %d",balancer->clone_lag);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "keepalive_pool", 14)) {
+				v1=strtol(value, &c1, 10);
+	            if((value != c1) && (v1 >= 0) && (v1 <= KEEPALIVE_POOL_MAX)) {
+					balancer->keepalive_pool=v1;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: keepalive_pool value invalid, must be between 0 and %d", lineCounter, KEEPALIVE_POOL_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting keepalive_pool to: %d",balancer->keepalive_pool);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "keepalive_timeout", 17)) {
+				v1=strtol(value, &c1, 10);
+	            if((value != c1) && (v1 >= 1) && (v1 <= 3600)) {
+					balancer->keepalive_timeout=v1;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: keepalive_timeout value invalid, must be between 1 and 3600", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting keepalive_timeout to: %d",balancer->keepalive_timeout);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "warm_pool", 9)) {
+				v1=strtol(value, &c1, 10);
+				if((value != c1) && (v1 >= 0) && (v1 <= WARM_POOL_MAX)) {
+					balancer->warm_pool=v1;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: warm_pool value invalid, must be between 0 and %d", lineCounter, WARM_POOL_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting warm_pool to: %d",balancer->warm_pool);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "client_timeout", 14)) {
+				v1=strtol(value, &c1, 10);
+				if((value != c1) && (v1 >= 0) && (v1 <= SESSION_TIMEOUT_MAX)) {
+					balancer->client_timeout=v1;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: client_timeout value invalid, must be between 0 and %d", lineCounter, SESSION_TIMEOUT_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting client_timeout to: %d",balancer->client_timeout);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "member_timeout", 14)) {
+				v1=strtol(value, &c1, 10);
+				if((value != c1) && (v1 >= 0) && (v1 <= SESSION_TIMEOUT_MAX)) {
+					balancer->member_timeout=v1;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: member_timeout value invalid, must be between 0 and %d", lineCounter, SESSION_TIMEOUT_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting member_timeout to: %d",balancer->member_timeout);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "session_lifetime", 16)) {
+				v1=strtol(value, &c1, 10);
+				if((value != c1) && (v1 >= 0) && (v1 <= SESSION_TIMEOUT_MAX)) {
+					balancer->session_lifetime=v1;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: session_lifetime value invalid, must be between 0 and %d", lineCounter, SESSION_TIMEOUT_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting session_lifetime to: %d",balancer->session_lifetime);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "drain_timeout", 13)) {
+				v1=strtol(value, &c1, 10);
+				if((value != c1) && (v1 >= 0) && (v1 <= DRAIN_TIMEOUT_MAX)) {
+					balancer->drain_timeout=v1;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: drain_timeout value invalid, must be between 0 and %d", lineCounter, DRAIN_TIMEOUT_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting drain_timeout to: %d",balancer->drain_timeout);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "http_balancing", 14)) {
+				if(!strncmp(value, "connection", 10)) {
+					balancer->http_balancing=HTTP_BALANCING_CONNECTION;
+				}
+				else if(!strncmp(value, "request", 7)) {
+					balancer->http_balancing=HTTP_BALANCING_REQUEST;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: http_balancing value invalid", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting http_balancing to: %d",balancer->http_balancing);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "relay_mode", 10)) {
+				if(!strncmp(value, "copy", 4)) {
+					balancer->relay_mode=RELAY_MODE_COPY;
+				}
+				else if(!strncmp(value, "splice", 6)) {
+					balancer->relay_mode=RELAY_MODE_SPLICE;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: relay_mode value invalid", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting relay_mode to: %d",balancer->relay_mode);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "io_backend", 10)) {
+				if(!strncmp(value, "epoll", 5)) {
+					balancer->io_backend=IO_BACKEND_EPOLL;
+				}
+				else if(!strncmp(value, "io_uring_poll", 13)) {
+					#ifndef USE_IO_URING
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: io_backend io_uring_poll requires octopus to be built with --enable-io-uring", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+					#endif
+					balancer->io_backend=IO_BACKEND_URING_POLL;
+				}
+				else if(!strncmp(value, "io_uring", 8)) {
+					#ifndef USE_IO_URING
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: io_backend io_uring requires octopus to be built with --enable-io-uring", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+					#endif
+					balancer->io_backend=IO_BACKEND_URING;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: io_backend value invalid", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting io_backend to: %d",balancer->io_backend);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "epoll_mode", 10)) {
+				if(!strncmp(value, "level", 5)) {
+					balancer->epoll_mode=EPOLL_MODE_LEVEL;
+				}
+				else if(!strncmp(value, "edge", 4)) {
+					balancer->epoll_mode=EPOLL_MODE_EDGE;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: epoll_mode value invalid", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting epoll_mode to: %d",balancer->epoll_mode);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "inline_writes", 13)) {
+				if(!strncmp(value, "disabled", 8)) {
+					balancer->inline_writes=INLINE_WRITES_OFF;
+				}
+				else if(!strncmp(value, "enabled", 7)) {
+					balancer->inline_writes=INLINE_WRITES_ON;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: inline_writes value invalid", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting inline_writes to: %d",balancer->inline_writes);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "listen_fastopen", 15)) {
+				v1=strtol(value, &c1, 10);
+				if((value != c1) && (v1 >= 0) && (v1 <= LISTEN_FASTOPEN_MAX)) {
+					balancer->listen_fastopen=v1;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: listen_fastopen value invalid, must be between 0 and %d", lineCounter, LISTEN_FASTOPEN_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting listen_fastopen to: %d",balancer->listen_fastopen);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "member_fastopen", 15)) {
+				if(!strncmp(value, "disabled", 8)) {
+					balancer->member_fastopen=MEMBER_FASTOPEN_OFF;
+				}
+				else if(!strncmp(value, "enabled", 7)) {
+					balancer->member_fastopen=MEMBER_FASTOPEN_ON;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: member_fastopen value invalid", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting member_fastopen to: %d",balancer->member_fastopen);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
 			if (!strncmp(directive, "overload_mode", 13)) {
 				if(!strncmp(value, "STRICT", 5)) {
 					balancer->overload_mode=OVERLOAD_MODE_STRICT;
@@ -545,6 +818,128 @@ int parse_config_file(const char *conf_file) {
 					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 				}
 			}
+			if (!strncmp(directive, "workers",7)) {
+				v1=strtol(value, &c1, 10);
+	            if(value != c1) {
+					if((v1 < 1) || (v1 > MAXWORKERS)) {
+						snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: workers value invalid, must be between 1 and %d", lineCounter, MAXWORKERS);
+						write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+					}
+					else {
+						balancer->workers=v1;
+					}
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: workers value invalid, must be between 1 and %d", lineCounter, MAXWORKERS);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting workers to: %d",balancer->workers);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "accept_budget",13)) {
+				v1=strtol(value, &c1, 10);
+	            if(value != c1) {
+					if(v1 < 0) {
+						snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: accept_budget value invalid, must be greater than or equal to 0", lineCounter);
+						write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+					}
+					else {
+						balancer->accept_budget=v1;
+					}
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: accept_budget value invalid, must be greater than or equal to 0", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting accept_budget to: %d",balancer->accept_budget);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "defer_accept", 12)) {
+				v1=strtol(value, &c1, 10);
+				if((value != c1) && (v1 >= 0) && (v1 <= DEFER_ACCEPT_MAX)) {
+					balancer->defer_accept=v1;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: defer_accept value invalid, must be between 0 and %d", lineCounter, DEFER_ACCEPT_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting defer_accept to: %d",balancer->defer_accept);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "buffer_size",12)) {
+				v1=strtol(value, &c1, 10);
+	            if((value != c1) && (v1 >= BUFFER_SIZE_MIN) && (v1 <= BUFFER_SIZE_MAX)) {
+					/* buffers come in power of two sizes */
+					balancer->buffer_size=BUFFER_CLASS_SIZE(buffer_class(v1));
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: buffer_size value invalid, must be between %d and %d", lineCounter, BUFFER_SIZE_MIN, BUFFER_SIZE_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting buffer_size to: %d",balancer->buffer_size);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "buffer_size_max",16)) {
+				v1=strtol(value, &c1, 10);
+	            if((value != c1) && (v1 >= BUFFER_SIZE_MIN) && (v1 <= BUFFER_SIZE_MAX)) {
+					/* buffers come in power of two sizes */
+					balancer->buffer_size_max=BUFFER_CLASS_SIZE(buffer_class(v1));
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: buffer_size_max value invalid, must be between %d and %d", lineCounter, BUFFER_SIZE_MIN, BUFFER_SIZE_MAX);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting buffer_size_max to: %d",balancer->buffer_size_max);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "buffer_mode", 11)) {
+				if(!strncmp(value, "fixed", 5)) {
+					balancer->buffer_mode=BUFFER_MODE_FIXED;
+				}
+				else if(!strncmp(value, "adaptive", 8)) {
+					balancer->buffer_mode=BUFFER_MODE_ADAPTIVE;
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: buffer_mode value invalid", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: parse_config_file: setting buffer_mode to: %d",balancer->buffer_mode);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
+			if (!strncmp(directive, "buffer_memory",13)) {
+				v1=strtol(value, &c1, 10);
+	            if(value != c1) {
+					if(v1 < 0) {
+						snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: buffer_memory value invalid, must be greater than or equal to 0", lineCounter);
+						write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+					}
+					else {
+						balancer->buffer_memory=v1;
+					}
+				}
+				else {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: parsing config file at line %d: buffer_memory value invalid, must be greater than or equal to 0", lineCounter);
+					write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+				}
+				if(balancer->debug_level > 0) {
+					snprintf(log_string, OCTOPUS_LOG_LEN,"DEBUG: parse_config_file: setting buffer_memory to: %d",balancer->buffer_memory);
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+				}
+			}
 			if (!strncmp(directive, "fd_limit",8)) {
 				v1=strtol(value, &c1, 10);
 	            if(value != c1) {
@@ -640,6 +1035,13 @@ int parse_config_file(const char *conf_file) {
 			}
 		}
 		fclose(fp);
+		/* the io_uring backend moves the data through the session buffers itself and only has level-triggered interest */
+		if((balancer->io_backend == IO_BACKEND_URING) && (balancer->relay_mode == RELAY_MODE_SPLICE)) {
+			write_log(OCTOPUS_LOG_EXIT, "ERROR: parsing config file: relay_mode splice can't be used with io_backend io_uring", SUPPRESS_OFF);
+		}
+		if((balancer->io_backend == IO_BACKEND_URING) && (balancer->epoll_mode == EPOLL_MODE_EDGE)) {
+			write_log(OCTOPUS_LOG_EXIT, "ERROR: parsing config file: epoll_mode edge can't be used with io_backend io_uring", SUPPRESS_OFF);
+		}
 		return 0;
 	}
 	else {
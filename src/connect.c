@@ -27,6 +27,44 @@ int connect_server(SESSION *session) {
 
 	/*check that the session does not already have a server fd. */
 	/*connect may have been called on this session because the clone read/write failed and it needs to be reconnected */
+	/* an idle keep-alive connection to the member saves the connect, failing that one made in advance */
+	serverfd=-1;
+	if (session->memberfd == -1) {
+		session->state &= ~STATE_MEM_FASTOPEN;
+	}
+	if ((session->memberfd == -1) && (balancer->keepalive_pool > 0)) {
+		serverfd=keepalive_take(next_member);
+		if(serverfd >= 0) {
+			COUNTER_ADD(balancer->members[next_member].pool_hits, 1);
+		}
+		else {
+			COUNTER_ADD(balancer->members[next_member].pool_misses, 1);
+		}
+	}
+	if ((session->memberfd == -1) && (serverfd < 0) && (balancer->warm_pool > 0)) {
+		serverfd=warm_take(next_member);
+	}
+	if (serverfd >= 0) {
+		session->member=&(balancer->members[next_member]);
+		session->memberfd=serverfd;
+		if(epoll_add(session, EVENT_ROLE_MEMBER) <0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: connect_server: cannot add server to epoll fd: %s", strerror(errno));
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+			close(serverfd);
+			session->memberfd=-1;
+			return -1;
+		}
+		server_count_add(session->member, 1);
+		session->state |= STATE_MEM_CONNECTED;
+		session->state |= STATE_MEM_READ_READY;
+		session->connect_attempts=0;
+		session->member_active=timer_now;
+		timer_update(session);
+		if(balancer->debug_level >1) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: using pooled connection to member server %s @ fd %d", balancer->members[next_member].name, serverfd);
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		}
+	}
 	if (session->memberfd == -1) {
 		if ((serverfd=socket(PF_INET, SOCK_STREAM, 0)) < 0) {
 			if(errno == EMFILE) {
@@ -48,6 +86,7 @@ int connect_server(SESSION *session) {
 		if (fcntl(serverfd, F_SETFL, O_NONBLOCK)==-1) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: connect_server: cannot set socket to NONBLOCK: %s", strerror(errno));
 			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+			close(serverfd);
 			return -1;
 		}
 		status = setsockopt(serverfd, IPPROTO_TCP, TCP_NODELAY,(char *) &yes, (socklen_t)sizeof(yes));
@@ -68,36 +107,80 @@ int connect_server(SESSION *session) {
 		if(status<0) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: Unable to bind connection to requested member outbound IP: %s", strerror(errno));
 			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+			close(serverfd);
 			return -1;
 		}
-		/* connect to the appropriate member */
+		/* with a Fast Open cookie for the member connect() returns straight away and the SYN goes with the first write.
+		 * The io_uring backend's connect goes through the ring, which doesn't put it off */
+		if((balancer->member_fastopen == MEMBER_FASTOPEN_ON) && (balancer->io_backend != IO_BACKEND_URING)) {
+			status = setsockopt(serverfd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &yes, (socklen_t)sizeof(yes));
+			if(status<0) {
+				snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: connect_server: cannot set socket to FASTOPEN_CONNECT: %s", strerror(errno));
+				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+			}
+		}
+		/* connect to the appropriate member. The io_uring backend submits the connect once the socket is registered */
 		errno=0;
-		status= connect(serverfd, (struct sockaddr *)&member_addr, (socklen_t)sizeof(member_addr));
+		if(balancer->io_backend == IO_BACKEND_URING) {
+			status=-1;
+			errno=EINPROGRESS;
+		}
+		else {
+			worker_stats->io_syscalls++;
+			status= connect(serverfd, (struct sockaddr *)&member_addr, (socklen_t)sizeof(member_addr));
+		}
+		if((status == 0) && (balancer->member_fastopen == MEMBER_FASTOPEN_ON)) {
+			session->state |= STATE_MEM_FASTOPEN;
+			COUNTER_ADD(balancer->members[next_member].fastopen_sent, 1);
+		}
 		if(status != 0) {
 			if(errno != EINPROGRESS) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: connect_server: cannot connect to member %s: %s", balancer->members[next_member].name, strerror(errno));
 				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
-				return -1;
+				close(serverfd);
+				/* the session can still be sent to another member */
+				return connect_failover(session, &(balancer->members[next_member]), 0, use_clone);
 			}
+			/* the connect completes in the background, connect_done() finds out how it went */
+			session->state |= STATE_MEM_CONNECTING;
 		}
 		/* associate the session with the server, set session state and put it into a epoll balancer */
 		session->member=&(balancer->members[next_member]);
 		session->memberfd=serverfd;
-		fds[serverfd].session=session;
-		ro_ev.data.fd=serverfd;
-		if(epoll_ctl(epfd, EPOLL_CTL_ADD, serverfd, &ro_ev) <0) {
+		if(epoll_add(session, EVENT_ROLE_MEMBER) <0) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: connect_server: cannot add server to epoll fd: %s", strerror(errno));
 			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+			/* the member was never counted, so the fd must not be left for disconnect_member() */
+			close(serverfd);
+			session->memberfd=-1;
+			session->state &= ~(STATE_MEM_CONNECTING | STATE_MEM_FASTOPEN);
 			return -1;
 		}
-		fds[serverfd].session->member->c +=1;
-		fds[serverfd].session->state |= STATE_MEM_CONNECTED;
-		fds[serverfd].session->state |= STATE_MEM_READ_READY;
+#ifdef USE_IO_URING
+		if(balancer->io_backend == IO_BACKEND_URING) {
+			uring_connect(session, EVENT_ROLE_MEMBER, &member_addr);
+		}
+#endif
+		server_count_add(session->member, 1);
+		session->state |= STATE_MEM_CONNECTED;
+		session->state |= STATE_MEM_READ_READY;
+		if(session->state & STATE_MEM_CONNECTING) {
+			connect_track(session);
+		}
+		else {
+			session->connect_attempts=0;
+			session->member_active=timer_now;
+			timer_update(session);
+		}
 		if(balancer->debug_level >1) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: connected to member server %s @ fd %d", balancer->members[next_member].name, serverfd);
 			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 		}
 	}
+	/* the first member connect of the session is timed from its accept */
+	if((session->accepted_us != 0) && (session->memberfd >= 0)) {
+		connect_latency(session);
+	}
 	/* if we are cloning connections... */
 	if((use_clone == 1) && (session->clonefd == -1)) {
 		errno=0;
@@ -158,9 +241,15 @@ int connect_server(SESSION *session) {
 		}
 
 
-		/* connect to the appropriate clone */
+		/* connect to the appropriate clone, or with the io_uring backend once the socket is registered */
 		errno=0;
-		status= (connect(clonefd, (struct sockaddr *)&clone_addr, (socklen_t)sizeof(clone_addr)) == -1);
+		if(balancer->io_backend == IO_BACKEND_URING) {
+			status=0;
+		}
+		else {
+			worker_stats->io_syscalls++;
+			status= (connect(clonefd, (struct sockaddr *)&clone_addr, (socklen_t)sizeof(clone_addr)) == -1);
+		}
 		if(status != 0) {
 			if(errno != EINPROGRESS) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: connect_server: cannot connect to clone %s: %s", balancer->clones[next_clone].name, strerror(errno));
@@ -171,16 +260,19 @@ int connect_server(SESSION *session) {
 		/* associate the session with the server, set session state and put it into a epoll balancer */
 		session->clone=&(balancer->clones[next_clone]);
 		session->clonefd=clonefd;
-		fds[clonefd].session=session;
-		ro_ev.data.fd=clonefd;
-		if(epoll_ctl(epfd, EPOLL_CTL_ADD, clonefd, &ro_ev) <0) {
+		if(epoll_add(session, EVENT_ROLE_CLONE) <0) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: connect_server: cannot add clone to epoll fd: %s", strerror(errno));
 			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
 			return 1;
 		}
-		fds[clonefd].session->clone->c +=1;
-		fds[clonefd].session->state |= STATE_CLO_CONNECTED;
-		fds[clonefd].session->state |= STATE_CLO_READ_READY;
+#ifdef USE_IO_URING
+		if(balancer->io_backend == IO_BACKEND_URING) {
+			uring_connect(session, EVENT_ROLE_CLONE, &clone_addr);
+		}
+#endif
+		server_count_add(session->clone, 1);
+		session->state |= STATE_CLO_CONNECTED;
+		session->state |= STATE_CLO_READ_READY;
 		if(balancer->debug_level >1) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: Connected to clone server %s @ fd %d", balancer->clones[next_clone].name, clonefd);
 			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
@@ -190,3 +282,523 @@ int connect_server(SESSION *session) {
 }
 
 
+/* Member connects are made non-blocking and complete in the background while the worker carries on.
+ * A session whose connect is in progress has STATE_MEM_CONNECTING set and sits on this worker's
+ * connecting list until the member socket is reported writable or in error, when connect_done() looks at
+ * SO_ERROR, or until connect_timeout seconds have passed and connect_expire() gives up on it.
+ *
+ * Either way a failed connect doesn't end the session. connect_failover() sends it to another available
+ * member that it hasn't tried yet, the client's data is still in the session buffers (or pipes) and is
+ * written once the new connect completes. The session is only ended when every member has been tried.
+ *
+ * The failures are counted per member in the shared memory segment: connect_failures and connect_timeouts
+ * in total, and connect_fail_streak for the failures since the member last accepted a session.
+ */
+
+/* adds a session whose member connect is in progress to the end of the connecting list. Every connect
+ * is given the same time so the list stays in deadline order
+ */
+int connect_track(SESSION *session) {
+	session->connect_deadline=timer_clock() + ((long long)balancer->connect_timeout * 1000);
+	session->connect_next=-1;
+	session->connect_prev=connecting_tail;
+	if(connecting_tail >= 0) {
+		sessions[connecting_tail].connect_next=session->id;
+	}
+	else {
+		connecting_head=session->id;
+	}
+	connecting_tail=session->id;
+	return 0;
+}
+
+/* takes a session off the connecting list, if it's on it */
+int connect_untrack(SESSION *session) {
+	if(!(session->state & STATE_MEM_CONNECTING)) {
+		return 0;
+	}
+	session->state &= ~STATE_MEM_CONNECTING;
+	if(session->connect_prev >= 0) {
+		sessions[session->connect_prev].connect_next=session->connect_next;
+	}
+	else {
+		connecting_head=session->connect_next;
+	}
+	if(session->connect_next >= 0) {
+		sessions[session->connect_next].connect_prev=session->connect_prev;
+	}
+	else {
+		connecting_tail=session->connect_prev;
+	}
+	session->connect_prev=-1;
+	session->connect_next=-1;
+	return 0;
+}
+
+/* called when the member socket of a connecting session is reported, finds out whether the connect worked.
+ * returns 0 if it did and the event can be handled as usual, -1 if the session has moved to another member
+ * or ended
+ */
+int connect_done(SESSION *session) {
+	int error=0;
+	int streak;
+	socklen_t len=sizeof(error);
+
+#ifdef USE_IO_URING
+	/* the io_uring backend has the result of the connect, unless it had to be seen through with a poll */
+	if((balancer->io_backend == IO_BACKEND_URING) && (session->reg[EVENT_ROLE_MEMBER].result != URING_RESULT_ASK)) {
+		error=-session->reg[EVENT_ROLE_MEMBER].result;
+	}
+	else
+#endif
+	if(getsockopt(session->memberfd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+		error=errno;
+	}
+	if(error != 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: connect_done: connect to member %s failed: %s", session->member->name, strerror(error));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+		if(connect_failover(session, session->member, 0, 0) == -1) {
+			delete_session(session);
+		}
+		return -1;
+	}
+	connect_untrack(session);
+	session->connect_attempts=0;
+	session->member_active=timer_now;
+	timer_update(session);
+	/* the streak is taken down by what was read, so failures other workers count in the meantime stay */
+	streak=session->member->connect_fail_streak;
+	if(streak != 0) {
+		COUNTER_SUB(session->member->connect_fail_streak, streak);
+	}
+	/* the socket was watched for EPOLLOUT to see the connect through, from now on it only is when there's data to send */
+	if(session->state & STATE_MEM_WRITE_READY) {
+		epoll_mod(session, EVENT_ROLE_MEMBER, &rw_ev);
+	}
+	else {
+		epoll_mod(session, EVENT_ROLE_MEMBER, &ro_ev);
+	}
+	return 0;
+}
+
+/* gives up on the member connects that have been in progress for longer than connect_timeout.
+ * returns the number of connects given up on
+ */
+int connect_expire() {
+	SESSION *session;
+	long long now=timer_clock();
+	int expired=0;
+
+	while((connecting_head >= 0) && (sessions[connecting_head].connect_deadline <= now)) {
+		session=&sessions[connecting_head];
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: connect_expire: connect to member %s timed out after %d seconds", session->member->name, balancer->connect_timeout);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+		if(connect_failover(session, session->member, 1, 0) == -1) {
+			delete_session(session);
+		}
+		expired++;
+	}
+	return expired;
+}
+
+/* returns the milliseconds until the first member connect in progress times out, for the event loop to
+ * wait no longer than that, or -1 if there isn't one
+ */
+int connect_wait_time() {
+	long long wait;
+
+	if(connecting_head < 0) {
+		return -1;
+	}
+	wait=sessions[connecting_head].connect_deadline - timer_clock();
+	if(wait < 0) {
+		return 0;
+	}
+	/* the deadline is never more than connect_timeout away, round up so we don't wake just before it */
+	return (int)wait + 1;
+}
+
+/* sends a session whose connect to the failed member didn't work to another member. The members already
+ * tried for it are left out, the algorithm picks from the rest. clone is 0 if the session's clone (if it
+ * has one) has already been dealt with.
+ * returns as connect_server(), -1 if there is no member left to try
+ */
+int connect_failover(SESSION *session, SERVER *failed, int timed_out, int clone) {
+	int i;
+	int n=0;
+	int status;
+
+	if(timed_out) {
+		COUNTER_ADD(failed->connect_timeouts, 1);
+	}
+	else {
+		COUNTER_ADD(failed->connect_failures, 1);
+	}
+	COUNTER_ADD(failed->connect_fail_streak, 1);
+	/* the socket of a connect that was in progress */
+	if(session->memberfd >= 0) {
+		connect_untrack(session);
+		session->state &= ~(STATE_MEM_CONNECTED | STATE_MEM_CAN_READ | STATE_MEM_CAN_WRITE);
+		server_count_add(failed, -1);
+		epoll_del(session, EVENT_ROLE_MEMBER);
+		close(session->memberfd);
+		session->memberfd=-1;
+	}
+	if(session->connect_attempts == 0) {
+		memset(session->connect_tried, '\0', sizeof(session->connect_tried));
+	}
+	session->connect_attempts++;
+	session->connect_tried[failed->id / 8] |= (unsigned char)(1 << (failed->id % 8));
+
+	/* the algorithm chooses from the available members that haven't been tried yet */
+	if(get_available_servers() == 0) {
+		for(i=0; i < available_members_count; i++) {
+			if(session->connect_tried[available_members[i] / 8] & (1 << (available_members[i] % 8))) {
+				available_member_pos[available_members[i]]=-1;
+			}
+			else {
+				available_member_pos[available_members[i]]=n;
+				available_members[n++]=available_members[i];
+			}
+		}
+	}
+	available_members_count=n;
+	/* the narrowed list is only for this session, the next one builds it again */
+	available_ready=0;
+	if(n == 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: connect_failover: no member left to try after %d failed connects", session->connect_attempts);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+		return -1;
+	}
+	next_member=available_members[0];
+	if((balancer->algorithm == ALGORITHM_LC) || (balancer->algorithm == ALGORITHM_WLC)) {
+		set_lc_list();
+	}
+	/* the schedule still holds the members already tried, round robin steps through the ones that are left */
+	else if(balancer->algorithm == ALGORITHM_WRR) {
+		set_rr_server();
+	}
+	else {
+		set_server(session);
+	}
+	/* a URI hash may still point at the failed member */
+	if(session->connect_tried[next_member / 8] & (1 << (next_member % 8))) {
+		next_member=available_members[0];
+		set_lc_server();
+		if(session->connect_tried[next_member / 8] & (1 << (next_member % 8))) {
+			next_member=available_members[0];
+		}
+	}
+	if(clone == 0) {
+		use_clone=0;
+	}
+	worker_stats->connect_failovers++;
+	if(balancer->debug_level > 1) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: connect_failover: trying member %s instead of %s", balancer->members[next_member].name, failed->name);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	status=connect_server(session);
+	/* a pooled connection is ready straight away, the client data already read has to be sent to it */
+	if((status != -1) && !(session->state & STATE_MEM_CONNECTING) && (session->state & STATE_MEM_WRITE_READY)) {
+		epoll_mod(session, EVENT_ROLE_MEMBER, &rw_ev);
+	}
+	return status;
+}
+
+
+/* counts the time from the session's accept to its first member connect being started, or a pooled
+ * connection being taken, in this worker's histogram. Each power of two microseconds has four buckets.
+ * returns the bucket
+ */
+int connect_latency(SESSION *session) {
+	long long us=timer_clock_us() - session->accepted_us;
+	int bucket;
+	int msb=0;
+
+	session->accepted_us=0;
+	if(us < 4) {
+		bucket=(us < 0) ? 0 : (int)us;
+	}
+	else {
+		while((us >> (msb + 1)) != 0) {
+			msb++;
+		}
+		bucket=((msb - 1) * 4) + (int)((us >> (msb - 2)) & 3);
+	}
+	if(bucket >= LATENCY_BUCKETS) {
+		bucket=LATENCY_BUCKETS - 1;
+	}
+	worker_stats->connect_latency[bucket]++;
+	return bucket;
+}
+
+/* called when the member of a session whose connect was put off with Fast Open first answers, counts
+ * whether the member took the data sent with the SYN
+ * returns 1 if it did
+ */
+int fastopen_check(SESSION *session) {
+	struct tcp_info info;
+	socklen_t len=sizeof(info);
+
+	session->state &= ~STATE_MEM_FASTOPEN;
+	if((getsockopt(session->memberfd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) && (info.tcpi_options & TCPI_OPT_SYN_DATA)) {
+		COUNTER_ADD(session->member->fastopen_acked, 1);
+		return 1;
+	}
+	return 0;
+}
+
+
+/* takes an idle keep-alive connection to a member from this worker's pool. Connections that have been
+ * idle for longer than keepalive_timeout, have been closed by the member (or have data waiting, which
+ * a member between responses shouldn't send) or are connected to a server that no longer has the slot
+ * are closed on the way.
+ * returns the connection's fd, or -1 if there is none
+ */
+int keepalive_take(int member) {
+	MEMBER_POOL *pool=&member_pools[member];
+	POOLED_CONN *conn;
+	SERVER *server=&balancer->members[member];
+	char c;
+	ssize_t status;
+
+	keepalive_expire(pool, time(NULL));
+	while(pool->count > 0) {
+		pool->count--;
+		COUNTER_SUB(server->pool_idle, 1);
+		conn=&pool->conns[pool->count];
+		if((conn->addr.sin_addr.s_addr == server->myaddr.sin_addr.s_addr) && (conn->addr.sin_port == server->myaddr.sin_port)) {
+			status=recv(conn->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+			if((status < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+				return conn->fd;
+			}
+		}
+		close(conn->fd);
+	}
+	return -1;
+}
+
+/* hands the member connection of a session that is ending to this worker's pool instead of closing it.
+ * The member's least recently used connection makes room when the pool is full.
+ * returns -1 if the connection has to be closed as usual
+ */
+int keepalive_put(SESSION *session) {
+	MEMBER_POOL *pool;
+	POOLED_CONN *conn;
+	time_t now;
+
+	if((balancer->keepalive_pool == 0) || !(session->state & STATE_MEM_CONNECTED) || (session->state & STATE_MEM_CONNECTING) || (http_reusable(session) == 0)) {
+		return -1;
+	}
+	pool=&member_pools[session->member->id];
+	if(pool->conns == NULL) {
+		pool->conns=malloc(sizeof(POOLED_CONN) * balancer->keepalive_pool);
+		if(pool->conns == NULL) {
+			return -1;
+		}
+	}
+	now=time(NULL);
+	keepalive_expire(pool, now);
+	if(pool->count == balancer->keepalive_pool) {
+		close(pool->conns[0].fd);
+		COUNTER_SUB(session->member->pool_idle, 1);
+		pool->count--;
+		memmove(&pool->conns[0], &pool->conns[1], sizeof(POOLED_CONN) * pool->count);
+	}
+	epoll_del(session, EVENT_ROLE_MEMBER);
+	/* unlike a closed socket the pooled one would stay in the epoll set, where a member closing it would be reported every time round */
+	if(balancer->io_backend == IO_BACKEND_EPOLL) {
+		worker_stats->event_syscalls++;
+		epoll_ctl(epfd, EPOLL_CTL_DEL, session->memberfd, NULL);
+	}
+	conn=&pool->conns[pool->count++];
+	conn->fd=session->memberfd;
+	conn->since=now;
+	conn->addr=session->member->myaddr;
+	COUNTER_ADD(session->member->pool_idle, 1);
+	session->state &= ~STATE_MEM_CONNECTED;
+	server_count_add(session->member, -1);
+	COUNTER_ADD(session->member->completed_c, 1);
+	session->memberfd=-1;
+	if(balancer->debug_level > 2) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: keepalive_put: keeping connection to member server %s @ fd %d for reuse", session->member->name, conn->fd);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	return 0;
+}
+
+/* closes the connections of a member pool that have been idle for longer than keepalive_timeout.
+ * They are in the order they went idle so the expired ones are at the front
+ */
+int keepalive_expire(MEMBER_POOL *pool, time_t now) {
+	int expired=0;
+
+	while((expired < pool->count) && ((now - pool->conns[expired].since) >= balancer->keepalive_timeout)) {
+		close(pool->conns[expired].fd);
+		expired++;
+	}
+	if(expired > 0) {
+		COUNTER_SUB(balancer->members[pool - member_pools].pool_idle, expired);
+		pool->count -= expired;
+		memmove(&pool->conns[0], &pool->conns[expired], sizeof(POOLED_CONN) * pool->count);
+	}
+	return expired;
+}
+
+
+/* The warm pool holds connections to each member that each worker makes in advance, so a session that
+ * can't be given a keep-alive connection still doesn't wait for a TCP handshake. They are made with
+ * non-blocking connects and aren't watched by the event loop: warm_refill() tops the pools up after each
+ * event batch, and warm_take() checks a connection with a zero timeout poll() when it hands it out.
+ * Connections still connecting are left for later, ones that failed or have been closed by the member are
+ * counted as stale and thrown away. Only enabled members that aren't standbys are kept warm, and a
+ * connection is closed once it has been in the pool for keepalive_timeout seconds so that the members
+ * don't time it out first.
+ */
+
+/* starts a non-blocking connect to a member for the warm pool.
+ * returns the socket, or -1 if the connect couldn't be started
+ */
+int warm_connect(int member) {
+	struct sockaddr_in member_addr;
+	struct sockaddr_in member_outbound_addr;
+	int fd;
+
+	if ((fd=socket(PF_INET, SOCK_STREAM, 0)) < 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: warm_connect: cannot create new socket for member %s: %s", balancer->members[member].name, strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+		return -1;
+	}
+	member_addr.sin_family = AF_INET;
+	member_addr.sin_port = htons((uint16_t)(balancer->members[member].port));
+	member_addr.sin_addr = balancer->members[member].myaddr.sin_addr;
+	memset(member_addr.sin_zero, '\0', sizeof(member_addr.sin_zero));
+	bzero(&member_outbound_addr, sizeof(member_outbound_addr));
+	member_outbound_addr.sin_family = AF_INET;
+	memcpy(&member_outbound_addr.sin_addr, &balancer->member_outbound_ip, sizeof(struct in_addr));
+	if ((fcntl(fd, F_SETFL, O_NONBLOCK) == -1) || (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *) &yes, (socklen_t)sizeof(yes)) < 0) || (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, (socklen_t)sizeof(yes)) < 0) || (bind(fd, (struct sockaddr *)&member_outbound_addr, (socklen_t)sizeof(member_outbound_addr)) < 0)) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: warm_connect: cannot set up socket for member %s: %s", balancer->members[member].name, strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+		close(fd);
+		return -1;
+	}
+	errno=0;
+	if ((connect(fd, (struct sockaddr *)&member_addr, (socklen_t)sizeof(member_addr)) != 0) && (errno != EINPROGRESS)) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: warm_connect: cannot connect to member %s: %s", balancer->members[member].name, strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* takes a connected socket from this worker's warm pool for a member, oldest first.
+ * returns the socket, or -1 if none is ready
+ */
+int warm_take(int member) {
+	MEMBER_POOL *pool=&warm_pools[member];
+	SERVER *server=&balancer->members[member];
+	struct pollfd pfd;
+	char c;
+	int i=0;
+	int fd;
+
+	while(i < pool->count) {
+		pfd.fd=pool->conns[i].fd;
+		pfd.events=POLLOUT;
+		pfd.revents=0;
+		if((pool->conns[i].addr.sin_addr.s_addr == server->myaddr.sin_addr.s_addr) && (pool->conns[i].addr.sin_port == server->myaddr.sin_port) && (poll(&pfd, 1, 0) >= 0)) {
+			/* still connecting */
+			if(pfd.revents == 0) {
+				i++;
+				continue;
+			}
+			/* connected and not closed by the member. Some protocols have the server speak first, that data stays for the client */
+			errno=0;
+			if(!(pfd.revents & (POLLERR | POLLHUP)) && ((recv(pfd.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) > 0) || (errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+				fd=pfd.fd;
+				pool->count--;
+				memmove(&pool->conns[i], &pool->conns[i + 1], sizeof(POOLED_CONN) * (pool->count - i));
+				COUNTER_SUB(server->warm_idle, 1);
+				COUNTER_ADD(server->warm_hits, 1);
+				return fd;
+			}
+		}
+		close(pfd.fd);
+		pool->count--;
+		memmove(&pool->conns[i], &pool->conns[i + 1], sizeof(POOLED_CONN) * (pool->count - i));
+		COUNTER_SUB(server->warm_idle, 1);
+		COUNTER_ADD(server->warm_stale, 1);
+		/* the member may be going down, give it a moment before connecting to it again */
+		pool->retry=time(NULL) + 1;
+	}
+	COUNTER_ADD(server->warm_misses, 1);
+	return -1;
+}
+
+/* tops this worker's warm pools up to warm_pool connections per member and closes the connections that
+ * have been kept for keepalive_timeout, or are to members that can't be given sessions.
+ * returns the number of connects started
+ */
+int warm_refill() {
+	MEMBER_POOL *pool;
+	SERVER *server;
+	time_t now=time(NULL);
+	int started=0;
+	int expired;
+	int fd;
+	int i;
+
+	for(i=0; i < balancer->nmembers; i++) {
+		pool=&warm_pools[i];
+		server=&balancer->members[i];
+		if((server->status != SERVER_STATE_ENABLED) || (server->standby_state == STANDBY_STATE_TRUE)) {
+			warm_drain(i);
+			continue;
+		}
+		if(pool->conns == NULL) {
+			pool->conns=malloc(sizeof(POOLED_CONN) * balancer->warm_pool);
+			if(pool->conns == NULL) {
+				continue;
+			}
+		}
+		for(expired=0; (expired < pool->count) && ((now - pool->conns[expired].since) >= balancer->keepalive_timeout); expired++) {
+			close(pool->conns[expired].fd);
+		}
+		if(expired > 0) {
+			COUNTER_SUB(server->warm_idle, expired);
+			pool->count -= expired;
+			memmove(&pool->conns[0], &pool->conns[expired], sizeof(POOLED_CONN) * pool->count);
+		}
+		while((pool->count < balancer->warm_pool) && (now >= pool->retry)) {
+			fd=warm_connect(i);
+			if(fd < 0) {
+				pool->retry=now + 1;
+				break;
+			}
+			pool->conns[pool->count].fd=fd;
+			pool->conns[pool->count].since=now;
+			pool->conns[pool->count].addr=server->myaddr;
+			pool->count++;
+			COUNTER_ADD(server->warm_idle, 1);
+			started++;
+		}
+	}
+	return started;
+}
+
+/* closes this worker's warm connections to a member.
+ * returns the number closed
+ */
+int warm_drain(int member) {
+	MEMBER_POOL *pool=&warm_pools[member];
+	int closed=pool->count;
+
+	while(pool->count > 0) {
+		close(pool->conns[--pool->count].fd);
+	}
+	if(closed > 0) {
+		COUNTER_SUB(balancer->members[member].warm_idle, closed);
+	}
+	return closed;
+}
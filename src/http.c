@@ -0,0 +1,323 @@
+/*
+ * Octopus Load Balancer - HTTP message framing.
+ *
+ * Copyright 2008-2011 Alistair Reay <alreay1@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+/* A keep-alive session follows the requests its client sends and the responses its member sends back,
+ * as they are read, so that when the client goes away we know whether the member connection sits between
+ * two messages and can be used for another session. With per-request balancing the same tells us when the
+ * next request on the client connection can be sent to a different member.
+ *
+ * Only the framing is followed: the start line, the content-length, transfer-encoding and connection
+ * headers, and the chunk sizes. Bodies are skipped by counting, and only the start of each line is kept.
+ *
+ * Anything the parser can't follow marks the connection as not reusable, it is then closed as before.
+ * That includes responses framed by the connection closing, CONNECT tunnels and upgrades, and HEAD
+ * requests as their responses have headers without a body.
+ */
+
+/* sets a parser up for a new connection */
+int http_reset(HTTP_PARSER *parser, int response) {
+	memset(parser, '\0', sizeof(HTTP_PARSER));
+	parser->response=response;
+	return 0;
+}
+
+/* follows len bytes of a message stream */
+int http_parse(HTTP_PARSER *parser, const char *data, int len) {
+	const char *eol;
+	int i=0;
+	int n;
+	int room;
+
+	while((i < len) && (parser->close == 0)) {
+		/* bodies are skipped */
+		if((parser->state == HTTP_STATE_BODY) || (parser->state == HTTP_STATE_CHUNK_DATA)) {
+			n=len - i;
+			if(n > parser->remain) {
+				n=(int)parser->remain;
+			}
+			parser->remain -= n;
+			i += n;
+			if(parser->remain == 0) {
+				if(parser->state == HTTP_STATE_BODY) {
+					http_message_done(parser);
+				}
+				else {
+					parser->state=HTTP_STATE_CHUNK_END;
+				}
+			}
+			continue;
+		}
+		/* everything else is read a line at a time */
+		eol=memchr(data + i, '\n', len - i);
+		if(eol != NULL) {
+			n=eol - (data + i);
+		}
+		else {
+			n=len - i;
+		}
+		room=(HTTP_LINE_LEN - 1) - parser->line_len;
+		if(room > 0) {
+			memcpy(parser->line + parser->line_len, data + i, (n < room) ? n : room);
+		}
+		if(n >= (int)sizeof(parser->tail)) {
+			memcpy(parser->tail, data + i + n - sizeof(parser->tail), sizeof(parser->tail));
+		}
+		else if(n > 0) {
+			memmove(parser->tail, parser->tail + n, sizeof(parser->tail) - n);
+			memcpy(parser->tail + sizeof(parser->tail) - n, data + i, n);
+		}
+		/* only the length matters past the end of the line buffer, don't let it wrap */
+		if(parser->line_len < INT_MAX - n) {
+			parser->line_len += n;
+		}
+		i += n;
+		if(eol != NULL) {
+			i++;
+			http_line(parser);
+			parser->line_len=0;
+			memset(parser->tail, '\0', sizeof(parser->tail));
+		}
+	}
+	return 0;
+}
+
+/* follows len bytes held in a session buffer, starting offset bytes after the oldest one */
+int http_parse_buffer(HTTP_PARSER *parser, BUFFER *buffer, int offset, int len) {
+	int start;
+	int first;
+
+	if(buffer->size == 0) {
+		return 0;
+	}
+	start=(buffer->head + offset) % buffer->size;
+	first=buffer->size - start;
+	if(first > len) {
+		first=len;
+	}
+	http_parse(parser, buffer->data + start, first);
+	if(len > first) {
+		http_parse(parser, buffer->data, len - first);
+	}
+	return 0;
+}
+
+/* handles a complete line */
+int http_line(HTTP_PARSER *parser) {
+	char *line=parser->line;
+	int len=parser->line_len;
+	int truncated=0;
+	char *end;
+	long long size;
+
+	if(len > HTTP_LINE_LEN - 1) {
+		len=HTTP_LINE_LEN - 1;
+		truncated=1;
+	}
+	if((len > 0) && (line[len - 1] == '\r') && (truncated == 0)) {
+		len--;
+	}
+	line[len]='\0';
+
+	switch(parser->state) {
+	case HTTP_STATE_START:
+		/* empty lines between messages are allowed */
+		if(len == 0) {
+			return 0;
+		}
+		if(parser->response) {
+			/* HTTP/1.x SSS reason */
+			if((len < 12) || strncmp(line, "HTTP/1.", 7) || (line[8] != ' ')) {
+				parser->close=1;
+				return -1;
+			}
+			if(line[7] == '0') {
+				parser->msg |= HTTP_MSG_10;
+			}
+			parser->status=atoi(line + 9);
+		}
+		else {
+			if(!strncmp(line, "CONNECT ", 8)) {
+				parser->msg |= HTTP_MSG_TUNNEL;
+			}
+			else if(!strncmp(line, "HEAD ", 5)) {
+				parser->msg |= HTTP_MSG_HEAD;
+			}
+			/* the version is at the end of the request line, which may not have fitted */
+			if(!strncmp(parser->tail, " HTTP/1.0\r", 10) || !strncmp(parser->tail + 1, " HTTP/1.0", 9)) {
+				parser->msg |= HTTP_MSG_10;
+			}
+			else if(strncmp(parser->tail, " HTTP/1.1\r", 10) && strncmp(parser->tail + 1, " HTTP/1.1", 9)) {
+				/* HTTP/0.9 or HTTP/2, neither of which we follow */
+				parser->close=1;
+				return -1;
+			}
+		}
+		parser->state=HTTP_STATE_HEADERS;
+		return 0;
+	case HTTP_STATE_HEADERS:
+		if(len == 0) {
+			return http_headers_done(parser);
+		}
+		return http_header(parser, line, truncated);
+	case HTTP_STATE_CHUNK_SIZE:
+		errno=0;
+		size=strtoll(line, &end, 16);
+		if((end == line) || (size < 0) || (errno != 0)) {
+			parser->close=1;
+			return -1;
+		}
+		if(size == 0) {
+			parser->state=HTTP_STATE_TRAILERS;
+		}
+		else {
+			parser->remain=size;
+			parser->state=HTTP_STATE_CHUNK_DATA;
+		}
+		return 0;
+	case HTTP_STATE_CHUNK_END:
+		if(len != 0) {
+			parser->close=1;
+			return -1;
+		}
+		parser->state=HTTP_STATE_CHUNK_SIZE;
+		return 0;
+	case HTTP_STATE_TRAILERS:
+		if(len == 0) {
+			http_message_done(parser);
+		}
+		return 0;
+	}
+	return 0;
+}
+
+/* looks at one header line for the framing headers. Header names are case insensitive */
+int http_header(HTTP_PARSER *parser, char *line, int truncated) {
+	char *value;
+	char *end;
+	long long length;
+
+	value=strchr(line, ':');
+	if(value == NULL) {
+		/* a long header that has been cut before its colon doesn't matter to us */
+		return 0;
+	}
+	value++;
+	while((*value == ' ') || (*value == '\t')) {
+		value++;
+	}
+	if(!strncasecmp(line, "content-length:", 15)) {
+		errno=0;
+		length=strtoll(value, &end, 10);
+		if((end == value) || (length < 0) || (errno != 0) || (truncated == 1)) {
+			parser->close=1;
+			return -1;
+		}
+		parser->msg |= HTTP_MSG_LENGTH;
+		parser->remain=length;
+	}
+	else if(!strncasecmp(line, "transfer-encoding:", 18)) {
+		if(truncated == 1) {
+			parser->close=1;
+			return -1;
+		}
+		if(strcasestr(value, "chunked") != NULL) {
+			parser->msg |= HTTP_MSG_CHUNKED;
+		}
+	}
+	else if(!strncasecmp(line, "connection:", 11)) {
+		if((truncated == 1) || (strcasestr(value, "close") != NULL) || (strcasestr(value, "upgrade") != NULL)) {
+			parser->close=1;
+			return -1;
+		}
+		if(strcasestr(value, "keep-alive") != NULL) {
+			parser->msg |= HTTP_MSG_KEEPALIVE;
+		}
+	}
+	return 0;
+}
+
+/* works out where the body of a message ends once its headers have been read */
+int http_headers_done(HTTP_PARSER *parser) {
+	/* an HTTP/1.0 connection is closed after the message unless it asked to be kept alive */
+	if((parser->msg & HTTP_MSG_10) && !(parser->msg & HTTP_MSG_KEEPALIVE)) {
+		parser->close=1;
+		return -1;
+	}
+	if(parser->response) {
+		/* a 101 switches protocols, the other informational responses come before the real one */
+		if(parser->status == 101) {
+			parser->close=1;
+			return -1;
+		}
+		if((parser->status >= 100) && (parser->status < 200)) {
+			parser->state=HTTP_STATE_START;
+			parser->msg=0;
+			parser->status=0;
+			parser->remain=0;
+			return 0;
+		}
+		if((parser->status == 204) || (parser->status == 304)) {
+			return http_message_done(parser);
+		}
+	}
+	else if(parser->msg & (HTTP_MSG_TUNNEL | HTTP_MSG_HEAD)) {
+		parser->close=1;
+		return -1;
+	}
+	if(parser->msg & HTTP_MSG_CHUNKED) {
+		parser->state=HTTP_STATE_CHUNK_SIZE;
+		return 0;
+	}
+	if(parser->msg & HTTP_MSG_LENGTH) {
+		if(parser->remain == 0) {
+			return http_message_done(parser);
+		}
+		parser->state=HTTP_STATE_BODY;
+		return 0;
+	}
+	/* a request without either has no body, a response without either runs until the connection closes */
+	if(parser->response) {
+		parser->close=1;
+		return -1;
+	}
+	return http_message_done(parser);
+}
+
+/* a message has been read to its end */
+int http_message_done(HTTP_PARSER *parser) {
+	parser->messages++;
+	parser->state=HTTP_STATE_START;
+	parser->msg=0;
+	parser->status=0;
+	parser->remain=0;
+	return 0;
+}
+
+/* returns 1 if the session's member connection is between messages, with every request answered,
+ * and may be used for another session or another request. Client data that hasn't been parsed yet
+ * isn't counted, per-request balancing asks before the start of the next request is parsed
+ */
+int http_reusable(SESSION *session) {
+	HTTP_PARSER *request=&session->request;
+	HTTP_PARSER *response=&session->response;
+
+	if(!(session->state & STATE_HTTP) || (request->close != 0) || (response->close != 0)) {
+		return 0;
+	}
+	if((request->state != HTTP_STATE_START) || (response->state != HTTP_STATE_START) || (request->line_len != 0) || (response->line_len != 0)) {
+		return 0;
+	}
+	if((request->messages == 0) || (request->messages != response->messages)) {
+		return 0;
+	}
+	return 1;
+}
@@ -122,14 +122,31 @@ int initialize_logging(char *conf_file) {
 
 /* statically allocate all the memory required for handling client, member and ghost send/recv buffers
  * static allocation is memory hungry but it pays off in terms of stability and performance (no malloc required ondemand)
+ * when running several workers each worker only allocates its own slice of the session limit.
  */
 SESSION* initialize_sessions() {
 	int i;
 	int supportable_sessions=0;
+	int pooled_fds;
 
 	/* work out how many sessions we can support max with this amount of fds
-	 * we divide by 3 because each session requires client, server,and clone FDs */
-	supportable_sessions = (balancer->fd_limit - 4) / 3;
+	 * we divide by 3 because each session requires client, server,and clone FDs.
+	 * In splice relay mode a session may instead hold client, server and two pipes (6 FDs),
+	 * or client, server, clone and three pipes (9 FDs) when there are clones.
+	 * The idle keep-alive and warm connections each worker may hold to the members are set aside first */
+	pooled_fds = (balancer->keepalive_pool + balancer->warm_pool) * balancer->nmembers;
+	if(pooled_fds > (balancer->fd_limit / 2)) {
+		pooled_fds = balancer->fd_limit / 2;
+	}
+	if((balancer->relay_mode == RELAY_MODE_SPLICE) && (balancer->nclones > 0)) {
+		supportable_sessions = (balancer->fd_limit - pooled_fds - 4) / 9;
+	}
+	else if(balancer->relay_mode == RELAY_MODE_SPLICE) {
+		supportable_sessions = (balancer->fd_limit - pooled_fds - 4) / 6;
+	}
+	else {
+		supportable_sessions = (balancer->fd_limit - pooled_fds - 4) / 3;
+	}
 	snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_sessions: With %d fds we can support %d sessions", balancer->fd_limit, supportable_sessions);
 	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 	/* zero means we'll use the max setting */
@@ -147,25 +164,46 @@ SESSION* initialize_sessions() {
 		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 	}
 
+	/* every worker gets an equal slice of the session limit */
+	worker_session_limit = balancer->session_limit / balancer->workers;
+	if(worker_session_limit < 1) {
+		worker_session_limit = 1;
+	}
+	if(balancer->workers > 1) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_sessions: %d workers will each handle up to %d sessions", balancer->workers, worker_session_limit);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+
 	/* now we allocate enough memory for all the sessions (static allocation) */
-	sessions = malloc(sizeof(SESSION) * balancer->session_limit);
+	sessions = malloc(sizeof(SESSION) * worker_session_limit);
 	if(sessions == NULL) {
 		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: initialize_sessions: Unable to allocate memory for sessions - %s", strerror(errno));
 		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
 	}
 	/* initialize all sessions with default (unused) values */
-	memset(sessions,'\0',(sizeof(SESSION) * balancer->session_limit));
-	for(i=0; i<balancer->session_limit;i++) {
+	memset(sessions,'\0',(sizeof(SESSION) * worker_session_limit));
+	for(i=0; i<worker_session_limit;i++) {
 		sessions[i].id=i;
 		sessions[i].state=STATE_UNUSED;
 		sessions[i].clientfd=-1;
 		sessions[i].memberfd=-1;
 		sessions[i].clonefd=-1;
-		sessions[i].client_used_buffer=0;
-		sessions[i].member_used_buffer=0;
-		sessions[i].clone_used_buffer=0;
+		sessions[i].buffer_limit=MESSAGE_SIZE_LIMIT;
+		sessions[i].wait_prev=-1;
+		sessions[i].wait_next=-1;
+		sessions[i].connect_prev=-1;
+		sessions[i].connect_next=-1;
+		sessions[i].timer_slot=-1;
+		sessions[i].timer_prev=-1;
+		sessions[i].timer_next=-1;
+		sessions[i].client_pipe[0]=-1;
+		sessions[i].client_pipe[1]=-1;
+		sessions[i].member_pipe[0]=-1;
+		sessions[i].member_pipe[1]=-1;
+		sessions[i].clone_pipe[0]=-1;
+		sessions[i].clone_pipe[1]=-1;
 	}
-	snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_sessions: initialized %d sessions", balancer->session_limit);
+	snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_sessions: initialized %d sessions", worker_session_limit);
 	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 	initialize_unused_session(); // added by Cheng Ren, 2012-9-30
 	return 0;
@@ -173,6 +211,7 @@ SESSION* initialize_sessions() {
 
 /*Begin---- by Cheng Ren, 2012-9-27*/
 /*allocate memory for the unused session list*/
+/* the queue has one slot more than there are sessions so that a full queue (head != rear) can be told apart from an empty one (head == rear) */
 int initialize_unused_session() {
 
 	if(sessions == NULL) {
@@ -180,7 +219,7 @@ int initialize_unused_session() {
 		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
 	}
 	
-	unused_session_queue.unused_sessions = malloc(sizeof(SESSION) * balancer->session_limit);
+	unused_session_queue.unused_sessions = malloc(sizeof(SESSION *) * (worker_session_limit + 1));
 	unused_session_queue.head = 0;
 	unused_session_queue.rear = 0;
 
@@ -189,25 +228,21 @@ int initialize_unused_session() {
 		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
 	}
 
-	snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_unused_session: Using user defined session limit as the number of free sessions", balancer->session_limit);
-	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
-	
 	/* add all of the unused sessions to the free list */
 	int i;
-	for(i=0; i< balancer->session_limit; i++) {
+	for(i=0; i< worker_session_limit; i++) {
 		if ((sessions[i].state) == STATE_UNUSED) {
-			unused_session_queue.unused_sessions[unused_session_queue.rear] = &sessions[i];
-			unused_session_queue.rear = (unused_session_queue.rear+1) % balancer->session_limit;  
+			add_unused_session(&sessions[i]);
 		}
 	}
 
-	snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_unused_session: initialized %d sessions", balancer->session_limit);
+	snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_unused_session: initialized %d sessions", worker_session_limit);
 	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 	return 0;
 }
 /*End*/
 
-/* try to set file descriptor limits and then initialize FD structure array */
+/* try to set file descriptor limits */
 int initialize_fds() {
 	int status;
 	/* this struct has a soft limit and hard limit field within it */
@@ -238,17 +273,6 @@ int initialize_fds() {
 		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: set_fd_limits: Unable to get fd limit");
 		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 	}
-
-	/* allocate enough memory for all FDs (static allocation) */
-	fds = malloc(sizeof(FD) * balancer->fd_limit);
-	if(fds == NULL) {
-		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: initialize_fds: Unable to initialize file descriptor set  - %s", strerror(errno));
-		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
-	}
-	/* initialize with default values */
-	memset(fds,'\0',(sizeof(FD) * balancer->fd_limit));
-	snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_fds: initialized file descriptor set with %d elements", balancer->fd_limit);
-	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 	return 0;
 }
 
@@ -291,6 +315,28 @@ int initialize_balancer() {
 	balancer->shm_perms=DEFAULT_SHM_PERMS;
 	balancer->connection_rejected_log_suppress=0;
 	balancer->debug_level=temporary_debug_level;
+	balancer->workers=DEFAULT_WORKERS;
+	balancer->epoll_mode=DEFAULT_EPOLL_MODE;
+	balancer->inline_writes=DEFAULT_INLINE_WRITES;
+	balancer->accept_budget=DEFAULT_ACCEPT_BUDGET;
+	balancer->defer_accept=DEFAULT_DEFER_ACCEPT;
+	balancer->relay_mode=DEFAULT_RELAY_MODE;
+	balancer->buffer_memory=DEFAULT_BUFFER_MEMORY;
+	balancer->buffer_size=DEFAULT_BUFFER_SIZE;
+	balancer->buffer_size_max=DEFAULT_BUFFER_SIZE_MAX;
+	balancer->buffer_mode=DEFAULT_BUFFER_MODE;
+	balancer->io_backend=DEFAULT_IO_BACKEND;
+	balancer->clone_lag=DEFAULT_CLONE_LAG;
+	balancer->keepalive_pool=DEFAULT_KEEPALIVE_POOL;
+	balancer->keepalive_timeout=DEFAULT_KEEPALIVE_TIMEOUT;
+	balancer->warm_pool=DEFAULT_WARM_POOL;
+	balancer->listen_fastopen=DEFAULT_LISTEN_FASTOPEN;
+	balancer->member_fastopen=DEFAULT_MEMBER_FASTOPEN;
+	balancer->http_balancing=DEFAULT_HTTP_BALANCING;
+	balancer->client_timeout=DEFAULT_CLIENT_TIMEOUT;
+	balancer->member_timeout=DEFAULT_MEMBER_TIMEOUT;
+	balancer->session_lifetime=DEFAULT_SESSION_LIFETIME;
+	balancer->drain_timeout=DEFAULT_DRAIN_TIMEOUT;
 	inet_aton(DEFAULT_ADDRESS, &balancer->binding_ip);
 
 	strncpy(balancer->version, OCTOPUS_VERSION, OCTOPUS_VERSION_LEN);
@@ -307,6 +353,7 @@ int initialize_shm() {
 	char *data = NULL;
 	key_t key;
 	int shmid;
+	char *run_file;
 	umask(0);
 	struct stat stat_buffer;
 	char temp_name[512];
@@ -337,30 +384,39 @@ int initialize_shm() {
 	}
 
 	/* we should be creating a new .shm file in RUN_DIR. If the file already
-	 * exists then there is already an instance running on that ip and port combo
+	 * exists then there is already an instance running on that ip and port combo.
+	 * A binary taking over from a running instance makes its file under a temporary
+	 * name and only moves it into place once it is running, see upgrade_commit()
 	 */
-	status = stat(balancer->shm_run_file, &stat_buffer);
+	run_file=balancer->shm_run_file;
+	if(upgrade_state == UPGRADE_TAKEOVER) {
+		snprintf(upgrade_run_file, SHM_FILE_FULLNAME_MAX_LENGTH, "%s.upgrade", balancer->shm_run_file);
+		run_file=upgrade_run_file;
+		unlink(run_file);
+	}
+	status = stat(run_file, &stat_buffer);
 	if(status == -1) {
-		if ((fd = open(balancer->shm_run_file, O_CREAT | O_RDWR, balancer->shm_perms)) == -1) {
-			snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: initialize_shm: Unable to create file %s: %s", balancer->shm_run_file, strerror(errno));
+		if ((fd = open(run_file, O_CREAT | O_RDWR, balancer->shm_perms)) == -1) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: initialize_shm: Unable to create file %.*s: %s", OCTOPUS_LOG_PATH_LEN, run_file, strerror(errno));
 			write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
 		}
 	}
 	else {
-		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: Unable to create balancer. File %s already exists. Maybe a server instance is already running?", balancer->shm_run_file);
+		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: Unable to create balancer. File %.*s already exists. Maybe a server instance is already running?", OCTOPUS_LOG_PATH_LEN, run_file);
 		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
 	}
 
 	/* create a SHM key using a pathname and a project identifier */
-	if ((key = ftok(balancer->shm_run_file, 'Z')) == -1) {
+	if ((key = ftok(run_file, 'Z')) == -1) {
       	snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: initialize_shm: Unable to make SHM key - %s", strerror(errno));
 		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
 	}
 	snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_shm: SHM key= %d",key);
 	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 
-	/* allocate a SHM memory segment for storing the balancer struct */
-	if ((shmid = shmget(key, sizeof(BALANCER), balancer->shm_perms | IPC_CREAT )) == -1) {
+	/* allocate a SHM memory segment for storing the balancer struct. While the running instance
+	 * still has its segment the key of the new one must not be the same as its key */
+	if ((shmid = shmget(key, sizeof(BALANCER), balancer->shm_perms | IPC_CREAT | ((upgrade_state == UPGRADE_TAKEOVER) ? IPC_EXCL : 0))) == -1) {
 		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: initialize_shm: Unable to create server SHM segment - %s", strerror(errno));
 		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
 	}
@@ -373,6 +429,10 @@ int initialize_shm() {
 		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
 	}
 
+	/* the state of the instance being upgraded goes into the new segment with the rest */
+	if(upgrade_state == UPGRADE_TAKEOVER) {
+		upgrade_adopt();
+	}
 	/* copy all of the balancer struct into this address space */
 	memcpy(data, balancer, sizeof(BALANCER));
 	/* then free the original pointer */
@@ -419,6 +479,31 @@ int create_serversocket() {
 		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: Unable to set REUSEADDR on server socket");
 		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 	}
+	/* with multiple workers every worker binds its own listener to the same ip/port and the kernel spreads new connections between them */
+	if(balancer->workers > 1) {
+		status = setsockopt(listener, SOL_SOCKET, SO_REUSEPORT, &yes, (socklen_t)sizeof(yes));
+		if(status<0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: Unable to set REUSEPORT on server socket: %s", strerror(errno));
+			write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+		}
+	}
+	/* HASH and STATIC can't choose a member before the request has arrived, so the kernel holds the
+	 * connection back until it has. A client that sends nothing is still accepted after defer_accept seconds */
+	if((balancer->defer_accept > 0) && ((balancer->algorithm == ALGORITHM_HASH) || (balancer->algorithm == ALGORITHM_STATIC))) {
+		status = setsockopt(listener, IPPROTO_TCP, TCP_DEFER_ACCEPT, &balancer->defer_accept, (socklen_t)sizeof(balancer->defer_accept));
+		if(status<0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: Unable to set TCP_DEFER_ACCEPT on server socket: %s", strerror(errno));
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		}
+	}
+	/* clients that have a Fast Open cookie from us can send their first data with the SYN */
+	if(balancer->listen_fastopen > 0) {
+		status = setsockopt(listener, IPPROTO_TCP, TCP_FASTOPEN, &balancer->listen_fastopen, (socklen_t)sizeof(balancer->listen_fastopen));
+		if(status<0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: Unable to set TCP_FASTOPEN on server socket: %s", strerror(errno));
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		}
+	}
 	/* bind the socket fd to the ip/tcp address */
 	status = bind(listener, (struct sockaddr *)&srvaddr, (socklen_t)sizeof(srvaddr));
 	if(status<0) {
@@ -433,3 +518,82 @@ int create_serversocket() {
 	}
 	return listener;
 }
+
+/* creates one listening socket per worker. They are all created by the master before
+ * the workers are forked so that bind errors are reported before any worker starts
+ */
+int initialize_listeners() {
+	int i=0;
+	/* an upgrade carries on with the running instance's listeners so no connection is refused */
+	if(upgrade_state == UPGRADE_TAKEOVER) {
+		i=upgrade_listeners();
+	}
+	for(; i < balancer->workers; i++) {
+		listeners[i] = create_serversocket();
+	}
+	return 0;
+}
+
+/* forks the additional event-loop workers. The master process is always worker 0.
+ * Every worker inherits a private copy of the session tables and keeps only its own listener
+ */
+int initialize_workers() {
+	int i;
+	int j;
+	pid_t pid;
+	balancer->worker_pids[0]= getpid();
+	for(i=1; i < balancer->workers; i++) {
+		if((pid = fork()) < 0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: initialize_workers: Cannot fork worker %d - %s", i, strerror(errno));
+			write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+		}
+		/* worker process */
+		else if(pid == 0) {
+			worker_id=i;
+			break;
+		}
+		balancer->worker_pids[i]= pid;
+	}
+	/* every process closes the listeners that belong to the other workers */
+	for(j=0; j < balancer->workers; j++) {
+		if(j != worker_id) {
+			close(listeners[j]);
+		}
+	}
+	if(worker_id > 0 && balancer->debug_level > 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_workers: worker %d started with pid %d", worker_id, getpid());
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	return 0;
+}
+
+/* sets up the worker's pool of session buffers. Nothing is allocated here, the pool grows as sessions
+ * need buffers up to the worker's share of the buffer_memory budget
+ */
+int initialize_buffers() {
+	int class;
+	for(class=0; class < BUFFER_CLASSES; class++) {
+		buffer_pool.free_list[class]=NULL;
+		buffer_pool.free_blocks[class]=0;
+	}
+	buffer_pool.bytes=0;
+	buffer_pool.max_bytes=0;
+	buffer_pool.wait_head=-1;
+	buffer_pool.wait_tail=-1;
+	if(balancer->buffer_memory > 0) {
+		buffer_pool.max_bytes=(long long)balancer->buffer_memory * 1048576 / balancer->workers;
+		if(buffer_pool.max_bytes < ((long long)BUFFER_MIN_BLOCKS * balancer->buffer_size)) {
+			buffer_pool.max_bytes=(long long)BUFFER_MIN_BLOCKS * balancer->buffer_size;
+		}
+	}
+	if(worker_id == 0) {
+		if(buffer_pool.max_bytes > 0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_buffers: each worker may use up to %lld KB of %s buffers starting at %d bytes", buffer_pool.max_bytes / 1024, buffer_mode_status[balancer->buffer_mode], balancer->buffer_size);
+		}
+		else {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: initialize_buffers: %s buffers starting at %d bytes will be allocated as needed", buffer_mode_status[balancer->buffer_mode], balancer->buffer_size);
+		}
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	return 0;
+}
@@ -18,6 +18,7 @@ int check_server_state(SERVER *server) {
 	int select_status=0;
 	int read_status=0;
 	int err_status=0;
+	int streak;
 	struct sockaddr_in server_addr;
 	char readbuffer[1];
 
@@ -121,7 +122,17 @@ int check_server_state(SERVER *server) {
 							write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 						}
 					}
-					server->status= SERVER_STATE_ENABLED;
+					if(server->status != SERVER_STATE_ENABLED) {
+						server->status= SERVER_STATE_ENABLED;
+						SERVERS_CHANGED();
+					}
+					/* the sessions' connects to it that failed since it last took one are reported and forgotten */
+					streak=server->connect_fail_streak;
+					if(streak > 0) {
+						snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: monitor: server \"%s\" passed its check after %d session connects to it failed", server->name, streak);
+						write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+						COUNTER_SUB(server->connect_fail_streak, streak);
+					}
 				}
 			}
 		}
@@ -138,7 +149,10 @@ int check_server_state(SERVER *server) {
 					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 				}
 			}
-			server->status= SERVER_STATE_FAILED;
+			if(server->status != SERVER_STATE_FAILED) {
+				server->status= SERVER_STATE_FAILED;
+				SERVERS_CHANGED();
+			}
 			server->load=SNMP_LOAD_NOT_INIT;
 			server->e_load=0;
 		}
@@ -257,6 +271,7 @@ int handle_delete_servers() {
 			else {
 				balancer->members[i].status = SERVER_STATE_FREE;
 			}
+			SERVERS_CHANGED();
 		}
 	}
 	for (i=0; i< balancer->nclones; i++) {
@@ -272,6 +287,7 @@ int handle_delete_servers() {
 			else {
 				balancer->clones[i].status = SERVER_STATE_FREE;
 			}
+			SERVERS_CHANGED();
 		}
 	}
 	return 0;
@@ -304,6 +320,10 @@ int initialize_monitor(int argc, char *argv[]) {
 		snprintf(log_string, OCTOPUS_LOG_LEN,"STARTUP: initialize_monitor: monitor process started");
 		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 		balancer->monitor_pid= getpid();
+		/* the monitor has no part in an upgrade, the socket to the old binary is the master's */
+		if(upgrade_fd >= 0) {
+			close(upgrade_fd);
+		}
 		last_algorithm = balancer->algorithm;
 		if(balancer->snmp_community_pw == NULL) {
 			write_log(OCTOPUS_LOG_STD, "WARNING: initialize_monitor: SNMP password has not been set. Server load checks will be disabled!", SUPPRESS_OFF);
@@ -340,6 +360,15 @@ int initialize_monitor(int argc, char *argv[]) {
 					else if(balancer->algorithm == ALGORITHM_STATIC) {
 						write_log(OCTOPUS_LOG_STD, "NOTICE: changing balancing algorithm to method: Static", SUPPRESS_OFF);
 					}
+					else if(balancer->algorithm == ALGORITHM_WRR) {
+						write_log(OCTOPUS_LOG_STD, "NOTICE: changing balancing algorithm to method: Weighted Round Robin", SUPPRESS_OFF);
+					}
+					else if(balancer->algorithm == ALGORITHM_WLC) {
+						write_log(OCTOPUS_LOG_STD, "NOTICE: changing balancing algorithm to method: Weighted Least Connections", SUPPRESS_OFF);
+					}
+					else if(balancer->algorithm == ALGORITHM_P2C) {
+						write_log(OCTOPUS_LOG_STD, "NOTICE: changing balancing algorithm to method: Power of Two Choices", SUPPRESS_OFF);
+					}
 					last_algorithm= balancer->algorithm;
 				}
 
@@ -461,8 +490,8 @@ int rebalance_hash() {
 			if(balancer->hash_table[i] == high_load_server_id) {
 				balancer->hash_table[i] = low_load_server_id;
 				hashes_to_move --;
-				balancer->members[high_load_server_id].hash_table_usage --;
-				balancer->members[low_load_server_id].hash_table_usage ++;
+				COUNTER_SUB(balancer->members[high_load_server_id].hash_table_usage, 1);
+				COUNTER_ADD(balancer->members[low_load_server_id].hash_table_usage, 1);
 			}
 		}
 	}
@@ -471,6 +500,16 @@ int rebalance_hash() {
 }
 
 
+/* sets a server's effective load. Going over or back under 100 changes whether it can be chosen in strict overload mode */
+int set_effective_load(SERVER *server, int e_load) {
+	int crossed=((server->e_load > 100) != (e_load > 100));
+	server->e_load= e_load;
+	if(crossed) {
+		SERVERS_CHANGED();
+	}
+	return 0;
+}
+
 /* this function assigns a loading percentage to member and clone servers by dividing current SNMP load by max SNMP load */
 int calc_effective_load() {
 #ifdef USE_SNMP
@@ -484,10 +523,10 @@ int calc_effective_load() {
 		server_load=balancer->members[i].load;
 		server_maxl=balancer->members[i].maxl;
 		if((server_load <= 0.0) || (server_maxl <= 0.0)) {
-			balancer->members[i].e_load= 0;
+			set_effective_load(&balancer->members[i], 0);
 		}
 		else {
-			balancer->members[i].e_load= ((server_load  / server_maxl) * 100);
+			set_effective_load(&balancer->members[i], ((server_load  / server_maxl) * 100));
 			overall_l += balancer->members[i].load;
 			overall_maxl += balancer->members[i].maxl;
 		}
@@ -496,10 +535,10 @@ int calc_effective_load() {
 		server_load=balancer->clones[i].load;
 		server_maxl=balancer->clones[i].maxl;
 		if((server_load < 0.0) || (server_maxl <= 0.0)) {
-			balancer->clones[i].e_load= 0;
+			set_effective_load(&balancer->clones[i], 0);
 		}
 		else {
-			balancer->clones[i].e_load= ((server_load / server_maxl) * 100);
+			set_effective_load(&balancer->clones[i], ((server_load / server_maxl) * 100));
 		}
 	}
 	if(overall_l >0) {
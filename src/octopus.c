@@ -19,6 +19,12 @@
 #include "signals.c"
 #include "logging.c"
 #include "connect.c"
+#include "buffer.c"
+#include "uring.c"
+#include "http.c"
+#include "timer.c"
+#include "upgrade.c"
+#include "reload.c"
 
 /* acceptable command line parameters */
 int usage(char *prog_name) {
@@ -35,18 +41,27 @@ int usage(char *prog_name) {
 
 int main(int argc, char *argv[]) {
 	int listenerfd = 0;
+	int maxevents = 0;
 	int i = 0;
-	struct sockaddr_in clientaddr;
-	socklen_t size = sizeof(clientaddr);
 	int incomingfd = 0;
 	int nfds = 0;
-	int status = 0;
+	int timeout;
+	int wait;
+	uint64_t tag;
+	int role;
+	SESSION *session;
+	struct sigaction upgrade_action;
 	signal(SIGCHLD,signal_handler);
 	signal(SIGUSR1,signal_handler);
 	signal(SIGALRM,signal_handler);
 	signal(SIGTERM,signal_handler);
 	signal(SIGINT,signal_handler);
 	signal(SIGSEGV,signal_handler);
+	/* without SA_RESTART, so that the signal wakes the event loop whichever backend it is waiting in */
+	memset(&upgrade_action, '\0', sizeof(upgrade_action));
+	upgrade_action.sa_handler=signal_handler;
+	sigaction(SIGUSR2, &upgrade_action, NULL);
+	sigaction(SIGHUP, &upgrade_action, NULL);
 
 	int param_foreground=FOREGROUND_OFF;
 	char *param_conf_file = NULL;
@@ -97,6 +112,9 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
+	/* remember how we were started so that an upgrade can start the new binary the same way */
+	upgrade_init(argv[0], param_conf_file, param_foreground);
+	reload_init(param_conf_file);
 	/* allocate memory for the balancer and sets defaults settings */
 	initialize_balancer();
 	/*if we are running the server as a daemon then we don't want to suppress stderr error messages until after the server has started successfully */
@@ -111,41 +129,106 @@ int main(int argc, char *argv[]) {
 	initialize_logging(param_conf_file);
 	/* Parse the configuration file for all other settings */
 	parse_config_file(param_conf_file);
+	/* a binary started by an upgrade learns which instance it is taking over from */
+	upgrade_receive();
 	/* Create shared memory segment and copy BALANCER structure into segment */
 	initialize_shm();
 	/* initialization for the monitor process. It is forked from the main octopus-server binary */
 	initialize_monitor(argc, argv);
-	/* try to set file descriptor limits and then initialize FD structure array */
+	/* try to set file descriptor limits */
 	initialize_fds();
-	/* statically allocate all the memory required for handling client, member and ghost send/recv buffers */
+	/* statically allocate the sessions, their buffers are taken from the buffer pool when needed */
 	initialize_sessions();
 	/* runs the server process which may involve running in the background (daemon mode) */
 	initialize_process();
-	/* standard listening socket creation for the load balancer */
-	listenerfd = create_serversocket();
+	/* standard listening socket creation for the load balancer, one socket per worker */
+	initialize_listeners();
+	/* fork the additional event-loop workers, each one continues from here with its own listener */
+	initialize_workers();
+	/* an upgrade tells the old binary we're running */
+	upgrade_commit();
+	listenerfd = listeners[worker_id];
+	worker_stats = &balancer->worker_stats[worker_id];
+	/* each worker draws its own members for the power of two choices */
+	p2c_seed = ((unsigned int)getpid() * 2654435761u) | 1;
+	/* set up this worker's share of the session buffer memory */
+	initialize_buffers();
+	/* and its timer wheel for the session timeouts */
+	initialize_timers();
+	maxevents = worker_session_limit * 3;
+	if(maxevents > MAX_EPOLL_EVENTS) {
+		maxevents = MAX_EPOLL_EVENTS;
+	}
 
-	/* create the epoll instance */
-	epfd = epoll_create(balancer->fd_limit);
 	/* configure our epoll event groups with the types of notifications we're interested in */
 	null_ev.events = EPOLLERR | EPOLLHUP ;
 	ro_ev.events = EPOLLIN | EPOLLERR | EPOLLHUP;
 	wr_ev.events = EPOLLOUT | EPOLLERR | EPOLLHUP;
 	rw_ev.events = EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLHUP;
-	/* at startup the only FD we care about is the listening socket's fd */
-	ro_ev.data.fd = listenerfd;
-	/* add the listening fd to the epoll instance */
-  	if(epoll_ctl(epfd, EPOLL_CTL_ADD, listenerfd, &ro_ev) < 0) {
-		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: main: error adding listener fd to epoll: %s", strerror(errno));
-		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+	et_ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLERR | EPOLLHUP | EPOLLET;
+#ifdef USE_IO_URING
+	if(balancer->io_backend != IO_BACKEND_EPOLL) {
+		/* create the io_uring instance and start accepting on the listener */
+		uring_init(maxevents);
+		uring_accept(listenerfd);
+	}
+	else
+#endif
+	{
+		/* create the epoll instance */
+		epfd = epoll_create(balancer->fd_limit);
+		/* at startup the only FD we care about is the listening socket's fd */
+		ro_ev.data.u64 = EVENT_TAG_LISTENER;
+		/* add the listening fd to the epoll instance */
+		if(epoll_ctl(epfd, EPOLL_CTL_ADD, listenerfd, &ro_ev) < 0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: main: error adding listener fd to epoll: %s", strerror(errno));
+			write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+		}
 	}
 	write_log(OCTOPUS_LOG_STD | OCTOPUS_LOG_SYSLOG, "STARTUP: main: octopus startup completed", SUPPRESS_OFF);
 	/* startup has completed */
 
 	/* this is the main loop */
 	while(1) {
+		/* SIGUSR2 starts an upgrade in the master, or tells a worker of the old binary to drain */
+		if(upgrade_signal) {
+			upgrade_request();
+		}
+		if(upgrade_state != UPGRADE_NONE) {
+			upgrade_check();
+		}
+		/* SIGHUP makes the master read the configuration file again */
+		if(reload_signal) {
+			reload_request();
+		}
+		/* we don't wait past the deadline of a member connect in progress or a session timeout */
+		timeout=connect_wait_time();
+		wait=timer_wait_time(timer_now);
+		if((wait >= 0) && ((timeout < 0) || (wait < timeout))) {
+			timeout=wait;
+		}
+		/* nor for so long that the warm pools aren't refilled and aged */
+		if((balancer->warm_pool > 0) && ((timeout < 0) || (timeout > WARM_POOL_INTERVAL))) {
+			timeout=WARM_POOL_INTERVAL;
+		}
+		/* nor while the new binary of an upgrade is awaited or the sessions are drained */
+		if((upgrade_state != UPGRADE_NONE) && ((timeout < 0) || (timeout > UPGRADE_INTERVAL))) {
+			timeout=UPGRADE_INTERVAL;
+		}
 		/* most of the time the balancer will just be blocking here */
-		nfds= epoll_wait(epfd, events, (balancer->session_limit * 3), -1);
-		if(nfds <= 0) {
+#ifdef USE_IO_URING
+		if(balancer->io_backend != IO_BACKEND_EPOLL) {
+			nfds= uring_wait(maxevents, timeout);
+		}
+		else
+#endif
+		{
+			worker_stats->event_syscalls++;
+			nfds= epoll_wait(epfd, events, maxevents, timeout);
+			/* the session handlers stamp their traffic with this, uring_wait() sets it before it accepts */
+			timer_now=timer_clock();
+		}
+		if(nfds < 0) {
 			if(errno==EINTR) {
 				continue;
 			}
@@ -157,90 +240,16 @@ int main(int argc, char *argv[]) {
 		if(balancer->debug_level>5) {
 			write_log(OCTOPUS_LOG_STD, "DEBUG: epoll_wait returned.", SUPPRESS_OFF);
 			for(i=nfds; i>0; i--) {
-				snprintf(log_string, OCTOPUS_LOG_LEN, " - event %d @ fd %i",events[i-1].events,events[i-1].data.u32);
+				snprintf(log_string, OCTOPUS_LOG_LEN, " - event %d @ session %u role %d",events[i-1].events,EVENT_TAG_ID(events[i-1].data.u64),EVENT_TAG_ROLE(events[i-1].data.u64));
 				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 			}
 		}
 		/* now we iterate through all of the epoll events */
 		for(i=0; i <nfds; i++) {
 			/* if we had activity on the server socket then we've probably got a new connection request */
-			if ((events[i].data.fd == listenerfd)) {
+			if (events[i].data.u64 == EVENT_TAG_LISTENER) {
 				if((events[i].events & EPOLLIN) ) {
-					/* try and accept the connection request */
-					incomingfd = accept(listenerfd, (struct sockaddr *)&clientaddr, &size);
-					/* handle accept errors */
-					if (incomingfd < 0) {
-						if(errno == EMFILE) {
-							snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: cannot accept new connection, file descriptor limit reached!");
-							write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
-							continue;
-						}
-						else {
-							snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: error accepting new connection: %s",strerror(errno));
-							write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
-							continue;
-						}
-					}
-					/* set the accepted FD to nonblocking */
-					if (fcntl(incomingfd, F_SETFL, O_NONBLOCK) < 0) {
-						snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: error accepting new connection! cannot set NONBLOCK: %s", strerror(errno));
-						write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
-						shutdown(incomingfd, SHUT_RDWR);
-						close(incomingfd);
-						continue;
-					}
-					/* set no delay */
-					if (setsockopt(incomingfd, IPPROTO_TCP, TCP_NODELAY, (char *) &yes, sizeof(yes)) < 0) {
-						snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: error accepting new connection! cannot set TCP_NODELAY: %s", strerror(errno));
-						write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
-						shutdown(incomingfd, SHUT_RDWR);
-						close(incomingfd);
-						continue;
-					}
-					/* assign a new session to the accepted FD */
-					fds[incomingfd].session= get_new_session();
-					/* if we fail to allocate a session then we disconnect the punter */
-					if(fds[incomingfd].session == NULL) {
-						/* closedown the client */
-						shutdown(incomingfd, SHUT_RDWR);
-						close(incomingfd);
-						snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: disconnected new request from host %s, port %d, fd %d as free session was not available", inet_ntoa(clientaddr.sin_addr), ntohs(clientaddr.sin_port), incomingfd);
-						write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
-						continue;
-					}
-					/* set all the session defaults */
-					else {
-						/* session state variables */
-						fds[incomingfd].session->state |= STATE_CLI_CONNECTED;
-						fds[incomingfd].session->state |= STATE_CLI_READ_READY;
-						fds[incomingfd].session->clientfd=incomingfd;
-						/* in debug mode we write a 'connect accepted' message */
-						if(balancer->debug_level > 1) {
-							snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: connect from host %s, port %d, fd %d", inet_ntoa(clientaddr.sin_addr), ntohs(clientaddr.sin_port), incomingfd);
-							write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
-						}
-						/* add the accepted FD to a epoll group (read-only) at the moment */
-						ro_ev.data.fd = incomingfd;
-					    if(epoll_ctl(epfd, EPOLL_CTL_ADD, incomingfd, &ro_ev) < 0) {
-				    		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: error adding incomingfd to epoll set: %s", strerror(errno));
-							write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
-							delete_session(fds[incomingfd].session);
-							continue;
-					    }
-					    /* we will connect the client to a server UNLESS we are using HTTP URI Hashing or Static (because we need to see client's requested URI before we can choose a server) */
-					    else {
-					    	if((balancer->algorithm != ALGORITHM_HASH) && (balancer->algorithm != ALGORITHM_STATIC)) {
-					   			status = choose_server(fds[incomingfd].session);
-					   			if(status == -1) {
-				    				snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: rejecting connection attempt due to server selection not returning any servers!");
-				    				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
-					   				delete_session(fds[incomingfd].session);
-					   				continue;
-					   			}
-					   			fds[incomingfd].session->state &= ~STATE_FRESH;
-					   		}
-					   	}
-					}
+					accept_connections(listenerfd, balancer->accept_budget);
 				}
 				/* we're should only see input events on the listener, everything else is an error */
 				else  {
@@ -248,14 +257,24 @@ int main(int argc, char *argv[]) {
 				}
 			}
 			/* From here on in we're dealing with a FD that's already part of an established session.
-			 * What happens now is that all the FDs are iterated and we add their respective sessions
-			 * to a stack for later maintenance. Then we will copy data depending on what type of
-			 * attention the socket is demanding.
+			 * The event's tag says which session and which of its sockets it is, then we will copy
+			 * data depending on what type of attention the socket is demanding.
 			 */
 			else {
-				incomingfd = events[i].data.fd;
+				tag = events[i].data.u64;
+				session = &sessions[EVENT_TAG_ID(tag)];
+				role = EVENT_TAG_ROLE(tag);
+				/* The socket has been closed since the event was queued. This happens when two FDs of a session
+				 * are reported in the same batch (say clientfd and memberfd) and handling the first one kills the
+				 * session or drops its member or clone. By the time we get to the second event the session may
+				 * even have been reused for another client, but its sockets have been registered with new tags. */
+				if(session->reg[role].tag != tag) {
+					continue;
+				}
+				incomingfd = session_fd(session, role);
+				switch(role) {
 				/* A client FD has changed state */
-				if (incomingfd == fds[incomingfd].session->clientfd) {
+				case EVENT_ROLE_CLIENT:
 					/* check for error */
 					if((events[i].events & EPOLLERR) ) {
 						if(balancer->debug_level > 0) {
@@ -263,7 +282,7 @@ int main(int argc, char *argv[]) {
 							write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 						}
 						/* mark session as having its' client disconnected */
-						delete_session(fds[incomingfd].session);
+						delete_session(session);
 						continue;
 					}
 					/* check for hang-up */
@@ -273,20 +292,35 @@ int main(int argc, char *argv[]) {
 							write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 						}
 						/* mark session as having its' client disconnected */
-						delete_session(fds[incomingfd].session);
+						delete_session(session);
+						continue;
+					}
+					/* in edge-triggered mode we note the readiness and let the session pump move the data */
+					if(balancer->epoll_mode == EPOLL_MODE_EDGE) {
+						if(events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+							session->state |= STATE_CLI_CAN_READ;
+						}
+						if(events[i].events & EPOLLOUT) {
+							session->state |= STATE_CLI_CAN_WRITE;
+						}
+						session_pump(session);
 						continue;
 					}
 					/* client wants to send us something */
 					if((events[i].events & EPOLLIN) ) {
-						client_read(incomingfd);
+						client_read(session);
 					}
-					/* client is available for write */
-					if(events[i].events & EPOLLOUT) {
-						client_write(incomingfd);
+					/* client is available for write, unless the read has closed it */
+					if((events[i].events & EPOLLOUT) && (session->reg[role].tag == tag)) {
+						client_write(session);
 					}
-				}
+					break;
 				/* A member FD has changed state */
-				else if (incomingfd == fds[incomingfd].session->memberfd) {
+				case EVENT_ROLE_MEMBER:
+					/* the connect has completed one way or the other. If it failed the session has moved on */
+					if((session->state & STATE_MEM_CONNECTING) && (connect_done(session) != 0)) {
+						continue;
+					}
 					/* check for error */
 					if((events[i].events & EPOLLERR) ) {
 						if(balancer->debug_level > 0) {
@@ -294,7 +328,7 @@ int main(int argc, char *argv[]) {
 							write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 						}
 						/* member has disconnected */
-						disconnect_member(fds[incomingfd].session);
+						disconnect_member(session);
 						continue;
 					}
 					/* check for hang-up */
@@ -304,20 +338,30 @@ int main(int argc, char *argv[]) {
 							write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 						}
 						/* member has disconnected */
-						disconnect_member(fds[incomingfd].session);
+						disconnect_member(session);
+						continue;
+					}
+					if(balancer->epoll_mode == EPOLL_MODE_EDGE) {
+						if(events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+							session->state |= STATE_MEM_CAN_READ;
+						}
+						if(events[i].events & EPOLLOUT) {
+							session->state |= STATE_MEM_CAN_WRITE;
+						}
+						session_pump(session);
 						continue;
 					}
 					/* member available for read */
 					if((events[i].events & EPOLLIN) ) {
-						member_read(incomingfd);
+						member_read(session);
 					}
-					/* member available for write */
-					if((events[i].events & EPOLLOUT) ) {
-						member_write(incomingfd);
+					/* member available for write, unless the read has closed it */
+					if((events[i].events & EPOLLOUT) && (session->reg[role].tag == tag)) {
+						member_write(session);
 					}
-				}
+					break;
 				/* A clone FD has changed state */
-				else if (incomingfd == fds[incomingfd].session->clonefd)  {
+				case EVENT_ROLE_CLONE:
 					/* check for error */
 					if((events[i].events & EPOLLERR) ) {
 						if(balancer->debug_level>0) {
@@ -325,7 +369,7 @@ int main(int argc, char *argv[]) {
 							write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 						}
 						/* mark the session as having its' clone disconnected */
-						disconnect_clone(fds[incomingfd].session);
+						disconnect_clone(session);
 						continue;
 					}
 					/* check for hang-up */
@@ -335,41 +379,259 @@ int main(int argc, char *argv[]) {
 							write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 						}
 						/* mark the session as having its' clone disconnected */
-						disconnect_clone(fds[incomingfd].session);
+						disconnect_clone(session);
+						continue;
+					}
+					if(balancer->epoll_mode == EPOLL_MODE_EDGE) {
+						if(events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+							session->state |= STATE_CLO_CAN_READ;
+						}
+						if(events[i].events & EPOLLOUT) {
+							session->state |= STATE_CLO_CAN_WRITE;
+						}
+						session_pump(session);
 						continue;
 					}
 					/* clone is available for read */
 					if((events[i].events & EPOLLIN) ) {
-						clone_read(incomingfd);
+						clone_read(session);
 					}
-					/* clone is available for write */
-					if((events[i].events & EPOLLOUT) ) {
-						clone_write(incomingfd);
-					}
-				}
-				/* If we get to here then we've been notified about an FD that's not part of any session.
-				 * This can occur if during the iteration of updated FDs we have two FDs that have changed for a session
-				 * (say clientfd closed and memberfd closed) and the clientfd is processed first then we'll kill the
-				 * entire session (disassociating the fd from a session) so that when we get around to processing the
-				 * memberfd we can't associate it with anything.
-				 * This doesn't cause any problems but it should be captured here.   */
-				else {
-					if(balancer->debug_level > 2) {
-						snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: Unassociated fd %d",incomingfd);
-						write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+					/* clone is available for write, unless the read has closed it */
+					if((events[i].events & EPOLLOUT) && (session->reg[role].tag == tag)) {
+						clone_write(session);
 					}
+					break;
 				}
 			}
 		}
+		/* member connects that have run out of time are given up on, their sessions try another member */
+		if(connecting_head >= 0) {
+			connect_expire();
+		}
+		/* sessions that have been idle or have lasted too long are ended */
+		timer_advance(timer_now);
+#ifdef USE_IO_URING
+		/* sockets whose poll completed in this batch are watched again with their new interest */
+		if(balancer->io_backend == IO_BACKEND_URING_POLL) {
+			uring_rearm();
+		}
+#endif
+		/* buffers handed back while handling the batch go to the sessions that have been waiting for one */
+		if(buffer_pool.wait_head >= 0) {
+			buffer_wake();
+		}
+		/* connections taken from the warm pools are replaced for the next sessions, unless the worker is draining */
+		if((balancer->warm_pool > 0) && (upgrade_state != UPGRADE_DRAINING)) {
+			warm_refill();
+		}
+#ifdef USE_IO_URING
+		/* the reads, writes and connects the sessions now want are queued for the next wait. This comes last
+		 * so that no socket is closed, and its fd maybe reused, between a request being queued and submitted */
+		if(balancer->io_backend == IO_BACKEND_URING) {
+			uring_sync();
+		}
+#endif
+	}
+	return 0;
+}
+
+/* accepts new client connections. The listener is drained with accept4() until the backlog is empty or
+ * budget connections have been taken (0 means no limit). The event loop passes accept_budget, so a burst
+ * of clients doesn't cost an epoll_wait per connection while the established sessions still get their turn.
+ * The listener is always level-triggered so anything left in the backlog is reported again by the next
+ * epoll_wait.
+ * Accepted sockets inherit TCP_NODELAY from the listener so it isn't set again here.
+ */
+int accept_connections(int listenerfd, int budget) {
+	int incomingfd;
+	int accepted=0;
+	struct sockaddr_in clientaddr;
+	socklen_t size;
+
+	worker_stats->accept_wakeups++;
+	while((budget == 0) || (accepted < budget)) {
+		/* try and accept the connection request */
+		size = sizeof(clientaddr);
+		worker_stats->event_syscalls++;
+		incomingfd = accept4(listenerfd, (struct sockaddr *)&clientaddr, &size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		/* handle accept errors */
+		if (incomingfd < 0) {
+			/* nothing left in the backlog */
+			if((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				break;
+			}
+			/* the client gave up before we got to it, try the next one */
+			else if((errno == ECONNABORTED) || (errno == EINTR)) {
+				continue;
+			}
+			else if(errno == EMFILE) {
+				snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: cannot accept new connection, file descriptor limit reached!");
+				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+				break;
+			}
+			else {
+				snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: error accepting new connection: %s",strerror(errno));
+				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+				break;
+			}
+		}
+		accepted++;
+		accept_session(incomingfd, &clientaddr);
+	}
+	worker_stats->accepts += accepted;
+	return accepted;
+}
+
+/* sets up a session for a newly accepted client connection. clientaddr is only used for logging and may be
+ * NULL when the address wasn't collected. Returns -1 if the connection had to be dropped
+ */
+int accept_session(int incomingfd, struct sockaddr_in *clientaddr) {
+	int status;
+	struct sockaddr_in peeraddr;
+	struct tcp_info tcpinfo;
+	socklen_t size;
+	SESSION *session;
+
+	/* assign a new session to the accepted FD */
+	session= get_new_session();
+	/* the address is only used for logging so it's only looked up when there's something to log */
+	if((clientaddr == NULL) && ((session == NULL) || (balancer->debug_level > 1))) {
+		size = sizeof(peeraddr);
+		memset(&peeraddr, '\0', sizeof(peeraddr));
+		getpeername(incomingfd, (struct sockaddr *)&peeraddr, &size);
+		clientaddr = &peeraddr;
+	}
+	/* if we fail to allocate a session then we disconnect the punter */
+	if(session == NULL) {
+		/* closedown the client */
+		shutdown(incomingfd, SHUT_RDWR);
+		close(incomingfd);
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: disconnected new request from host %s, port %d, fd %d as free session was not available", inet_ntoa(clientaddr->sin_addr), ntohs(clientaddr->sin_port), incomingfd);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+		return -1;
+	}
+	/* a client whose data came with its SYN has saved a round trip */
+	if(balancer->listen_fastopen > 0) {
+		size = sizeof(tcpinfo);
+		if((getsockopt(incomingfd, IPPROTO_TCP, TCP_INFO, &tcpinfo, &size) == 0) && (tcpinfo.tcpi_options & TCPI_OPT_SYN_DATA)) {
+			worker_stats->fastopen_accepts++;
+		}
+	}
+	/* session state variables */
+	session->state |= STATE_CLI_CONNECTED;
+	session->state |= STATE_CLI_READ_READY;
+	session->state |= STATE_FRESH;
+	session->clientfd=incomingfd;
+	session->started=timer_now;
+	session->client_active=timer_now;
+	session->accepted_us=timer_clock_us();
+	/* copied data is bounded by the size of the buffer arrays, see buffer_full() */
+	session->buffer_limit=BUFFER_SIZE_MAX;
+	/* in debug mode we write a 'connect accepted' message */
+	if(balancer->debug_level > 1) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: connect from host %s, port %d, fd %d", inet_ntoa(clientaddr->sin_addr), ntohs(clientaddr->sin_port), incomingfd);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	/* add the accepted FD to a epoll group (read-only) at the moment */
+	if(epoll_add(session, EVENT_ROLE_CLIENT) < 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: error adding incomingfd to epoll set: %s", strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+		delete_session(session);
+		return -1;
+	}
+	/* the session's timeouts start now */
+	timer_update(session);
+	/* we will connect the client to a server UNLESS we are using HTTP URI Hashing or Static (because we need to see client's requested URI before we can choose a server) */
+	if((balancer->algorithm != ALGORITHM_HASH) && (balancer->algorithm != ALGORITHM_STATIC)) {
+		status = choose_server(session);
+		if(status == -1) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: rejecting connection attempt due to server selection not returning any servers!");
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+			delete_session(session);
+			return -1;
+		}
+		session->state &= ~STATE_FRESH;
+		/* the payload is never inspected so the data can be spliced, a clone gets a tee() of the client's data */
+		if((balancer->relay_mode == RELAY_MODE_SPLICE) && (balancer->http_balancing == HTTP_BALANCING_CONNECTION)) {
+			if(relay_open_pipes(session) == 0) {
+				session->state |= STATE_SPLICE;
+			}
+		}
+	}
+	/* sessions that aren't spliced don't keep pipes from an earlier use of the session */
+	if(!(session->state & STATE_SPLICE)) {
+		relay_close_pipes(session);
+		/* the copied data is followed as HTTP so the member connection can be kept for another session,
+		 * or each request balanced on its own */
+		if((balancer->keepalive_pool > 0) || (balancer->http_balancing == HTTP_BALANCING_REQUEST)) {
+			session->state |= STATE_HTTP;
+			http_reset(&session->request, 0);
+			http_reset(&session->response, 1);
+		}
+	}
+	/* HASH and STATIC wait for the request. With defer_accept it has usually arrived with the connection,
+	 * so it is read now and the member connected in this iteration rather than after another wakeup.
+	 * The io_uring backend's read goes in with the next wait, which it completes without blocking */
+	if((session->state & STATE_FRESH) && (balancer->defer_accept > 0) && (balancer->io_backend != IO_BACKEND_URING)) {
+		session->state |= STATE_CLI_CAN_READ;
+		if(balancer->epoll_mode == EPOLL_MODE_EDGE) {
+			session_pump(session);
+		}
+		else {
+			client_read(session);
+		}
+		if((session->state != STATE_UNUSED) && !(session->state & STATE_FRESH)) {
+			worker_stats->early_reads++;
+		}
 	}
 	return 0;
 }
 
 /* this function handles reading data from the client */
-int client_read(int fd) {
+int client_read(SESSION *session) {
+	int fd=session->clientfd;
 	int status;
 	/* read the maximum amount of data possible into the client buffer appending to any data that hasn't already been passed to a member */
-	nbytes= read(fd, (fds[fd].session->client_read_buffer + fds[fd].session->client_used_buffer), (MESSAGE_SIZE_LIMIT - fds[fd].session->client_used_buffer));
+	if(session->state & STATE_SPLICE) {
+		/* tee() duplicates from the front of the pipe, so with a clone we only read into an empty pipe */
+		if((session->state & STATE_CLO_CONNECTED) && (session->client_buffer.used > 0)) {
+			nbytes=-1;
+			errno=EAGAIN;
+		}
+		else {
+			worker_stats->io_syscalls++;
+			nbytes= splice(fd, NULL, session->client_pipe[1], NULL, (session->buffer_limit - session->client_buffer.used), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if(nbytes > 0) {
+				session->client_buffer.used += (int)nbytes;
+				if(session->state & STATE_CLO_CONNECTED) {
+					relay_tee(session, (int)nbytes);
+				}
+			}
+		}
+	}
+	else {
+		nbytes= buffer_read(&session->client_buffer, fd, session->buffer_limit);
+	}
+	if((nbytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		/* a pipe can run out of slots before its byte capacity is used up, treat it like a full buffer.
+		 * The same goes for a pipe that is waiting to be drained before the next tee() */
+		if((session->state & STATE_SPLICE) && (session->client_buffer.used > 0)) {
+			session->state |= STATE_CLI_BUFF_FULL;
+			session->state &= ~STATE_CLI_READ_READY;
+			session_update_interest(session);
+			return 0;
+		}
+		/* the socket has been drained, wait for the next notification */
+		session->state &= ~STATE_CLI_CAN_READ;
+		return 0;
+	}
+	/* the buffer pool is exhausted, stop reading from the client until buffer_wake() lets us carry on */
+	if((nbytes < 0) && (errno == ENOBUFS)) {
+		session->state &= ~STATE_CLI_READ_READY;
+		buffer_wait(session, STATE_CLI_BUFF_WAIT);
+		session_update_interest(session);
+		return 0;
+	}
 	/* if read returned an error */
 	if (nbytes <= 0) {
 		/* EOF? */
@@ -387,93 +649,98 @@ int client_read(int fd) {
 			}
 		}
 		/* in any case, the client has disconnected */
-		delete_session(fds[fd].session);
+		delete_session(session);
 	}
 	else {
 		if(balancer->debug_level > 2) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: client_read: read %d bytes from client @ fd %d",(int)nbytes,fd);
 			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 		}
-		/* increase the usage information of our read buffer */
-		fds[fd].session->client_used_buffer += (int)nbytes;
+		session->client_active=timer_now;
+		if(session->state & STATE_HTTP) {
+			/* a new request on a kept-alive connection, with everything before it answered and passed on to the
+			 * client, can be balanced on its own. Pipelined requests stay with the member that has the earlier ones */
+			if((balancer->http_balancing == HTTP_BALANCING_REQUEST) && (session->state & STATE_MEM_CONNECTED) && !(session->state & STATE_FRESH) && (session->client_buffer.used == (int)nbytes) && (session->member_buffer.used == 0) && (http_reusable(session) == 1)) {
+				if(choose_server_request(session) == -1) {
+					snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: closing kept-alive connection as no server could take its next request!");
+					write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+					delete_session(session);
+					return -1;
+				}
+			}
+			http_parse_buffer(&session->request, &session->client_buffer, (session->client_buffer.used - (int)nbytes), (int)nbytes);
+		}
 		/* this check checks if the session has established a connection to a server and if not, connects it */
-		if (fds[fd].session->state & STATE_FRESH) {
-			status = choose_server(fds[fd].session);
+		if (session->state & STATE_FRESH) {
+			status = choose_server(session);
 			/* if we couldn't choose a server then we've got to disconnect the client */
 			if(status == -1) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: rejecting connection attempt due to server selection not returning any servers!");
 				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
-				delete_session(fds[fd].session);
+				delete_session(session);
 				return -1;
 			}
-			fds[fd].session->state &= ~STATE_FRESH;
+			session->state &= ~STATE_FRESH;
 		}
-		/* We maintain an extra buffer for passing client messages to clones. */
-		if((fds[fd].session->state & STATE_CLO_CONNECTED) >0) {
-			/* in the situation where the clone has not been able to be written to enough, we have to cut it loose to avoid any ugliness */
-			if(nbytes > (MESSAGE_SIZE_LIMIT - fds[fd].session->clone_used_buffer)) {
-				disconnect_clone(fds[fd].session);
-			}
-			/* append the data just read from the client into the buffer for the clone */
-			else {
-				strncpy(fds[fd].session->clone_write_buffer + fds[fd].session->clone_used_buffer, (fds[fd].session->client_read_buffer + fds[fd].session->client_used_buffer - nbytes), nbytes);
-				fds[fd].session->clone_used_buffer += nbytes;
+		if(!(session->state & STATE_SPLICE)) {
+			COUNTER_ADD(session->member->buffer_reads[buffer_class(session->client_buffer.size)], 1);
+		}
+		/* We maintain an extra buffer for passing client messages to clones, sized for the clone lag allowance. */
+		if(((session->state & STATE_CLO_CONNECTED) >0) && !(session->state & STATE_SPLICE)) {
+			buffer_attach(&session->clone_buffer, balancer->clone_lag);
+			/* in the situation where the clone has fallen too far behind, we have to cut it loose to avoid any ugliness */
+			/* otherwise append the data just read from the client into the buffer for the clone */
+			if(((session->clone_buffer.used + (int)nbytes) > balancer->clone_lag) || (buffer_append(&session->clone_buffer, &session->client_buffer, (session->client_buffer.used - (int)nbytes), (int)nbytes) != 0)) {
+				disconnect_clone(session);
 			}
 		}
 		/* update session to indicate we'd like to write to servers */
-		fds[fd].session->state |= STATE_MEM_WRITE_READY;
-		fds[fd].session->state |= STATE_CLO_WRITE_READY;
+		session->state |= STATE_MEM_WRITE_READY;
+		session->state |= STATE_CLO_WRITE_READY;
 		/* client input buffer is full? */
-		if(fds[fd].session->client_used_buffer == MESSAGE_SIZE_LIMIT) {
-			fds[fd].session->state |= STATE_CLI_BUFF_FULL;
-			fds[fd].session->state &= ~STATE_CLI_READ_READY;
+		if(buffer_full(&session->client_buffer, session->buffer_limit)) {
+			session->state |= STATE_CLI_BUFF_FULL;
+			session->state &= ~STATE_CLI_READ_READY;
 		}
 
-		/* SESSION SOCKET MAINTAIN */
-		/* CLIENT */
-		/*  read/write is possible */
-		if( (fds[fd].session->state & STATE_CLI_READ_READY) && (fds[fd].session->state & STATE_CLI_WRITE_READY)) {
-			rw_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &rw_ev);
-		}
-		/* only write is possible */
-		else if (fds[fd].session->state & STATE_CLI_WRITE_READY) {
-			wr_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &wr_ev);
-		}
-		/* only read is possible */
-		else if (fds[fd].session->state & STATE_CLI_READ_READY) {
-			ro_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &ro_ev);
-		}
-		/* otherwise we're not interested */
-		else {
-			null_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &null_ev);
-		}
-		/* MEMBER */
-		if(fds[fd].session->state & STATE_MEM_READ_READY) {
-			rw_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &rw_ev);
-		}
-		/* only write is possible */
-		else {
-			wr_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &wr_ev);
-		}
-		/* CLONE */
-		if (fds[fd].session->state & STATE_CLO_CONNECTED) {
-			rw_ev.data.fd=fds[fd].session->clonefd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clonefd, &rw_ev);
+		/* FAST PATH */
+		/* the member (and clone) sockets are nearly always writable, so pass the data on straight away. If the
+		 * member write gets anywhere it does the socket maintenance, otherwise we wait for EPOLLOUT as usual.
+		 * The io_uring backend submits the writes after the batch whatever */
+		if((balancer->epoll_mode == EPOLL_MODE_LEVEL) && (balancer->inline_writes == INLINE_WRITES_ON) && (balancer->io_backend != IO_BACKEND_URING)) {
+			if((session->state & STATE_CLO_CONNECTED) && (write_inline(session, EVENT_ROLE_CLONE) != 0)) {
+				epoll_mod(session, EVENT_ROLE_CLONE, &rw_ev);
+			}
+			if((session->state & STATE_MEM_CONNECTED) && (write_inline(session, EVENT_ROLE_MEMBER) == 0)) {
+				return 0;
+			}
 		}
+
+		/* SESSION SOCKET MAINTAIN */
+		session_update_interest(session);
 	}
 	return 0;
 }
 
 /* this function handles writing data to the client */
-int client_write(int fd) {
+int client_write(SESSION *session) {
+	int fd=session->clientfd;
 	/* attempt to send everything we have to the client */
-	nbytes = write(fd, fds[fd].session->member_read_buffer, fds[fd].session->member_used_buffer);
+	if(session->state & STATE_SPLICE) {
+		worker_stats->io_syscalls++;
+		nbytes = splice(session->member_pipe[0], NULL, fd, NULL, session->member_buffer.used, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if(nbytes > 0) {
+			session->member_buffer.used -= (int)nbytes;
+		}
+	}
+	else {
+		nbytes = buffer_write(&session->member_buffer, fd);
+	}
+	/* the socket send buffer is full, wait for the next notification */
+	if((nbytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		session->state &= ~STATE_CLI_CAN_WRITE;
+		return 0;
+	}
 	if(balancer->debug_level > 2) {
 		snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: client_write: wrote %d bytes to client @ fd %d",(int)nbytes,fd);
 		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
@@ -485,98 +752,84 @@ int client_write(int fd) {
 			write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 		}
 		/* client has disconnected */
-		delete_session(fds[fd].session);
+		delete_session(session);
 	}
 	else {
-		/* update buffer usage */
-		fds[fd].session->member_used_buffer -= (int)nbytes;
+		session->client_active=timer_now;
 		/*no more data for client */
-		if(fds[fd].session->member_used_buffer == 0) {
-			fds[fd].session->state &= ~STATE_CLI_WRITE_READY;
+		if(session->member_buffer.used == 0) {
+			session->state &= ~STATE_CLI_WRITE_READY;
 			/* if the member has been disconnected, and there's no more data for the client, then we're done */
-			if (!(fds[fd].session->state & STATE_MEM_CONNECTED)) {
-				delete_session(fds[fd].session);
+			if (!(session->state & STATE_MEM_CONNECTED)) {
+				delete_session(session);
 				return 0;
 			}
 		}
-		/*there is still more to be written to the client! move any unwritten data to the front of the buffer */
-		else {
-			memcpy(fds[fd].session->member_read_buffer, (fds[fd].session->member_read_buffer + nbytes), fds[fd].session->member_used_buffer);
-		}
 		/* we just wrote some stuff to the client, the member buffer will have free space */
-		if (fds[fd].session->state & STATE_MEM_BUFF_FULL) {
-			fds[fd].session->state &= ~STATE_MEM_BUFF_FULL;
-			fds[fd].session->state |= STATE_MEM_READ_READY;
+		if (session->state & STATE_MEM_BUFF_FULL) {
+			session->state &= ~STATE_MEM_BUFF_FULL;
+			session->state |= STATE_MEM_READ_READY;
 		}
 
 		/* SESSION SOCKET MAINTAIN */
-		/* CLIENT */
-		/*  read/write is possible */
-		if( (fds[fd].session->state & STATE_CLI_READ_READY) && (fds[fd].session->state & STATE_CLI_WRITE_READY)) {
-			rw_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &rw_ev);
-		}
-		/* only write is possible */
-		else if (fds[fd].session->state & STATE_CLI_WRITE_READY) {
-			wr_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &wr_ev);
-		}
-		/* only read is possible */
-		else if (fds[fd].session->state & STATE_CLI_READ_READY) {
-			ro_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &ro_ev);
-		}
-		/* otherwise we're not interested */
-		else {
-			null_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &null_ev);
-		}
-		/* MEMBER */
-		if((fds[fd].session->state & STATE_MEM_WRITE_READY) && (fds[fd].session->state & STATE_MEM_READ_READY)) {
-			rw_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &rw_ev);
-		}
-		/* only write is possible */
-		else if(fds[fd].session->state & STATE_MEM_WRITE_READY) {
-			wr_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &wr_ev);
-		}
-		/* only read is possible */
-		else if(fds[fd].session->state & STATE_MEM_READ_READY) {
-			ro_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &ro_ev);
-		}
-		/* otherwise we're not interested */
-		else {
-			null_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &null_ev);
-		}
-
+		session_update_interest(session);
 	}
 	return 0;
 }
 
 /* this function handles reading data from the member */
-int member_read(int fd) {
+int member_read(SESSION *session) {
+	int fd=session->memberfd;
+	if(session->state & STATE_MEM_CONNECTING) {
+		session->state &= ~STATE_MEM_CAN_READ;
+		return 0;
+	}
 	/* read the maximum amount of data possible into the member buffer appending to any data that hasn't already been passed to the client */
-	nbytes= read(fd, ((fds[fd].session->member_read_buffer) + fds[fd].session->member_used_buffer), (MESSAGE_SIZE_LIMIT - fds[fd].session->member_used_buffer));
+	if(session->state & STATE_SPLICE) {
+		worker_stats->io_syscalls++;
+		nbytes= splice(fd, NULL, session->member_pipe[1], NULL, (session->buffer_limit - session->member_buffer.used), SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if(nbytes > 0) {
+			session->member_buffer.used += (int)nbytes;
+		}
+	}
+	else {
+		nbytes= buffer_read(&session->member_buffer, fd, session->buffer_limit);
+	}
+	if((nbytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		if((session->state & STATE_SPLICE) && (session->member_buffer.used > 0)) {
+			session->state |= STATE_MEM_BUFF_FULL;
+			session->state &= ~STATE_MEM_READ_READY;
+			session_update_interest(session);
+			return 0;
+		}
+		session->state &= ~STATE_MEM_CAN_READ;
+		return 0;
+	}
+	if((nbytes < 0) && (errno == ENOBUFS)) {
+		session->state &= ~STATE_MEM_READ_READY;
+		buffer_wait(session, STATE_MEM_BUFF_WAIT);
+		session_update_interest(session);
+		return 0;
+	}
 	if(balancer->debug_level > 2) {
 		snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: member_read: read %d bytes from server @ fd %d",(int)nbytes,fd);
 		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 	}
 	/* if read returned an error */
 	if (nbytes <= 0) {
+		/* a member that has closed its end can't be kept for another session */
+		session->state &= ~STATE_HTTP;
 		/* socket error! */
 		if(nbytes < 0) {
 			if(balancer->debug_level > 3) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: member_read: ERROR for fd @ %d",fd);
 				write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 			}
-			if (!(fds[fd].session->state & STATE_CLI_WRITE_READY)) {
-				delete_session(fds[fd].session);
+			if (!(session->state & STATE_CLI_WRITE_READY)) {
+				delete_session(session);
 			}
 			else {
-				disconnect_member(fds[fd].session);
+				disconnect_member(session);
 			}
 		}
 		/* EOF - this is normal */
@@ -585,70 +838,74 @@ int member_read(int fd) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: member_read: EOF for fd @ %d",fd);
 				write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 			}
-			if (!(fds[fd].session->state & STATE_CLI_WRITE_READY)) {
-				delete_session(fds[fd].session);
+			if (!(session->state & STATE_CLI_WRITE_READY)) {
+				delete_session(session);
 			}
 			else {
-				disconnect_member(fds[fd].session);
+				disconnect_member(session);
 			}
 		}
 	}
 	else {
-		/* update buffer and bytes accounting */
-		fds[fd].session->member_used_buffer += (int)nbytes;
-		fds[fd].session->member->brecv +=nbytes;
+		session->member_active=timer_now;
+		if(session->state & STATE_MEM_FASTOPEN) {
+			fastopen_check(session);
+		}
+		/* bytes accounting */
+		COUNTER_ADD(session->member->brecv, nbytes);
+		if(!(session->state & STATE_SPLICE)) {
+			COUNTER_ADD(session->member->buffer_reads[buffer_class(session->member_buffer.size)], 1);
+		}
+		if(session->state & STATE_HTTP) {
+			http_parse_buffer(&session->response, &session->member_buffer, (session->member_buffer.used - (int)nbytes), (int)nbytes);
+		}
 		/* reading data from a member will always mean we have to write to the client */
-		fds[fd].session->state |= STATE_CLI_WRITE_READY;
+		session->state |= STATE_CLI_WRITE_READY;
 		/* if out member buffer is full then the won't poll the server for updates until it's got some room */
-		if(fds[fd].session->member_used_buffer == MESSAGE_SIZE_LIMIT) {
+		if(buffer_full(&session->member_buffer, session->buffer_limit)) {
 			if(balancer->debug_level > 3) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: member_read: server buffer full. Unsetting SRV_READ_READY for fd @ %d",fd);
 				write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 			}
-			fds[fd].session->state |= STATE_MEM_BUFF_FULL;
-			fds[fd].session->state &= ~STATE_MEM_READ_READY;
-		}
-		/* SESSION SOCKET MAINTAIN */
-		/* CLIENT */
-		/*  read is possible */
-		if(fds[fd].session->state & STATE_CLI_READ_READY) {
-			rw_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &rw_ev);
-		}
-		/* only write is possible */
-		else {
-			wr_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &wr_ev);
-		}
-
-		/* MEMBER */
-		if((fds[fd].session->state & STATE_MEM_WRITE_READY) && (fds[fd].session->state & STATE_MEM_READ_READY)) {
-			rw_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &rw_ev);
-		}
-		/* only write is possible */
-		else if(fds[fd].session->state & STATE_MEM_WRITE_READY) {
-			wr_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &wr_ev);
-		}
-		/* only read is possible */
-		else if(fds[fd].session->state & STATE_MEM_READ_READY) {
-			ro_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &ro_ev);
+			session->state |= STATE_MEM_BUFF_FULL;
+			session->state &= ~STATE_MEM_READ_READY;
 		}
-		/* otherwise we're not interested */
-		else {
-			null_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &null_ev);
+		/* FAST PATH */
+		/* the client socket is nearly always writable, so pass the response on straight away */
+		if((balancer->epoll_mode == EPOLL_MODE_LEVEL) && (balancer->inline_writes == INLINE_WRITES_ON) && (balancer->io_backend != IO_BACKEND_URING)) {
+			if(write_inline(session, EVENT_ROLE_CLIENT) == 0) {
+				return 0;
+			}
 		}
+		/* SESSION SOCKET MAINTAIN */
+		session_update_interest(session);
 	}
 	return 0;
 }
 
 /* this function handles writing data to the member */
-int member_write(int fd) {
+int member_write(SESSION *session) {
+	int fd=session->memberfd;
+	/* nothing can be sent until the connect has completed, the socket is still watched for EPOLLOUT */
+	if(session->state & STATE_MEM_CONNECTING) {
+		session->state &= ~STATE_MEM_CAN_WRITE;
+		return 0;
+	}
 	/* attempt to send everything we have to the member */
-	nbytes = write(fd, fds[fd].session->client_read_buffer, fds[fd].session->client_used_buffer);
+	if(session->state & STATE_SPLICE) {
+		worker_stats->io_syscalls++;
+		nbytes = splice(session->client_pipe[0], NULL, fd, NULL, session->client_buffer.used, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if(nbytes > 0) {
+			session->client_buffer.used -= (int)nbytes;
+		}
+	}
+	else {
+		nbytes = buffer_write(&session->client_buffer, fd);
+	}
+	if((nbytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		session->state &= ~STATE_MEM_CAN_WRITE;
+		return 0;
+	}
 	if(balancer->debug_level > 2) {
 		snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: member_write: wrote %d bytes to server @ fd %d",(int)nbytes,fd);
 		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
@@ -660,73 +917,55 @@ int member_write(int fd) {
 			write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 		}
 		/* member has disconnected */
-		disconnect_member(fds[fd].session);
+		disconnect_member(session);
 	}
 	else {
-		/* update buffer usage and traffic accounting values */
-		fds[fd].session->client_used_buffer -= (int)nbytes;
-		fds[fd].session->member->bsent += (int)nbytes;
-		/* after writing to a server we expect some sort of response */
-		fds[fd].session->state |= STATE_MEM_READ_READY;
+		session->member_active=timer_now;
+		/* traffic accounting values */
+		COUNTER_ADD(session->member->bsent, nbytes);
+		/* after writing to a server we expect some sort of response, unless we've got no room to store it */
+		if(!(session->state & (STATE_MEM_BUFF_FULL | STATE_MEM_BUFF_WAIT))) {
+			session->state |= STATE_MEM_READ_READY;
+		}
 		/*if the buffer is now empty, then we don't need to monitor the server for write availability */
-		if(fds[fd].session->client_used_buffer == 0) {
+		if(session->client_buffer.used == 0) {
 			if(balancer->debug_level > 3) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: member_write: server buffer empty. Unsetting STATE_MEM_WRITE_READY for fd @ %d",fd);
 				write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 			}
-			fds[fd].session->state &= ~STATE_MEM_WRITE_READY;
-		}
-		/*if the buffer was not fully emptied, move everything that wasn't written to the front of the buffer */
-		else {
-			memcpy(fds[fd].session->client_read_buffer, (fds[fd].session->client_read_buffer + nbytes), fds[fd].session->client_used_buffer);
+			session->state &= ~STATE_MEM_WRITE_READY;
 		}
-		/* we just wrote some stuff to the member, the client buffer will have free space */
-		if(fds[fd].session->state & STATE_CLI_BUFF_FULL) {
-			fds[fd].session->state &= ~STATE_CLI_BUFF_FULL;
-			fds[fd].session->state |= STATE_CLI_READ_READY;
+		/* we just wrote some stuff to the member, the client buffer will have free space.
+		 * A spliced session with a clone has to wait for the pipe to empty, see client_read() */
+		if((session->state & STATE_CLI_BUFF_FULL) && !(STATE_ISSET(session->state, STATE_SPLICE | STATE_CLO_CONNECTED) && (session->client_buffer.used > 0))) {
+			session->state &= ~STATE_CLI_BUFF_FULL;
+			session->state |= STATE_CLI_READ_READY;
 		}
 
 		/* SESSION SOCKET MAINTAIN */
-		/* CLIENT */
-		/*  write is possible */
-		if(fds[fd].session->state & STATE_CLI_WRITE_READY) {
-			rw_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &rw_ev);
-		}
-		/* only read is possible */
-		else {
-			ro_ev.data.fd=fds[fd].session->clientfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clientfd, &ro_ev);
-		}
-
-		/* MEMBER */
-		if((fds[fd].session->state & STATE_MEM_WRITE_READY) && (fds[fd].session->state & STATE_MEM_READ_READY)) {
-			rw_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &rw_ev);
-		}
-		/* only write is possible */
-		else if(fds[fd].session->state & STATE_MEM_WRITE_READY) {
-			wr_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &wr_ev);
-		}
-		/* only read is possible */
-		else if(fds[fd].session->state & STATE_MEM_READ_READY) {
-			ro_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &ro_ev);
-		}
-		/* otherwise we're not interested */
-		else {
-			null_ev.data.fd=fds[fd].session->memberfd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->memberfd, &null_ev);
-		}
+		session_update_interest(session);
 	}
 	return 0;
 }
 
 /* this function handles reading data from the clone */
-int clone_read(int fd) {
+int clone_read(SESSION *session) {
+	int fd=session->clonefd;
 	/* read the maximum amount of data possible into the waste buffer */
-	nbytes= read(fd, waste_buffer, MESSAGE_SIZE_LIMIT);
+#ifdef USE_IO_URING
+	if(balancer->io_backend == IO_BACKEND_URING) {
+		nbytes= uring_result(&session->reg[EVENT_ROLE_CLONE].ring, URING_READ_DONE, session->reg[EVENT_ROLE_CLONE].result);
+	}
+	else
+#endif
+	{
+		worker_stats->io_syscalls++;
+		nbytes= read(fd, waste_buffer, MESSAGE_SIZE_LIMIT);
+	}
+	if((nbytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		session->state &= ~STATE_CLO_CAN_READ;
+		return 0;
+	}
 	if(balancer->debug_level > 2) {
 		snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: clone_read: read %d bytes from clone @ fd %d",(int)nbytes,fd);
 		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
@@ -739,7 +978,7 @@ int clone_read(int fd) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: clone_read: ERROR, setting STATE_CLO_FAILED for fd @ %d",fd);
 				write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 			}
-			disconnect_clone(fds[fd].session);
+			disconnect_clone(session);
 			return -1;
 		}
 		/* EOF - this is normal */
@@ -747,11 +986,11 @@ int clone_read(int fd) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: clone_read: EOF, setting STATE_CLO_FAILED for fd @ %d",fd);
 			write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 		}
-		disconnect_clone(fds[fd].session);
+		disconnect_clone(session);
 	}
 	else {
 		/* bytes accounting */
-		fds[fd].session->clone->brecv +=nbytes;
+		COUNTER_ADD(session->clone->brecv, nbytes);
 
 		/* CLONE SESSION SOCKET MAINTAIN */
 		/* NONE NEEDED!
@@ -762,9 +1001,23 @@ int clone_read(int fd) {
 }
 
 /* this function handles writing data to the clone */
-int clone_write(int fd) {
+int clone_write(SESSION *session) {
+	int fd=session->clonefd;
 	/* attempt to send everything we have to the clone */
-	nbytes =write(fd,fds[fd].session->clone_write_buffer, fds[fd].session->clone_used_buffer);
+	if(session->state & STATE_SPLICE) {
+		worker_stats->io_syscalls++;
+		nbytes = splice(session->clone_pipe[0], NULL, fd, NULL, session->clone_buffer.used, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if(nbytes > 0) {
+			session->clone_buffer.used -= (int)nbytes;
+		}
+	}
+	else {
+		nbytes = buffer_write(&session->clone_buffer, fd);
+	}
+	if((nbytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+		session->state &= ~STATE_CLO_CAN_WRITE;
+		return 0;
+	}
 	if(balancer->debug_level > 2) {
 		snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: clone_write: wrote %d bytes to clone @ fd %d",(int)nbytes,fd);
 		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
@@ -776,40 +1029,317 @@ int clone_write(int fd) {
 			write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 		}
 		/* clone has disconnected */
-		disconnect_clone(fds[fd].session);
+		disconnect_clone(session);
 	}
 	/* on a successful write */
 	else {
-		/* update buffer and bytes accounting */
-		fds[fd].session->clone_used_buffer -= (int)nbytes;
-		fds[fd].session->clone->bsent +=nbytes;
+		/* bytes accounting */
+		COUNTER_ADD(session->clone->bsent, nbytes);
 		/* after a write, we expect a response */
-		fds[fd].session->state |= STATE_CLO_READ_READY;
+		session->state |= STATE_CLO_READ_READY;
 		/*if the buffer is now empty, then we don't need to monitor the server for write availability */
-		if(fds[fd].session->clone_used_buffer==0) {
+		if(session->clone_buffer.used==0) {
 			if(balancer->debug_level > 3) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: clone_write: clone buffer empty. Unsetting STATE_CLO_WRITE_READY for fd @ %d",fd);
 				write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 			}
-			fds[fd].session->state &= ~STATE_CLO_WRITE_READY;
+			session->state &= ~STATE_CLO_WRITE_READY;
+		}
+
+		/* SESSION SOCKET MAINTAIN */
+		session_update_interest(session);
+	}
+	return 0;
+}
+
+/* adds a new session socket to the epoll instance. Level-triggered sockets start out read-only,
+ * edge-triggered sockets are registered once for everything and never modified
+ */
+int epoll_add(SESSION *session, int role) {
+	struct epoll_event *ev;
+	EVENT_REG *reg=&session->reg[role];
+	if(balancer->epoll_mode == EPOLL_MODE_EDGE) {
+		ev=&et_ev;
+	}
+	/* a member connect in progress is seen through by the socket becoming writable */
+	else if((role == EVENT_ROLE_MEMBER) && (session->state & STATE_MEM_CONNECTING)) {
+		ev=&rw_ev;
+	}
+	else {
+		ev=&ro_ev;
+	}
+	/* every registration gets a new generation, 0 is kept for sockets that aren't registered */
+	event_gen=(event_gen + 1) & EVENT_GEN_MASK;
+	if(event_gen == 0) {
+		event_gen=1;
+	}
+	reg->tag=EVENT_TAG(event_gen, session->id, role);
+	reg->events=ev->events;
+	reg->armed=0;
+	ev->data.u64=reg->tag;
+#ifdef USE_IO_URING
+	if(balancer->io_backend == IO_BACKEND_URING_POLL) {
+		return uring_poll_add(session, role);
+	}
+	/* the requests for the socket are made after the batch */
+	if(balancer->io_backend == IO_BACKEND_URING) {
+		reg->ring &= ~(URING_WANT_CONNECT | URING_WAIT_READ | URING_WAIT_WRITE | URING_READ_DONE);
+		return uring_mark(session);
+	}
+#endif
+	worker_stats->event_syscalls++;
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, session_fd(session, role), ev);
+}
+
+/* changes the epoll interest of a session socket. The interest currently registered with the kernel is
+ * remembered per socket so the syscall is only made when the interest actually changes
+ */
+int epoll_mod(SESSION *session, int role, struct epoll_event *ev) {
+	EVENT_REG *reg=&session->reg[role];
+	if(reg->tag == 0) {
+		return -1;
+	}
+	/* edge-triggered sockets keep their original registration */
+	if(balancer->epoll_mode == EPOLL_MODE_EDGE) {
+		return 0;
+	}
+	/* EPOLLOUT stays on until a member connect in progress has completed, see connect_done() */
+	if((role == EVENT_ROLE_MEMBER) && (session->state & STATE_MEM_CONNECTING) && !(ev->events & EPOLLOUT)) {
+		ev=(ev->events & EPOLLIN) ? &rw_ev : &wr_ev;
+	}
+	if(reg->events == ev->events) {
+		worker_stats->epoll_mod_saved++;
+		return 0;
+	}
+	ev->data.u64=reg->tag;
+	reg->events=ev->events;
+	worker_stats->epoll_mod_calls++;
+#ifdef USE_IO_URING
+	if(balancer->io_backend == IO_BACKEND_URING_POLL) {
+		return uring_poll_update(session, role);
+	}
+	if(balancer->io_backend == IO_BACKEND_URING) {
+		return uring_mark(session);
+	}
+#endif
+	worker_stats->event_syscalls++;
+	return epoll_ctl(epfd, EPOLL_CTL_MOD, session_fd(session, role), ev);
+}
+
+/* the epoll interest for a socket that can be read from and/or written to */
+struct epoll_event *interest_ev(int read_ready, int write_ready) {
+	if(read_ready && write_ready) {
+		return &rw_ev;
+	}
+	if(write_ready) {
+		return &wr_ev;
+	}
+	if(read_ready) {
+		return &ro_ev;
+	}
+	return &null_ev;
+}
+
+/* brings the epoll interest of all of a session's sockets in line with its state: a socket is watched for reading
+ * while there's room for what it sends and for writing while there's data waiting for it. A clone is always read
+ * from. epoll_mod() skips the sockets whose interest hasn't changed and the ones that aren't registered
+ */
+int session_update_interest(SESSION *session) {
+	epoll_mod(session, EVENT_ROLE_CLIENT, interest_ev(session->state & STATE_CLI_READ_READY, session->state & STATE_CLI_WRITE_READY));
+	epoll_mod(session, EVENT_ROLE_MEMBER, interest_ev(session->state & STATE_MEM_READ_READY, session->state & STATE_MEM_WRITE_READY));
+	if(session->state & STATE_CLO_CONNECTED) {
+		epoll_mod(session, EVENT_ROLE_CLONE, interest_ev(1, session->state & STATE_CLO_WRITE_READY));
+	}
+	return 0;
+}
+
+/* called before a session socket is closed. epoll forgets closed sockets by itself, io_uring polls
+ * and reads, writes and connects have to be cancelled. Clearing the tag makes any event still queued
+ * for the socket stale
+ */
+int epoll_del(SESSION *session, int role) {
+#ifdef USE_IO_URING
+	if(balancer->io_backend == IO_BACKEND_URING_POLL) {
+		uring_poll_remove(session, role);
+	}
+	if(balancer->io_backend == IO_BACKEND_URING) {
+		uring_cancel(session, role);
+	}
+#endif
+	session->reg[role].tag=0;
+	session->reg[role].events=0;
+	return 0;
+}
+
+/* returns the fd of one of a session's sockets */
+int session_fd(SESSION *session, int role) {
+	if(role == EVENT_ROLE_CLIENT) {
+		return session->clientfd;
+	}
+	if(role == EVENT_ROLE_MEMBER) {
+		return session->memberfd;
+	}
+	return session->clonefd;
+}
+
+/* edge-triggered mode: runs the session's handlers until every socket the session wants to use has hit
+ * EAGAIN or there's no more data to move. Pending writes are done first so the buffers are freed up for reads.
+ * The loop stops as soon as the session is deleted.
+ */
+int session_pump(SESSION *session) {
+	while(session->state != STATE_UNUSED) {
+		if(STATE_ISSET(session->state, STATE_CLI_CONNECTED | STATE_CLI_WRITE_READY | STATE_CLI_CAN_WRITE)) {
+			client_write(session);
 		}
-		/*if the buffer was not fully emptied, move everything that wasn't written to the front of the buffer */
+		else if(STATE_ISSET(session->state, STATE_MEM_CONNECTED | STATE_MEM_WRITE_READY | STATE_MEM_CAN_WRITE)) {
+			member_write(session);
+		}
+		else if(STATE_ISSET(session->state, STATE_CLO_CONNECTED | STATE_CLO_WRITE_READY | STATE_CLO_CAN_WRITE)) {
+			clone_write(session);
+		}
+		else if(STATE_ISSET(session->state, STATE_MEM_CONNECTED | STATE_MEM_READ_READY | STATE_MEM_CAN_READ)) {
+			member_read(session);
+		}
+		else if(STATE_ISSET(session->state, STATE_CLI_CONNECTED | STATE_CLI_READ_READY | STATE_CLI_CAN_READ)) {
+			client_read(session);
+		}
+		else if(STATE_ISSET(session->state, STATE_CLO_CONNECTED | STATE_CLO_READ_READY | STATE_CLO_CAN_READ)) {
+			clone_read(session);
+		}
+		/* nothing left that the kernel will let us do */
 		else {
-			memcpy(fds[fd].session->clone_write_buffer, (fds[fd].session->clone_write_buffer + nbytes), fds[fd].session->clone_used_buffer);
+			break;
 		}
+	}
+	return 0;
+}
 
-		/* CLONE SESSION SOCKET MAINTAIN */
-		/* write is possible */
-		if(fds[fd].session->state & STATE_CLO_WRITE_READY) {
-			rw_ev.data.fd=fds[fd].session->clonefd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clonefd, &rw_ev);
+/* level-triggered mode: runs the write handler for one of the session's sockets straight after a read, without
+ * waiting for epoll to report the socket writable. The handler's EAGAIN path clears the socket's CAN_WRITE flag,
+ * which is how we find out it would have blocked.
+ * returns 0 if the handler got somewhere (and did the socket maintenance), -1 if the caller has to register for EPOLLOUT
+ */
+int write_inline(SESSION *session, int role) {
+	int flag;
+
+	worker_stats->inline_writes++;
+	if(role == EVENT_ROLE_CLIENT) {
+		flag=STATE_CLI_CAN_WRITE;
+		session->state |= flag;
+		client_write(session);
+	}
+	else if(role == EVENT_ROLE_MEMBER) {
+		flag=STATE_MEM_CAN_WRITE;
+		session->state |= flag;
+		member_write(session);
+	}
+	else {
+		flag=STATE_CLO_CAN_WRITE;
+		session->state |= flag;
+		clone_write(session);
+	}
+	/* the write may have ended the session */
+	if((session->state == STATE_UNUSED) || (session->state & flag)) {
+		return 0;
+	}
+	worker_stats->inline_fallbacks++;
+	return -1;
+}
+
+/* creates the pipes a session uses to splice data between its client and member. The pipes stay with the
+ * session when it's reused so they're only created once. The session's buffer limit becomes the pipe capacity.
+ */
+int relay_open_pipes(SESSION *session) {
+	int client_pipe_size;
+	int member_pipe_size;
+	if(session->client_pipe[0] < 0) {
+		if(pipe2(session->client_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: relay_open_pipes: unable to create pipe, using copy relay for session: %s", strerror(errno));
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+			session->client_pipe[0]=-1;
+			session->client_pipe[1]=-1;
+			return -1;
 		}
-		/* otherwise just read */
-		else {
-			ro_ev.data.fd=fds[fd].session->clonefd;
-			epoll_ctl(epfd, EPOLL_CTL_MOD, fds[fd].session->clonefd, &ro_ev);
+	}
+	if(session->member_pipe[0] < 0) {
+		if(pipe2(session->member_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: relay_open_pipes: unable to create pipe, using copy relay for session: %s", strerror(errno));
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+			session->member_pipe[0]=-1;
+			session->member_pipe[1]=-1;
+			relay_close_pipes(session);
+			return -1;
+		}
+	}
+	/* the clone pipe holds what the clone is behind by, so its capacity is the clone lag allowance */
+	if((session->state & STATE_CLO_CONNECTED) && (session->clone_pipe[0] < 0)) {
+		if(pipe2(session->clone_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: relay_open_pipes: unable to create pipe, using copy relay for session: %s", strerror(errno));
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+			session->clone_pipe[0]=-1;
+			session->clone_pipe[1]=-1;
+			relay_close_pipes(session);
+			return -1;
+		}
+		if((fcntl(session->clone_pipe[0], F_SETPIPE_SZ, balancer->clone_lag) < 0) && (balancer->debug_level > 1)) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: relay_open_pipes: unable to size clone pipe for clone_lag %d: %s", balancer->clone_lag, strerror(errno));
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		}
+	}
+	client_pipe_size=fcntl(session->client_pipe[0], F_GETPIPE_SZ);
+	member_pipe_size=fcntl(session->member_pipe[0], F_GETPIPE_SZ);
+	if((client_pipe_size <= 0) || (member_pipe_size <= 0)) {
+		relay_close_pipes(session);
+		return -1;
+	}
+	if(client_pipe_size < member_pipe_size) {
+		session->buffer_limit=client_pipe_size;
+	}
+	else {
+		session->buffer_limit=member_pipe_size;
+	}
+	return 0;
+}
+
+/* closes a session's splice pipes, discarding anything still in them */
+int relay_close_pipes(SESSION *session) {
+	relay_close_pipe(session->client_pipe);
+	relay_close_pipe(session->member_pipe);
+	relay_close_pipe(session->clone_pipe);
+	return 0;
+}
+
+/* closes both ends of a pipe if it is open */
+int relay_close_pipe(int *p) {
+	if(p[0] >= 0) {
+		close(p[0]);
+		close(p[1]);
+		p[0]=-1;
+		p[1]=-1;
+	}
+	return 0;
+}
+
+/* duplicates the len bytes just spliced into the session's empty client pipe into the clone pipe without
+ * consuming them. A clone that is too far behind to take all of them is disconnected, it can't be given a gap.
+ * returns -1 if the clone was disconnected
+ */
+int relay_tee(SESSION *session, int len) {
+	ssize_t teed=-1;
+
+	if((session->clone_buffer.used + len) <= balancer->clone_lag) {
+		worker_stats->io_syscalls++;
+		teed=tee(session->client_pipe[0], session->clone_pipe[1], len, SPLICE_F_NONBLOCK);
+	}
+	if(teed != len) {
+		if(balancer->debug_level > 1) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: relay_tee: clone @ fd %d is more than %d bytes behind, disconnecting it", session->clonefd, balancer->clone_lag);
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
 		}
+		disconnect_clone(session);
+		return -1;
 	}
+	session->clone_buffer.used += len;
 	return 0;
 }
 
@@ -823,14 +1353,16 @@ SESSION* get_new_session() {
 		return NULL;
 	}
 	// delete the session, and return it
-	unused_session_queue.head = (unused_session_queue.head + 1) % unused_session_queue.head;
-	return unused_session_queue.unused_sessions[unused_session_queue.head];
+	SESSION *session = unused_session_queue.unused_sessions[unused_session_queue.head];
+	unused_session_queue.head = (unused_session_queue.head + 1) % (worker_session_limit + 1);
+	return session;
 }
 
 /*Added by Cheng Ren,2012-9-30*/
 int add_unused_session(SESSION *session) {
-	unused_session_queue.rear = (unused_session_queue.rear + 1) % balancer->session_limit;
 	unused_session_queue.unused_sessions[unused_session_queue.rear] = session;
+	unused_session_queue.rear = (unused_session_queue.rear + 1) % (worker_session_limit + 1);
+	return 0;
 }
 
 /*Added by Cheng Ren, 2012-9-30*/
@@ -838,6 +1370,7 @@ int pop_unused_session() {
 	if(unused_session_queue.head == unused_session_queue.rear)
 	{
 		write_log(OCTOPUS_LOG_STD, "WARNING: delete_unused_sessio: unable to delete session, no more free session available!", SUPPRESS_OFF);
+		return -1;
 	}
 	
 	if(balancer->debug_level > 3) {
@@ -846,12 +1379,16 @@ int pop_unused_session() {
 		write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
 	}
 
-	unused_session_queue.head = (unused_session_queue.head + 1) % balancer->session_limit;
+	unused_session_queue.head = (unused_session_queue.head + 1) % (worker_session_limit + 1);
 	return 0;
 }
 
 /* kills a session including shutting down sockets, closing FDs and resetting default session values */
 int delete_session(SESSION *session) {
+	/* a session can be reported by several fds in the same epoll batch, only free it once */
+	if(session->state == STATE_UNUSED) {
+		return 0;
+	}
 	if(balancer->debug_level > 3) {
 		snprintf(log_string, OCTOPUS_LOG_LEN, "DEBUG: deleting session with clientfd %d, memberfd %d, clonefd %d and state %d", session->clientfd, session->memberfd, session->clonefd, session->state);
 		write_log(OCTOPUS_LOG_STD,log_string, SUPPRESS_OFF);
@@ -859,17 +1396,28 @@ int delete_session(SESSION *session) {
 	if (session->state & STATE_CLI_CONNECTED) {
 		disconnect_client(session);
 	}
+	/* a member connection that is between HTTP messages goes back to the pool */
+	if (session->state & STATE_HTTP) {
+		keepalive_put(session);
+	}
 	if (session->state & STATE_MEM_CONNECTED) {
 		disconnect_member(session);
 	}
 	if (session->state & STATE_CLO_CONNECTED) {
 		disconnect_clone(session);
 	}
+	/* pipes are kept for the next use of the session unless they still hold data */
+	if((session->client_buffer.used > 0) || (session->member_buffer.used > 0)) {
+		relay_close_pipes(session);
+	}
+	buffer_unwait(session);
+	timer_cancel(session);
 	/*session defaults */
 	session->state=STATE_UNUSED;
-	session->client_used_buffer=0;
-	session->member_used_buffer=0;
-	session->clone_used_buffer=0;
+	session->connect_attempts=0;
+	buffer_reset(&session->client_buffer);
+	buffer_reset(&session->member_buffer);
+	buffer_reset(&session->clone_buffer);
 	add_unused_session(session); // added by Cheng Ren, 2012-10-15;
 	return 0;
 }
@@ -880,9 +1428,10 @@ int disconnect_clone(SESSION *session) {
 	/* if the clone has a FD */
 	if(session->clonefd >= 0) {
 		session->state &= ~STATE_CLO_CONNECTED;
-		session->clone->c -=1;
-		session->clone->completed_c ++;
+		server_count_add(session->clone, -1);
+		COUNTER_ADD(session->clone->completed_c, 1);
 		shutdown(session->clonefd, SHUT_RDWR);
+		epoll_del(session, EVENT_ROLE_CLONE);
 		status=close(session->clonefd);
 		if (status!=0) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: Failed to close clone fd: %d",session->clonefd);
@@ -890,6 +1439,9 @@ int disconnect_clone(SESSION *session) {
 		}
 		session->clonefd=-1;
 	}
+	/* nothing more will be sent to the clone */
+	buffer_reset(&session->clone_buffer);
+	relay_close_pipe(session->clone_pipe);
 	return 0;
 }
 
@@ -897,10 +1449,12 @@ int disconnect_member(SESSION *session) {
 	int status=0;
 	/* if the member has a FD */
 	if(session->memberfd >= 0) {
+		connect_untrack(session);
 		session->state &= ~STATE_MEM_CONNECTED;
-		session->member->c -=1;
-		session->member->completed_c ++;
+		server_count_add(session->member, -1);
+		COUNTER_ADD(session->member->completed_c, 1);
 		shutdown(session->memberfd, SHUT_RDWR);
+		epoll_del(session, EVENT_ROLE_MEMBER);
 		status=close(session->memberfd);
 		if (status!=0) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: Failed to close member fd %d",session->memberfd);
@@ -917,6 +1471,7 @@ int disconnect_client(SESSION *session) {
 	if(session->clientfd >= 0) {
 		session->state &= ~STATE_CLI_CONNECTED;
 		shutdown(session->clientfd, SHUT_RDWR);
+		epoll_del(session, EVENT_ROLE_CLIENT);
 		status=close(session->clientfd);
 		if (status!=0) {
 			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: Failed to close client fd %d",session->clientfd);
@@ -10,10 +10,16 @@
  *
  */
 
+/* needed for accept4() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <ctype.h>
 #include <errno.h>
 #include <sys/wait.h>
+#include <signal.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -21,14 +27,23 @@
 #include <netinet/tcp.h>
 #include <sys/shm.h>
 #include <sys/epoll.h>
+#include <poll.h>
 #include <dirent.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
 #include <string.h>
 #include <time.h>
 #include <sys/syslog.h>
 #include <strings.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef USE_IO_URING
+#include <linux/io_uring.h>
+#endif
 #ifdef USE_SNMP
 #include <net-snmp/net-snmp-config.h>
 #include <net-snmp/net-snmp-includes.h>
@@ -48,6 +63,17 @@
 #define FOREGROUND_ON 1
 #define FOREGROUND_INIT 2
 
+/* where a process is in a binary upgrade. The old binary starts the new one and waits for it, then stops
+ * accepting and finishes its sessions. The new binary starts up with the old one's listener and state
+ */
+#define UPGRADE_NONE 0
+#define UPGRADE_STARTED 1
+#define UPGRADE_DRAINING 2
+#define UPGRADE_TAKEOVER 3
+/* the new binary's answer once it is running, the second when it has also replaced the old one's SHM file */
+#define UPGRADE_READY 'R'
+#define UPGRADE_READY_RUN_FILE 'F'
+
 /* Default values that we assume unless overwritten by user config */
 #define DEFAULT_PORT 1080
 #define DEFAULT_ADDRESS "0.0.0.0"
@@ -56,9 +82,54 @@
 #define DEFAULT_CONNECT_TIMEOUT 5
 #define DEFAULT_MAXC 500
 #define DEFAULT_MAXL 4.0
+#define DEFAULT_WEIGHT 1
 #define DEFAULT_REBALANCE_THRESHOLD 30
 #define DEFAULT_REBALANCE_SIZE 5
 #define DEFAULT_REBALANCE_INTERVAL 30
+#define DEFAULT_WORKERS 1
+/* maximum number of connections accepted per listener wakeup, 0 means accept until the backlog is empty */
+#define DEFAULT_ACCEPT_BUDGET 64
+/* seconds the kernel holds a new connection back until its first data arrives (TCP_DEFER_ACCEPT), only
+ * for HASH and STATIC, which need the request to choose a member. 0 turns it off */
+#define DEFAULT_DEFER_ACCEPT 5
+#define DEFER_ACCEPT_MAX 60
+/* buckets of the accept to member connect time histogram, four per power of two microseconds */
+#define LATENCY_BUCKETS 96
+/* megabytes of session buffer memory shared by the workers, 0 means no limit */
+#define DEFAULT_BUFFER_MEMORY 0
+#define DEFAULT_BUFFER_SIZE MESSAGE_SIZE_LIMIT
+#define DEFAULT_BUFFER_SIZE_MAX 65536
+/* bytes of client data a clone may fall behind by before it is disconnected */
+#define DEFAULT_CLONE_LAG 65536
+/* idle member connections each worker keeps per member for reuse, 0 turns the pool off */
+#define DEFAULT_KEEPALIVE_POOL 0
+#define KEEPALIVE_POOL_MAX 1024
+/* seconds an idle member connection is kept before it is closed */
+#define DEFAULT_KEEPALIVE_TIMEOUT 15
+/* connections each worker keeps made in advance to every member, 0 turns the warm pool off */
+#define DEFAULT_WARM_POOL 0
+#define WARM_POOL_MAX 64
+/* milliseconds the event loop may wait before the warm pools are looked at again */
+#define WARM_POOL_INTERVAL 1000
+/* seconds a session may go without traffic from its client or member, or last in all. 0 is no limit */
+#define DEFAULT_CLIENT_TIMEOUT 0
+#define DEFAULT_MEMBER_TIMEOUT 0
+#define DEFAULT_SESSION_LIFETIME 0
+#define SESSION_TIMEOUT_MAX 604800
+/* seconds the processes of the old binary may take to finish their sessions after an upgrade, 0 is no limit */
+#define DEFAULT_DRAIN_TIMEOUT 60
+#define DRAIN_TIMEOUT_MAX 86400
+/* milliseconds the event loop may wait while an upgrade is in progress, and how long the new binary
+ * has to get going before the upgrade is abandoned */
+#define UPGRADE_INTERVAL 100
+#define UPGRADE_START_TIMEOUT 30000
+/* the new binary finds its end of the socket to the old one as this fd, named by this environment variable */
+#define UPGRADE_FD 3
+#define UPGRADE_ENV "OCTOPUS_UPGRADE_FD"
+#define UPGRADE_MAGIC 0x4f435550
+/* the shape of the BALANCER, SERVER and hash table. Bump it whenever they change: a new binary adopts the
+ * state of a running one, whatever its release, only when the layouts are the same */
+#define UPGRADE_LAYOUT 3
 
 
 /* used to determing if SNMP has been compiled into octopus-server and if so, what state it is in */
@@ -69,6 +140,14 @@
 /* maximum length of input we accept from the admin binary */
 #define ADMIN_MAX_INPUT 128
 
+/* the number of event-loop worker processes a balancer may run. Each worker
+ * owns its own SO_REUSEPORT listener, epoll instance and slice of the sessions
+ */
+#define MAXWORKERS 64
+
+/* maximum number of events we collect from a single epoll_wait call */
+#define MAX_EPOLL_EVENTS 20000
+
 /* the admin interface assumes that there are _only_ 512 instances running */
 #define MAXBALANCERS 512
 
@@ -78,6 +157,8 @@
 #define OCTOPUS_LOG_SYSLOG 2
 /* maximum log entry length */
 #define OCTOPUS_LOG_LEN 512
+/* longest file path quoted in a log entry, so a long path cannot push the rest of the entry off the end */
+#define OCTOPUS_LOG_PATH_LEN 256
 
 /* these are the various states that a server may be in */
 #define SERVER_STATE_FREE 0
@@ -97,11 +178,18 @@
 /* a balancer will contain a maximum of 512 servers */
 #define MAXSERVERS 512
 
-/* the amount of data stored temporarily in a SESSION will be 4KB
- * As memory is allocated statically in octopus increasing this
- * increases the memory footprint linearly
+/* the default size of a session buffer, 4KB unless configure was run with --with-buffer-size.
+ * It can be changed with the buffer_size directive or the admin 'buffer' command
  */
+#ifndef MESSAGE_SIZE_LIMIT
 #define MESSAGE_SIZE_LIMIT 4096
+#endif
+
+/* session buffers come in power of two size classes from 1KB to 1MB */
+#define BUFFER_SIZE_MIN 1024
+#define BUFFER_SIZE_MAX 1048576
+#define BUFFER_CLASSES 11
+#define BUFFER_CLASS_SIZE(class) (BUFFER_SIZE_MIN << (class))
 
 /* this is the size of the hash table used by the HASH balancing algorithm.
  * the size determines the number of values that a URL can hash to and
@@ -136,6 +224,161 @@
 #define STATE_CLO_WRITE_READY 1024
 #define STATE_MEM_BUFF_FULL 2048
 #define STATE_CLI_BUFF_FULL 4096
+/* in edge-triggered mode these record that the kernel has reported a socket as readable/writable
+ * and that we haven't since seen EAGAIN on it */
+#define STATE_CLI_CAN_READ 8192
+#define STATE_CLI_CAN_WRITE 16384
+#define STATE_MEM_CAN_READ 32768
+#define STATE_MEM_CAN_WRITE 65536
+#define STATE_CLO_CAN_READ 131072
+#define STATE_CLO_CAN_WRITE 262144
+/* the session relays client/member data through its pipes with splice() instead of the buffers */
+#define STATE_SPLICE 524288
+/* a read is waiting for the buffer pool to have a free buffer */
+#define STATE_CLI_BUFF_WAIT 1048576
+#define STATE_MEM_BUFF_WAIT 2097152
+/* the HTTP framing of the session's traffic is followed, for the keep-alive pool and per-request balancing */
+#define STATE_HTTP 4194304
+/* the member socket's connect hasn't completed yet, see connect_done() */
+#define STATE_MEM_CONNECTING 8388608
+/* the member connect was put off with TCP Fast Open, the first data written to the member goes in the SYN */
+#define STATE_MEM_FASTOPEN 16777216
+/* true when all of the given state flags are set */
+#define STATE_ISSET(state, flags) (((state) & (flags)) == (flags))
+
+/* session sockets can be watched level-triggered, where the interest of each socket is changed as
+ * buffers fill and drain, or edge-triggered where each socket is registered once and read/written until EAGAIN
+ */
+#define EPOLL_MODE_LEVEL 0
+#define EPOLL_MODE_EDGE 1
+#define DEFAULT_EPOLL_MODE EPOLL_MODE_LEVEL
+
+/* in level-triggered mode data just read can be written on straight away instead of waiting for the
+ * next epoll_wait() to report the other socket writable. Edge-triggered sessions always work this way */
+#define INLINE_WRITES_OFF 0
+#define INLINE_WRITES_ON 1
+#define DEFAULT_INLINE_WRITES INLINE_WRITES_ON
+/* TCP Fast Open: the listener's queue of pending Fast Open connections, 0 turns it off on the listener */
+#define DEFAULT_LISTEN_FASTOPEN 0
+#define LISTEN_FASTOPEN_MAX 65535
+#define MEMBER_FASTOPEN_OFF 0
+#define MEMBER_FASTOPEN_ON 1
+#define DEFAULT_MEMBER_FASTOPEN MEMBER_FASTOPEN_OFF
+
+/* data can be relayed by copying it through the session buffers, or for the algorithms that never
+ * look at the payload (RR, LC and LL), moved between the sockets with splice() through a pair of pipes
+ */
+#define RELAY_MODE_COPY 0
+#define RELAY_MODE_SPLICE 1
+#define DEFAULT_RELAY_MODE RELAY_MODE_COPY
+
+/* the session sockets can be watched with epoll, or when compiled with --enable-io-uring, with io_uring polls
+ * where the interest changes and accepts are queued as submissions and sent to the kernel in one batch
+ * with each wait for completions. Both feed the same event handlers, which read, write and connect with
+ * ordinary system calls. The io_uring backend goes further and submits the reads, writes and connects
+ * themselves to the ring, the handlers are run on their completions (see uring.c)
+ */
+#define IO_BACKEND_EPOLL 0
+#define IO_BACKEND_URING_POLL 1
+#define IO_BACKEND_URING 2
+#define DEFAULT_IO_BACKEND IO_BACKEND_EPOLL
+/* size of the io_uring submission queue, the completion queue is twice as big */
+#define URING_ENTRIES 4096
+/* io_uring user_data of a request for a session socket is the socket's event tag (see EVENT_TAG) with the
+ * kind of request in bits 60-61. The top bits, which event tags never use, mark accept requests and requests
+ * whose completions are of no interest */
+#define URING_TAG_IGNORE (1ULL << 63)
+#define URING_TAG_ACCEPT (1ULL << 62)
+#define URING_TAG_OP(op) ((uint64_t)(op) << 60)
+#define URING_TAG_OP_OF(user_data) ((int)(((user_data) >> 60) & 3))
+/* the requests the io_uring backend makes for a session socket */
+#define URING_OP_POLL 0
+#define URING_OP_READ 1
+#define URING_OP_WRITE 2
+#define URING_OP_CONNECT 3
+/* EVENT_REG ring flags: a request of each kind in flight, see URING_BUSY(), then what is still to be done */
+#define URING_BUSY(op) (1 << (op))
+#define URING_WANT_CONNECT 16 /* the connect is to be submitted */
+#define URING_WAIT_READ 32 /* the kernel returned EAGAIN, the next read waits for a poll */
+#define URING_WAIT_WRITE 64
+#define URING_READ_DONE 128 /* clone socket: a read has completed and clone_read() is to take its result */
+/* result of a member connect that had to be waited for with a poll, connect_done() asks the socket */
+#define URING_RESULT_ASK 1
+
+/* every socket registered for events carries a tag in its epoll data (or io_uring user_data) saying which
+ * session it belongs to and which of the session's sockets it is, so an event leads straight to its session
+ * and handler. The session is stored as its index in the worker's sessions array rather than as a pointer,
+ * which leaves room for a generation that is new for each registration. An event queued for a socket that
+ * has been closed since, even if the session or the fd number has been reused, won't match the tag the
+ * session holds and is dropped.
+ *   bits 0-1: role, bits 2-31: session index, bits 32-59: generation
+ */
+#define EVENT_ROLE_CLIENT 0
+#define EVENT_ROLE_MEMBER 1
+#define EVENT_ROLE_CLONE 2
+#define EVENT_ROLE_LISTENER 3
+/* number of sockets a session can have registered */
+#define EVENT_ROLES 3
+#define EVENT_GEN_MASK 0x0fffffffU
+#define EVENT_TAG(gen, id, role) ((((uint64_t)(gen) & EVENT_GEN_MASK) << 32) | ((uint64_t)(id) << 2) | (uint64_t)(role))
+#define EVENT_TAG_ROLE(tag) ((int)((tag) & 3))
+#define EVENT_TAG_ID(tag) ((unsigned int)(((tag) >> 2) & 0x3fffffffU))
+#define EVENT_TAG_LISTENER EVENT_TAG(0, 0, EVENT_ROLE_LISTENER)
+
+/* session buffers are taken from a per-worker pool which grows by slabs of this many bytes (or one buffer
+ * if that is bigger) at a time */
+#define BUFFER_SLAB_SIZE 262144
+/* a worker's pool is never limited to fewer buffers than this, so a session can always make progress */
+#define BUFFER_MIN_BLOCKS 3
+/* io_uring backend: a read or write on the buffer's array is in flight, which keeps the array attached,
+ * or has completed and its result is waiting for the handler */
+#define BUFFER_RING_READ 1
+#define BUFFER_RING_WRITE 2
+#define BUFFER_RING_READ_DONE 4
+#define BUFFER_RING_WRITE_DONE 8
+
+/* session buffers are either always buffer_size bytes, or in adaptive mode each direction of a session
+ * starts at buffer_size, doubles (up to buffer_size_max) after BUFFER_GROW_FILLS reads in a row fill the
+ * buffer and halves after BUFFER_SHRINK_READS reads in a row use less than a quarter of it
+ */
+#define BUFFER_MODE_FIXED 0
+#define BUFFER_MODE_ADAPTIVE 1
+#define DEFAULT_BUFFER_MODE BUFFER_MODE_FIXED
+#define BUFFER_GROW_FILLS 2
+#define BUFFER_SHRINK_READS 4
+
+/* a keep-alive client connection can stay with the member chosen for its first request, or have each request
+ * balanced on its own once the ones before it have been answered
+ */
+#define HTTP_BALANCING_CONNECTION 0
+#define HTTP_BALANCING_REQUEST 1
+#define DEFAULT_HTTP_BALANCING HTTP_BALANCING_CONNECTION
+
+/* the session timeouts are kept on a hierarchical timer wheel, see timer.c. Each level has TIMER_SLOTS
+ * slots, a slot of the first level lasts a tick and one of the next level lasts as long as the whole level below
+ */
+#define TIMER_TICK_MS 100
+#define TIMER_BITS 6
+#define TIMER_SLOTS (1 << TIMER_BITS)
+#define TIMER_MASK (TIMER_SLOTS - 1)
+#define TIMER_LEVELS 4
+
+/* HTTP message framing is followed a line at a time, only the start of each line is kept, see http.c */
+#define HTTP_LINE_LEN 64
+#define HTTP_STATE_START 0 /* between messages or in the start line */
+#define HTTP_STATE_HEADERS 1
+#define HTTP_STATE_BODY 2 /* content-length body */
+#define HTTP_STATE_CHUNK_SIZE 3
+#define HTTP_STATE_CHUNK_DATA 4
+#define HTTP_STATE_CHUNK_END 5 /* the CRLF after a chunk */
+#define HTTP_STATE_TRAILERS 6
+/* the message flags */
+#define HTTP_MSG_10 1 /* HTTP/1.0 */
+#define HTTP_MSG_LENGTH 2 /* has a content-length */
+#define HTTP_MSG_CHUNKED 4
+#define HTTP_MSG_KEEPALIVE 8 /* connection: keep-alive */
+#define HTTP_MSG_TUNNEL 16 /* CONNECT request */
+#define HTTP_MSG_HEAD 32 /* HEAD request */
 
 /* this is where we will place the shm_file */
 #define DEFAULT_SHM_RUN_DIR "/var/run/octopuslb/"
@@ -168,6 +411,24 @@
 #define ALGORITHM_LL 3
 #define ALGORITHM_HASH 4
 #define ALGORITHM_STATIC 5
+#define ALGORITHM_WRR 6
+#define ALGORITHM_WLC 7
+#define ALGORITHM_P2C 8
+
+/* a server's weight is its share of the sessions under WRR and WLC, from 1 to WEIGHT_MAX */
+#define WEIGHT_MAX 256
+
+/* smooth weighted round robin, see algorithms.c */
+#define WRR_STRIDE (1 << 20) /* how far a server of weight 1 moves on when it is chosen */
+#define WRR_PASS_NONE LLONG_MAX /* a server that can't be chosen */
+#define WRR_SPREAD 40503 /* 65536 over the golden ratio, spreads the servers' starting passes */
+
+/* the least connections index, see algorithms.c */
+#define LC_INDEX_SIZE MAXSERVERS /* most leaves of the tree, a power of two */
+#define LC_INDEX_REFRESH 10 /* milliseconds between rebuilds from the SHM */
+#define LC_PICK_RETRIES 4 /* out of date leaves corrected in one pick before the index is rebuilt */
+#define LC_KEY_STANDBY (1 << 30) /* added to the connection count of a standby server */
+#define LC_KEY_NONE INT_MAX /* a server that can't be chosen */
 
 /* servernames must be 16 chars or less */
 #define SERVERNAME_MAX_LENGTH 16
@@ -193,6 +454,20 @@
 #define SUPPRESS_OFF 0
 #define SUPPRESS_CONN_REJECT 1
 
+/* the SERVER counters live in the SHM segment and are updated by every worker
+ * process, so they must be changed atomically
+ */
+#define COUNTER_ADD(counter, value) __sync_fetch_and_add(&(counter), (value))
+#define COUNTER_SUB(counter, value) __sync_fetch_and_sub(&(counter), (value))
+
+/* called by whatever changes which servers a session may be sent to (state, standby, maxc, clone and overload
+ * modes, adding and deleting servers), so the workers know to rebuild their sets of available servers
+ */
+#define SERVERS_CHANGED() COUNTER_ADD(balancer->server_gen, 1)
+/* a reload publishes all of its changes between these two, see reload_apply() */
+#define SERVERS_WRITE_BEGIN() COUNTER_ADD(balancer->server_seq, 1)
+#define SERVERS_WRITE_END() COUNTER_ADD(balancer->server_seq, 1)
+
 /* this struct stores all the information associated with a particular
  * server. IP, tcp port, state, counters and load
  */
@@ -205,6 +480,7 @@ typedef struct {
 	struct sockaddr_in myaddr;	/* socket for server */
 	int c;	/* current number of connections */
 	int maxc;	/* maximum numbre of connections */
+	int weight; /* share of the sessions under the weighted algorithms */
 	unsigned long int completed_c;	/* completed number of connections */
 	unsigned long bsent;	/* bytes sent */
 	unsigned long brecv;	/* bytes received */
@@ -212,8 +488,60 @@ typedef struct {
 	float maxl;	/* user specified max load */
 	int e_load; /* effective loading, maxl/load * 100 */
 	unsigned short int hash_table_usage;
+	unsigned long buffer_reads[BUFFER_CLASSES]; /* reads into session buffers for this server, by buffer size class */
+	unsigned long pool_hits; /* sessions given an idle keep-alive connection */
+	unsigned long pool_misses; /* sessions that had to connect while the keep-alive pool was on */
+	int pool_idle; /* idle keep-alive connections held by all the workers */
+	unsigned long warm_hits; /* sessions given a connection from the warm pool */
+	unsigned long warm_misses; /* sessions that had to connect while the warm pool was on */
+	unsigned long warm_stale; /* warm connections found closed or failed when they were looked at */
+	int warm_idle; /* warm connections held by all the workers, including ones still connecting */
+	unsigned long fastopen_sent; /* connects that sent the first data in the SYN with a Fast Open cookie */
+	unsigned long fastopen_acked; /* of those, connects where the member accepted the data in the SYN */
+	unsigned long connect_failures; /* session connects refused or failed */
+	unsigned long connect_timeouts; /* session connects that didn't complete within connect_timeout */
+	int connect_fail_streak; /* session connects failed in a row, 0 once one succeeds */
 } SERVER;
 
+/* a circular buffer of session data, see buffer.c. The data array is borrowed from the buffer pool
+ * while the buffer holds data and is NULL otherwise */
+typedef struct {
+	char *data;
+	int size; /* capacity of data, 0 while no array is attached */
+	int head; /* offset of the oldest byte */
+	int used; /* bytes held. For spliced sessions the bytes are held in the pipe and only this count is kept */
+	int want; /* adaptive mode: size of the next array to attach, 0 for buffer_size */
+	int streak; /* adaptive mode: reads in a row that filled the buffer (> 0) or left it mostly empty (< 0) */
+	int ring; /* io_uring: BUFFER_RING_* flags of the reads and writes on the array */
+	int ring_read; /* io_uring: result of the completed read that buffer_read() hands the handler */
+	int ring_write; /* io_uring: and of the completed write for buffer_write() */
+} BUFFER;
+
+/* the event registration of one of a session's sockets */
+typedef struct {
+	uint64_t tag; /* what the socket is registered with, 0 while it isn't (see EVENT_TAG) */
+	uint32_t events; /* epoll events currently registered */
+	int armed; /* io_uring: a poll request is outstanding */
+	int ring; /* io_uring backend: URING_BUSY() and URING_* flags. The busy flags outlive the registration */
+	int result; /* io_uring backend: result of the last connect or clone read */
+	struct iovec iov[4]; /* io_uring backend: segments of the read (0-1) and write (2-3) submitted */
+	struct sockaddr_in addr; /* io_uring backend: where the connect goes */
+} EVENT_REG;
+
+/* follows the framing of the HTTP messages going one way through a session */
+typedef struct {
+	int state; /* HTTP_STATE_* */
+	int msg; /* HTTP_MSG_* flags of the current message */
+	int close; /* set once the connection can't carry another message, nothing more is parsed */
+	int response; /* parses responses rather than requests */
+	int status; /* response status code */
+	long long remain; /* bytes left of the body or chunk */
+	unsigned int messages; /* messages completed */
+	int line_len; /* length of the current line, which may be more than fits in line */
+	char line[HTTP_LINE_LEN];
+	char tail[10]; /* the last bytes of the current line, where a request line keeps its version */
+} HTTP_PARSER;
+
 /* this struct stores information about an active session;
  * file descriptors, buffers and pointers to the associated
  * SERVER struct
@@ -224,20 +552,124 @@ typedef struct {
 	int clientfd;
 	int memberfd;
 	int clonefd;
-	char member_read_buffer[MESSAGE_SIZE_LIMIT];
-	char client_read_buffer[MESSAGE_SIZE_LIMIT];
-	char clone_write_buffer[MESSAGE_SIZE_LIMIT];
-	int member_used_buffer;
-	int client_used_buffer;
-	int clone_used_buffer;
+	BUFFER member_buffer; /* data read from the member waiting to be written to the client */
+	BUFFER client_buffer; /* data read from the client waiting to be written to the member */
+	BUFFER clone_buffer; /* copy of the client data waiting to be written to the clone. Spliced sessions only count the clone pipe bytes */
+	int buffer_limit; /* how much data may be held for each direction (buffer or pipe capacity) */
+	int client_pipe[2]; /* splice mode: client to member data */
+	int member_pipe[2]; /* splice mode: member to client data */
+	int clone_pipe[2]; /* splice mode: client data tee()d for the clone */
+	int wait_prev; /* neighbours in the list of sessions waiting for a buffer, -1 for none */
+	int wait_next;
+	int connect_prev; /* neighbours in the list of sessions with a member connect in progress, -1 for none */
+	int connect_next;
+	long long connect_deadline; /* when the member connect in progress is given up, see timer_clock() */
+	int connect_attempts; /* member connects that have failed for the current request */
+	unsigned char connect_tried[MAXSERVERS / 8]; /* the members they were made to */
+	long long started; /* when the client connected, see timer_clock() */
+	long long accepted_us; /* when the client connected in microseconds, 0 once the first member connect is made */
+	long long client_active; /* when data last went to or came from the client */
+	long long member_active; /* and the member */
+	long long timer_tick; /* the tick the session's timer is due, it is on the wheel when timer_slot >= 0 */
+	int timer_slot;
+	int timer_prev; /* neighbours in the timer wheel slot, -1 for none */
+	int timer_next;
+	EVENT_REG reg[EVENT_ROLES]; /* event registrations of the client, member and clone sockets */
+	int ring_dirty; /* io_uring backend: on the list of sessions uring_sync() looks at after the batch */
+	HTTP_PARSER request; /* keep-alive sessions: framing of the client's requests */
+	HTTP_PARSER response; /* and of the member's responses */
 	SERVER *member;
 	SERVER *clone;
 } SESSION;
 
-/* This struct is used as a lookup to the SESSION struct */
+/* per-worker event loop statistics. Each worker only ever writes to its own slot in the BALANCER */
+typedef struct {
+	unsigned long long epoll_mod_calls; /* epoll_ctl(EPOLL_CTL_MOD) calls made */
+	unsigned long long epoll_mod_saved; /* epoll_ctl(EPOLL_CTL_MOD) calls skipped as the interest had not changed */
+	unsigned long long accept_wakeups; /* times the listener was reported readable */
+	unsigned long long accepts; /* connections accepted */
+	unsigned long long event_syscalls; /* epoll_wait/epoll_ctl/accept4 or io_uring_enter calls made by the event loop */
+	unsigned long long uring_sqes; /* io_uring submissions queued */
+	unsigned long long io_syscalls; /* reads, writes, splices and connects made by the session handlers */
+	unsigned long long inline_writes; /* writes tried straight after a read */
+	unsigned long long inline_fallbacks; /* inline writes that would have blocked and had to wait for EPOLLOUT */
+	unsigned long long buffer_bytes; /* memory allocated by the buffer pool */
+	unsigned long long buffer_blocks_used; /* buffers currently attached to a session */
+	unsigned long long buffer_bytes_used; /* memory of the buffers currently attached to a session */
+	unsigned long long buffer_bytes_peak; /* highest buffer_bytes_used seen */
+	unsigned long long buffer_waits; /* reads delayed because the pool was exhausted */
+	unsigned long long http_requests; /* requests after the first on a client connection that were balanced on their own */
+	unsigned long long http_switches; /* of those, requests that moved the session to another member */
+	unsigned long long connect_failovers; /* sessions moved to another member after a failed connect */
+	unsigned long long available_builds; /* times the available servers were built again from the SHM */
+	unsigned long long client_timeouts; /* sessions ended as the client had gone quiet for client_timeout */
+	unsigned long long member_timeouts; /* sessions ended as the member had gone quiet for member_timeout */
+	unsigned long long lifetime_timeouts; /* sessions ended as they had lasted for session_lifetime */
+	unsigned long long fastopen_accepts; /* clients whose data in the SYN was accepted by the listener */
+	unsigned long long early_reads; /* HASH and STATIC: sessions whose request was read as they were accepted */
+	unsigned long long connect_latency[LATENCY_BUCKETS]; /* sessions by the time from accept to the first member connect */
+} WORKER_STATS;
+
+/* per-worker timer wheel of the session timeouts, see timer.c */
+typedef struct {
+	long long tick; /* the last tick that has been handled */
+	int count; /* sessions on the wheel */
+	int slots[TIMER_LEVELS * TIMER_SLOTS]; /* first session in each slot, -1 for none */
+} TIMER_WHEEL;
+
+/* per-worker least connections index over the member or the clone slots, see algorithms.c */
+typedef struct {
+	int key[2 * LC_INDEX_SIZE]; /* node 1 is the root, the children of node i are 2i and 2i+1, slot i is leaf size+i */
+	int size; /* leaves, the power of two at or above n */
+	int n; /* servers in the array when it was built */
+	long long built; /* timer_now when it was built */
+	unsigned int gen; /* server_gen when it was built */
+	int ready;
+} LC_INDEX;
+
+/* per-worker smooth weighted round robin schedule over the member or the clone slots, see algorithms.c */
+typedef struct {
+	long long key[2 * MAXSERVERS]; /* node 1 is the root and holds the smallest pass below it, as in LC_INDEX */
+	long long pass[MAXSERVERS]; /* each server's pass, kept while it is out of the available servers */
+	int in[MAXSERVERS]; /* the server was in the available servers when the schedule was last built */
+	long long now; /* the pass of the last server chosen */
+	int size; /* leaves, the power of two at or above n */
+} WRR_INDEX;
+
+/* per-worker pool of session buffer arrays, see buffer.c */
 typedef struct {
-	SESSION *session;
-} FD;
+	char *free_list[BUFFER_CLASSES]; /* unused arrays of each size class, chained through their first bytes */
+	int free_blocks[BUFFER_CLASSES];
+	long long bytes; /* memory allocated so far */
+	long long max_bytes; /* this worker's share of the buffer_memory budget, 0 is unlimited */
+	int wait_head; /* index of the first session waiting for a buffer, -1 for none */
+	int wait_tail;
+} BUFFER_POOL;
+
+/* an idle member connection kept for reuse, see connect.c */
+typedef struct {
+	int fd;
+	time_t since; /* when it went idle */
+	struct sockaddr_in addr; /* where it is connected to, the member slot may be reused for another server */
+} POOLED_CONN;
+
+/* a worker's idle connections to one member, the most recently used last */
+typedef struct {
+	POOLED_CONN *conns;
+	int count;
+	time_t retry; /* warm pool: not refilled before this time after a connect failed */
+} MEMBER_POOL;
+
+/* what a running instance sends the binary that takes over from it, followed by its listeners, see upgrade.c */
+typedef struct {
+	int magic;
+	int layout; /* UPGRADE_LAYOUT of the running binary */
+	pid_t master_pid;
+	int shmid; /* its SHM segment, the state in it is adopted when the BALANCER layout is the same */
+	size_t balancer_size;
+	char version[OCTOPUS_VERSION_LEN];
+	char run_file[SHM_FILE_FULLNAME_MAX_LENGTH];
+} UPGRADE_HELLO;
 
 /*---Begin---by Cheng Ren, 2012-9-27 */
 /*This struct is the queue of unused sessions*/
@@ -248,6 +680,32 @@ typedef struct{
 } UNUSED_SESSION_QUEUE;
 /*End*/
 
+#ifdef USE_IO_URING
+/* a worker's io_uring instance, see uring.c */
+typedef struct {
+	int fd;
+	unsigned int *sq_head;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int sq_entries;
+	unsigned int sq_local_tail; /* tail including the submissions not yet published to the kernel */
+	unsigned int sq_pending; /* submissions not yet handed to io_uring_enter */
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	uint64_t *rearm; /* tags of the sockets whose one-shot poll completed in the last batch */
+	int rearm_count;
+	unsigned int *dirty; /* io_uring backend: sessions whose requests uring_sync() has to look at */
+	int dirty_count;
+	int accept_multishot; /* cleared if the kernel doesn't support multishot accept */
+	int listenerfd;
+	int ext_arg; /* the kernel takes a timeout with io_uring_enter */
+} URING;
+#endif
+
 /* This struct is the master brain of the load balancer.
  * It contains the SERVERs, accounting information, currently set balancing
  * algorithm, bound tcp port, SNMP password, log file and shm file details
@@ -295,31 +753,200 @@ typedef struct {
 	int overall_load;
 	int connection_rejected_log_suppress;
 	int debug_level;
+	int workers; /* number of event-loop worker processes */
+	int epoll_mode; /* level or edge triggered session sockets */
+	int accept_budget; /* connections accepted per listener wakeup, 0 is unlimited */
+	int defer_accept; /* seconds of TCP_DEFER_ACCEPT on the listener for HASH and STATIC, 0 is off */
+	int relay_mode; /* copy or splice */
+	int buffer_memory; /* megabytes of session buffers all the workers may allocate, 0 is unlimited */
+	int buffer_size; /* size of a session buffer, or the starting size in adaptive mode */
+	int buffer_size_max; /* adaptive mode: largest size a session buffer may grow to */
+	int buffer_mode; /* fixed or adaptive */
+	int io_backend; /* epoll or io_uring */
+	int inline_writes; /* write straight after a read in level-triggered mode */
+	int clone_lag; /* bytes a clone may fall behind the client by */
+	int keepalive_pool; /* idle member connections kept per member by each worker, 0 is off */
+	int keepalive_timeout; /* seconds an idle member connection is kept */
+	int warm_pool; /* connections made in advance per member by each worker, 0 is off */
+	int listen_fastopen; /* TCP Fast Open queue length of the listener, 0 is off */
+	int member_fastopen; /* TCP Fast Open on member connects */
+	int http_balancing; /* per connection or per request */
+	int client_timeout; /* seconds a session's client may go without traffic, 0 is no limit */
+	int member_timeout; /* seconds a session's member may go without traffic, 0 is no limit */
+	int session_lifetime; /* seconds a session may last, 0 is no limit */
+	int drain_timeout; /* seconds the old processes may take to finish their sessions after an upgrade, 0 is no limit */
+	pid_t worker_pids[MAXWORKERS];
+	WORKER_STATS worker_stats[MAXWORKERS];
+	unsigned int server_gen; /* bumped by SERVERS_CHANGED() */
+	unsigned int server_seq; /* odd while a reload is writing the servers and settings, see reload_apply() */
 } BALANCER;
 
 /* function prototypes */
 int handle_connection(int client_fd, char *buffer, size_t buffer_size);
-int create_balancer_server(int clone_server, char *serverName, int serverStatus, int standbyState, int serverPort, struct in_addr *serverIP, int serverMaxc, float servermaxl);
+int create_balancer_server(int clone_server, char *serverName, int serverStatus, int standbyState, int serverPort, struct in_addr *serverIP, int serverMaxc, float servermaxl, int serverWeight);
 SESSION* get_new_session();
-int member_read(int fd);
-int member_write(int fd);
-int client_read(int fd);
-int client_write(int fd);
-int clone_read(int fd);
-int clone_write(int fd);
+int add_unused_session(SESSION *session);
+int initialize_unused_session();
+int member_read(SESSION *session);
+int member_write(SESSION *session);
+int client_read(SESSION *session);
+int client_write(SESSION *session);
+int clone_read(SESSION *session);
+int clone_write(SESSION *session);
 int delete_session(SESSION *session);
+int accept_connections(int listenerfd, int budget);
+int accept_session(int incomingfd, struct sockaddr_in *clientaddr);
+int epoll_del(SESSION *session, int role);
+#ifdef USE_IO_URING
+int uring_init(int maxevents);
+struct io_uring_sqe *uring_get_sqe();
+int uring_submit();
+int uring_wait(int maxevents, int timeout);
+int uring_poll_add(SESSION *session, int role);
+int uring_poll_update(SESSION *session, int role);
+int uring_poll_remove(SESSION *session, int role);
+int uring_accept(int listenerfd);
+int uring_rearm();
+int uring_accept_cancel();
+int uring_exit();
+int uring_mark(SESSION *session);
+int uring_cancel(SESSION *session, int role);
+int uring_connect(SESSION *session, int role, struct sockaddr_in *addr);
+uint32_t uring_complete(uint64_t user_data, int res);
+BUFFER *uring_buffer(SESSION *session, int role, int op);
+int uring_read(SESSION *session, int role);
+int uring_write(SESSION *session, int role);
+int uring_sync();
+int uring_sync_socket(SESSION *session, int role);
+ssize_t uring_result(int *ring, int flag, int result);
+#endif
+int epoll_add(SESSION *session, int role);
+int epoll_mod(SESSION *session, int role, struct epoll_event *ev);
+struct epoll_event *interest_ev(int read_ready, int write_ready);
+int session_update_interest(SESSION *session);
+int session_fd(SESSION *session, int role);
+int session_pump(SESSION *session);
+int write_inline(SESSION *session, int role);
+int relay_open_pipes(SESSION *session);
+int buffer_reset(BUFFER *buffer);
+int buffer_acquire(BUFFER *buffer);
+int buffer_attach(BUFFER *buffer, int size);
+int buffer_full(BUFFER *buffer, int limit);
+int buffer_grow(int class);
+int buffer_adapt(BUFFER *buffer, int nbytes);
+int buffer_class(int size);
+int buffer_release(BUFFER *buffer);
+int buffer_wait(SESSION *session, int flag);
+int buffer_unwait(SESSION *session);
+int buffer_wake();
+int initialize_buffers();
+ssize_t buffer_read(BUFFER *buffer, int fd, int limit);
+ssize_t buffer_write(BUFFER *buffer, int fd);
+int buffer_space_iov(BUFFER *buffer, int limit, struct iovec *iov);
+int buffer_data_iov(BUFFER *buffer, struct iovec *iov);
+int buffer_commit(BUFFER *buffer, int nbytes);
+int buffer_consume(BUFFER *buffer, int nbytes);
+int buffer_append(BUFFER *dst, BUFFER *src, int offset, int len);
+int buffer_peek(BUFFER *buffer, char *dest, int len);
+int relay_close_pipes(SESSION *session);
+int relay_close_pipe(int *p);
+int relay_tee(SESSION *session, int len);
 int disconnect_client(SESSION *session);
 int disconnect_member(SESSION *session);
 int disconnect_clone(SESSION *session);
+int build_available_servers();
 int get_available_servers();
 int verify_server(SERVER *server);
 int choose_server(SESSION *session);
+int choose_member(SESSION *session);
+int choose_server_request(SESSION *session);
+int set_server(SESSION *session);
 int set_lc_server();
+int set_lc_list();
+int lc_key(SERVER *server);
+int lc_set(LC_INDEX *index, int slot, int key);
+int lc_refresh(LC_INDEX *index, SERVER *servers, int n);
+int lc_sync();
+int lc_update(SERVER *server);
+int server_count_add(SERVER *server, int n);
+int lc_find(LC_INDEX *index, int node, int lo, int hi, int from, int key);
+int lc_pick(LC_INDEX *index, SERVER *servers, int n, int last);
+int lc_choose();
 int set_ll_server();
 int set_rr_server();
+int wrr_set(WRR_INDEX *index, int slot, long long key);
+int wrr_refresh(WRR_INDEX *index, SERVER *servers, int *pos, int n);
+int wrr_find(WRR_INDEX *index, int node, int lo, int hi, int from, long long key);
+int wrr_pick(WRR_INDEX *index, SERVER *servers, int last);
+int set_wrr_server();
+unsigned int p2c_random();
+int p2c_less(SERVER *a, SERVER *b);
+int p2c_pick(int *list, int n, SERVER *servers);
+int set_p2c_server();
 int set_hash_server(SESSION *session);
 int set_static_server(SESSION *session);
 int connect_server(SESSION *session);
+int connect_done(SESSION *session);
+int connect_failover(SESSION *session, SERVER *failed, int timed_out, int clone);
+int connect_track(SESSION *session);
+int connect_untrack(SESSION *session);
+int connect_expire();
+int connect_wait_time();
+long long timer_clock();
+int initialize_timers();
+long long timer_deadline(SESSION *session);
+int timer_update(SESSION *session);
+int timer_schedule(SESSION *session, long long when);
+int timer_insert(SESSION *session);
+int timer_cancel(SESSION *session);
+int timer_advance(long long now);
+int timer_fire(SESSION *session);
+int timer_wait_time(long long now);
+int keepalive_take(int member);
+int keepalive_put(SESSION *session);
+int keepalive_expire(MEMBER_POOL *pool, time_t now);
+int warm_connect(int member);
+int warm_take(int member);
+int warm_refill();
+int warm_drain(int member);
+int fastopen_check(SESSION *session);
+int connect_latency(SESSION *session);
+long long timer_clock_us();
+int upgrade_init(char *prog, char *conf_file, int foreground);
+int reload_init(char *conf_file);
+int reload_request();
+int reload_config();
+int reload_stage(BALANCER *staged);
+int reload_find(SERVER *servers, int n, SERVER *server);
+int reload_room(SERVER *servers, int n);
+int reload_servers(SERVER *servers, int n, SERVER *staged, int nstaged, char *type, int *matched, int publish);
+int reload_add(SERVER *staged, int nstaged, int clone_server, char *type, int *matched, int publish);
+int reload_setting(char *name, int *live, int value, int publish);
+int reload_settings(BALANCER *staged, int publish);
+int reload_fixed(char *name, int live, int value);
+int reload_apply(BALANCER *staged);
+int upgrade_request();
+int upgrade_start();
+int upgrade_abandon(char *reason);
+int upgrade_check();
+int upgrade_handover(char reply);
+int upgrade_drain();
+int upgrade_exit();
+int upgrade_receive();
+int upgrade_collect(int *fds);
+int upgrade_listeners();
+int upgrade_adopt();
+int upgrade_commit();
+int sessions_in_use();
+int http_reset(HTTP_PARSER *parser, int response);
+int http_parse(HTTP_PARSER *parser, const char *data, int len);
+int http_parse_buffer(HTTP_PARSER *parser, BUFFER *buffer, int offset, int len);
+int http_line(HTTP_PARSER *parser);
+int http_header(HTTP_PARSER *parser, char *line, int truncated);
+int http_headers_done(HTTP_PARSER *parser);
+int http_message_done(HTTP_PARSER *parser);
+int http_reusable(SESSION *session);
+int set_effective_load(SERVER *server, int e_load);
 int calc_effective_load();
 int connect_to_shm(char *run_file, int ignore_version_check);
 int rebalance_hash();
@@ -330,13 +957,44 @@ int write_log(int options, char *description, int log_suppress);
 BALANCER *balancer;
 SESSION *sessions;
 UNUSED_SESSION_QUEUE unused_session_queue; /*added by Cheng Ren, 2012-9-27*/
-FD *fds;
+unsigned int event_gen=0; /* generation of the last event registration made by this worker */
 int epfd;
+int listeners[MAXWORKERS];
+int worker_id=0;
+int worker_session_limit=0;
+WORKER_STATS *worker_stats;
+BUFFER_POOL buffer_pool;
+MEMBER_POOL member_pools[MAXSERVERS]; /* this worker's idle keep-alive connections to each member */
+MEMBER_POOL warm_pools[MAXSERVERS]; /* this worker's connections made in advance to each member */
+int connecting_head=-1; /* this worker's sessions with a member connect in progress, oldest deadline first */
+int connecting_tail=-1;
+TIMER_WHEEL timer_wheel;
+LC_INDEX lc_members;
+LC_INDEX lc_clones;
+WRR_INDEX wrr_members;
+WRR_INDEX wrr_clones;
+unsigned int p2c_seed=1; /* the worker's random number state for the power of two choices */
+long long timer_now; /* timer_clock() as of the last event batch */
+volatile sig_atomic_t upgrade_signal=0; /* SIGUSR2 has arrived */
+volatile sig_atomic_t reload_signal=0; /* SIGHUP has arrived */
+char reload_conf_file[PATH_MAX]; /* the configuration file read again by a reload */
+int upgrade_state=UPGRADE_NONE;
+int upgrade_fd=-1; /* the UNIX socket between the old and the new binary while they hand over */
+pid_t upgrade_pid=0; /* old binary: the process it started, 0 once it has been reaped */
+long long upgrade_deadline=-1; /* when the new binary or the draining is given up on, see timer_clock() */
+int upgrade_run_file_taken=0; /* old binary: the new one has replaced its SHM file */
+UPGRADE_HELLO upgrade_hello;
+char upgrade_run_file[SHM_FILE_FULLNAME_MAX_LENGTH]; /* new binary: where its SHM file is made before it takes over */
+char *upgrade_argv[8]; /* how this binary was started, to start the new one the same way */
+#ifdef USE_IO_URING
+URING uring;
+#endif
 struct epoll_event null_ev;
 struct epoll_event ro_ev;
 struct epoll_event wr_ev;
 struct epoll_event rw_ev;
-struct epoll_event events[20000];
+struct epoll_event et_ev;
+struct epoll_event events[MAX_EPOLL_EVENTS];
 unsigned short int next_member=0;
 unsigned short int next_clone=0;
 static int sockbufsize = MESSAGE_SIZE_LIMIT;
@@ -348,13 +1006,26 @@ int debug_level_override=0;
 char *server_status[5] = {"Free", "Deleted", "Failed", "Disabled", "Enabled"};
 char *cloning_status[3] = {"Disabled", "Enabled", "Failed"};
 char *overload_status[2] = {"Relaxed", "Strict"};
-char *algorithm_status[5] = {"Round Robin", "Least Connections", "Least Load", "Hash", "Static"};
+char *epoll_mode_status[2] = {"Level-triggered", "Edge-triggered"};
+char *inline_writes_status[2] = {"Disabled", "Enabled"};
+char *member_fastopen_status[2] = {"Disabled", "Enabled"};
+char *relay_mode_status[2] = {"Copy", "Splice"};
+char *buffer_mode_status[2] = {"Fixed", "Adaptive"};
+char *io_backend_status[3] = {"epoll", "io_uring_poll", "io_uring"};
+char *http_balancing_status[2] = {"Per connection", "Per request"};
+char *algorithm_status[8] = {"Round Robin", "Least Connections", "Least Load", "Hash", "Static", "Weighted Round Robin", "Weighted Least Connections", "Power of Two Choices"};
 char *standby_status[2] = {"(S)",""};
 char log_string[OCTOPUS_LOG_LEN];
 int available_members[MAXSERVERS];
 int available_members_count=0;
 int available_clones[MAXSERVERS];
 int available_clones_count=0;
+int available_member_pos[MAXSERVERS]; /* a member's place in available_members, -1 if it isn't there */
+int available_clone_pos[MAXSERVERS];
+int available_member_standby=0; /* available_members fell back to the standbys */
+int available_clone_standby=0;
+unsigned int available_gen=0; /* server_gen the available servers were built at */
+int available_ready=0;
 int use_clone=0;
 int using_member_standby=0;
 int using_clone_standby=0;
@@ -372,6 +1043,7 @@ int set_cloned_state() {
 		}
 		if(temp == balancer->nclones) {
 			balancer->clone_mode= CLONE_MODE_FAILED;
+			SERVERS_CHANGED();
 		}
 	}
 	/* if clone mode is in the failed state then we will scan for at least one enabled clone */
@@ -379,6 +1051,7 @@ int set_cloned_state() {
 		for (i=0; i< balancer->nclones; i++) {
 			if(balancer->clones[i].status == SERVER_STATE_ENABLED) {
 				balancer->clone_mode= CLONE_MODE_ON;
+				SERVERS_CHANGED();
 				break;
 			}
 		}
@@ -394,7 +1067,7 @@ returns -1 when malloc fails
 returns -2 when tcp port is invalid
 returns -3 when IP address is invalid
 */
-int create_balancer_server(int clone_server, char *serverName, int serverStatus, int standbyState, int serverPort, struct in_addr *serverIP, int serverMaxc, float servermaxl) {
+int create_balancer_server(int clone_server, char *serverName, int serverStatus, int standbyState, int serverPort, struct in_addr *serverIP, int serverMaxc, float servermaxl, int serverWeight) {
 	int i;
 	SERVER *s;
 	s = malloc(sizeof(SERVER));
@@ -407,6 +1080,7 @@ int create_balancer_server(int clone_server, char *serverName, int serverStatus,
 	s->standby_state=standbyState;
 	s->port=serverPort;
 	s->maxc=serverMaxc;
+	s->weight=serverWeight;
 	s->load=SNMP_LOAD_NOT_INIT;
 	s->maxl=servermaxl;
 	s->bsent=0;
@@ -430,6 +1104,7 @@ int create_balancer_server(int clone_server, char *serverName, int serverStatus,
 				memcpy((void *)&balancer->members[i], (void *)s, sizeof(SERVER));
 				balancer->members[i].id=i;
 				free(s);
+				SERVERS_CHANGED();
 				return 0;
 			}
 		}
@@ -446,6 +1121,7 @@ int create_balancer_server(int clone_server, char *serverName, int serverStatus,
 				memcpy((void *)&balancer->clones[i], (void *)s, sizeof(SERVER));
 				balancer->clones[i].id=i;
 				free(s);
+				SERVERS_CHANGED();
 				return 0;
 			}
 		}
@@ -455,5 +1131,15 @@ int create_balancer_server(int clone_server, char *serverName, int serverStatus,
 		balancer->nclones++;
 	}
 	free(s);
+	SERVERS_CHANGED();
 	return 0;
 }
+
+/* returns the smallest buffer size class that holds size bytes */
+int buffer_class(int size) {
+	int class=0;
+	while((class < (BUFFER_CLASSES - 1)) && (BUFFER_CLASS_SIZE(class) < size)) {
+		class++;
+	}
+	return class;
+}
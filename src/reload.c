@@ -0,0 +1,392 @@
+/*
+ * Octopus Load Balancer - Configuration reload.
+ *
+ * Copyright 2008-2011 Alistair Reay <alreay1@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+/* SIGHUP to the master (or the admin 'reload' command) reads the configuration file again.
+ *
+ * The file is parsed by a child process into a fresh BALANCER with the default settings, the same way it is
+ * at startup, and handed back through an anonymous shared mapping. A file with errors only ends the child,
+ * the running configuration is kept. The staged members and clones are then compared with the live ones: a
+ * server is the same server if its name, IP and port are unchanged, and keeps its slot, its sessions, its
+ * counters and its hash table assignments while its maxc, maxl, weight, standby and status are updated. Servers no
+ * longer in the file are marked deleted and removed by the monitor once their last session has finished,
+ * the new ones are added. Nothing is changed unless there is room for all of them.
+ *
+ * Every change is worked out and logged first, then published in one go: the servers and settings are written
+ * between SERVERS_WRITE_BEGIN() and SERVERS_WRITE_END() with nothing else in between, and server_gen is bumped
+ * once after the last write. A worker that builds its available servers while the writes are going on uses
+ * them for one pick only, so no worker carries on with a set that mixes old and new settings. A pick made during
+ * those few stores may still see one server half written, as it could with the admin changing it.
+ *
+ * The parse runs in the master, which is also worker 0, and the master waits for it: worker 0 handles no
+ * events while the file is read, which is about as long as it takes at startup.
+ *
+ * Settings that are read as sessions are handled are applied too. The ones that sized or set up something
+ * at startup (the listener, the workers, the session table, the I/O backend, the pools) are left as they
+ * are and logged, they need a restart or an upgrade. So do log_file, shm_run_dir and snmp_community_pw.
+ */
+
+/* the daemon runs from / so the path is made absolute here */
+int reload_init(char *conf_file) {
+	if(conf_file == NULL) {
+		return -1;
+	}
+	if(realpath(conf_file, reload_conf_file) == NULL) {
+		strncpy(reload_conf_file, conf_file, PATH_MAX - 1);
+	}
+	return 0;
+}
+
+/* handles SIGHUP */
+int reload_request() {
+	reload_signal=0;
+	if(worker_id != 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: reload_request: worker %d ignored SIGHUP, reloads are started by signalling the master", worker_id);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		return -1;
+	}
+	if((upgrade_state != UPGRADE_NONE) || (balancer->alive == 0)) {
+		write_log(OCTOPUS_LOG_STD, "WARNING: reload_request: ignored SIGHUP while an upgrade is in progress", SUPPRESS_OFF);
+		return -1;
+	}
+	return reload_config();
+}
+
+int reload_config() {
+	BALANCER *staged;
+	int status;
+
+	staged=mmap(NULL, sizeof(BALANCER), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if(staged == MAP_FAILED) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: reload_config: unable to map the staging area: %s", strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		return -1;
+	}
+	snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: reload_config: reading %.*s", OCTOPUS_LOG_PATH_LEN, reload_conf_file);
+	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	status=reload_stage(staged);
+	if(status == 0) {
+		status=reload_apply(staged);
+	}
+	munmap(staged, sizeof(BALANCER));
+	return status;
+}
+
+/* parses the file in a child, where a fatal error in the parser ends only the child */
+int reload_stage(BALANCER *staged) {
+	BALANCER *live=balancer;
+	pid_t pid;
+	int status;
+
+	pid=fork();
+	if(pid < 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: reload_stage: unable to fork: %s", strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		return -1;
+	}
+	if(pid == 0) {
+		initialize_balancer();
+		balancer->foreground=live->foreground;
+		balancer->log_file=live->log_file;
+		balancer->log_file_path=live->log_file_path;
+		balancer->debug_level=live->debug_level;
+		parse_config_file(reload_conf_file);
+		memcpy(staged, balancer, sizeof(BALANCER));
+		_exit(0);
+	}
+	while(waitpid(pid, &status, 0) < 0) {
+		if(errno != EINTR) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: reload_stage: waitpid error: %s", strerror(errno));
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+			return -1;
+		}
+	}
+	if(!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: reload_stage: %.*s has errors, keeping the running configuration", OCTOPUS_LOG_PATH_LEN, reload_conf_file);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		return -1;
+	}
+	return 0;
+}
+
+/* the live server with the same name, IP and port, or -1 */
+int reload_find(SERVER *servers, int n, SERVER *server) {
+	int i;
+	for(i=0; i < n; i++) {
+		if((servers[i].status == SERVER_STATE_FREE) || (servers[i].status == SERVER_STATE_DELETED)) {
+			continue;
+		}
+		if(!strncmp(servers[i].name, server->name, SERVERNAME_MAX_LENGTH) && (servers[i].myaddr.sin_addr.s_addr == server->myaddr.sin_addr.s_addr) && (servers[i].myaddr.sin_port == server->myaddr.sin_port)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* the number of servers that can still be added to an array */
+int reload_room(SERVER *servers, int n) {
+	int room=MAXSERVERS - n;
+	int i;
+	for(i=0; i < n; i++) {
+		if(servers[i].status == SERVER_STATE_FREE) {
+			room++;
+		}
+	}
+	return room;
+}
+
+/* works out how the servers of one array change and logs it, or with publish set updates them in place and marks
+ * the ones gone from the file deleted. Both passes match the same servers
+ */
+int reload_servers(SERVER *servers, int n, SERVER *staged, int nstaged, char *type, int *matched, int publish) {
+	SERVER *s;
+	int changed=0;
+	int found;
+	int i;
+	int j;
+
+	for(i=0; i < n; i++) {
+		s=&servers[i];
+		if((s->status == SERVER_STATE_FREE) || (s->status == SERVER_STATE_DELETED)) {
+			continue;
+		}
+		found=-1;
+		for(j=0; j < nstaged; j++) {
+			if(!matched[j] && (reload_find(s, 1, &staged[j]) == 0)) {
+				found=j;
+				break;
+			}
+		}
+		if(found < 0) {
+			if(publish) {
+				s->status=SERVER_STATE_DELETED;
+			}
+			else {
+				snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: reload_servers: %s %s is no longer configured, it is removed once its %d sessions have finished", type, s->name, s->c);
+				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+			}
+			changed++;
+			continue;
+		}
+		matched[found]=1;
+		if((s->maxc != staged[found].maxc) || (s->maxl != staged[found].maxl) || (s->weight != staged[found].weight) || (s->standby_state != staged[found].standby_state)) {
+			if(publish) {
+				s->maxc=staged[found].maxc;
+				s->maxl=staged[found].maxl;
+				s->weight=staged[found].weight;
+				s->standby_state=staged[found].standby_state;
+			}
+			else {
+				snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: reload_servers: %s %s maxc %d -> %d, maxl %.2f -> %.2f, weight %d -> %d, standby %s -> %s", type, s->name, s->maxc, staged[found].maxc, s->maxl, staged[found].maxl, s->weight, staged[found].weight, (s->standby_state == STANDBY_STATE_TRUE) ? "true" : "false", (staged[found].standby_state == STANDBY_STATE_TRUE) ? "true" : "false");
+				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+			}
+			changed++;
+		}
+		/* a failed server stays failed until the monitor finds it back */
+		if(((staged[found].status == SERVER_STATE_DISABLED) && (s->status != SERVER_STATE_DISABLED)) || ((staged[found].status == SERVER_STATE_ENABLED) && (s->status == SERVER_STATE_DISABLED))) {
+			if(publish) {
+				s->status=staged[found].status;
+			}
+			else {
+				snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: reload_servers: %s %s %s -> %s", type, s->name, server_status[s->status], server_status[staged[found].status]);
+				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+			}
+			changed++;
+		}
+	}
+	return changed;
+}
+
+/* logs the staged servers that no live server matched, or with publish set adds them */
+int reload_add(SERVER *staged, int nstaged, int clone_server, char *type, int *matched, int publish) {
+	int added=0;
+	int j;
+
+	for(j=0; j < nstaged; j++) {
+		if(matched[j]) {
+			continue;
+		}
+		if(publish) {
+			create_balancer_server(clone_server, staged[j].name, staged[j].status, staged[j].standby_state, ntohs(staged[j].myaddr.sin_port), &staged[j].myaddr.sin_addr, staged[j].maxc, staged[j].maxl, staged[j].weight);
+		}
+		else {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: reload_add: adding %s %s %s:%d", type, staged[j].name, inet_ntoa(staged[j].myaddr.sin_addr), ntohs(staged[j].myaddr.sin_port));
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		}
+		added++;
+	}
+	return added;
+}
+
+/* logs, or with publish set applies, a setting that is read as sessions are handled */
+int reload_setting(char *name, int *live, int value, int publish) {
+	if(*live == value) {
+		return 0;
+	}
+	if(publish) {
+		*live=value;
+	}
+	else {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: reload_setting: %s %d -> %d", name, *live, value);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	return 1;
+}
+
+/* logs a setting that only takes effect at startup */
+int reload_fixed(char *name, int live, int value) {
+	if(live == value) {
+		return 0;
+	}
+	snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: reload_fixed: %s stays %d, changing it to %d needs a restart or an upgrade", name, live, value);
+	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	return 1;
+}
+
+/* the settings read as sessions are handled, logged or with publish set applied. Returns the number changed */
+int reload_settings(BALANCER *staged, int publish) {
+	int changed=0;
+	int monitor_interval;
+
+	if(balancer->algorithm != staged->algorithm) {
+		if(publish) {
+			balancer->algorithm=staged->algorithm;
+		}
+		else {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: reload_setting: algorithm %s -> %s", algorithm_status[balancer->algorithm - 1], algorithm_status[staged->algorithm - 1]);
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		}
+		changed++;
+	}
+	changed += reload_setting("overload_mode", &balancer->overload_mode, staged->overload_mode, publish);
+	changed += reload_setting("connect_timeout", &balancer->connect_timeout, staged->connect_timeout, publish);
+	changed += reload_setting("hash_rebalance_threshold", &balancer->hash_rebalance_threshold, staged->hash_rebalance_threshold, publish);
+	changed += reload_setting("hash_rebalance_size", &balancer->hash_rebalance_size, staged->hash_rebalance_size, publish);
+	changed += reload_setting("hash_rebalance_interval", &balancer->hash_rebalance_interval, staged->hash_rebalance_interval, publish);
+	changed += reload_setting("default_maxc", &balancer->default_maxc, staged->default_maxc, publish);
+	changed += reload_setting("snmp_status", &balancer->snmp_status, staged->snmp_status, publish);
+	changed += reload_setting("use_syslog", &balancer->use_syslog, staged->use_syslog, publish);
+	changed += reload_setting("accept_budget", &balancer->accept_budget, staged->accept_budget, publish);
+	changed += reload_setting("buffer_size_max", &balancer->buffer_size_max, staged->buffer_size_max, publish);
+	changed += reload_setting("buffer_size", &balancer->buffer_size, staged->buffer_size, publish);
+	changed += reload_setting("buffer_mode", &balancer->buffer_mode, staged->buffer_mode, publish);
+	changed += reload_setting("inline_writes", &balancer->inline_writes, staged->inline_writes, publish);
+	changed += reload_setting("clone_lag", &balancer->clone_lag, staged->clone_lag, publish);
+	changed += reload_setting("keepalive_timeout", &balancer->keepalive_timeout, staged->keepalive_timeout, publish);
+	changed += reload_setting("member_fastopen", &balancer->member_fastopen, staged->member_fastopen, publish);
+	changed += reload_setting("client_timeout", &balancer->client_timeout, staged->client_timeout, publish);
+	changed += reload_setting("member_timeout", &balancer->member_timeout, staged->member_timeout, publish);
+	changed += reload_setting("session_lifetime", &balancer->session_lifetime, staged->session_lifetime, publish);
+	changed += reload_setting("drain_timeout", &balancer->drain_timeout, staged->drain_timeout, publish);
+	monitor_interval=balancer->monitor_interval;
+	if(reload_setting("monitor_interval", &monitor_interval, staged->monitor_interval, publish)) {
+		balancer->monitor_interval=monitor_interval;
+		changed++;
+	}
+	if(balancer->session_weight != staged->session_weight) {
+		if(publish) {
+			balancer->session_weight=staged->session_weight;
+		}
+		else {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: reload_setting: session_weight %.2f -> %.2f", balancer->session_weight, staged->session_weight);
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		}
+		changed++;
+	}
+	/* a failed clone mode is still on as far as the file is concerned */
+	if((staged->clone_mode == CLONE_MODE_OFF) != (balancer->clone_mode == CLONE_MODE_OFF)) {
+		if(publish) {
+			balancer->clone_mode=staged->clone_mode;
+		}
+		else {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: reload_setting: clone_mode %s -> %s", cloning_status[balancer->clone_mode], cloning_status[staged->clone_mode]);
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		}
+		changed++;
+	}
+	if(publish) {
+		balancer->default_maxl=staged->default_maxl;
+		balancer->use_member_outbound_ip=staged->use_member_outbound_ip;
+		balancer->member_outbound_ip=staged->member_outbound_ip;
+		balancer->use_clone_outbound_ip=staged->use_clone_outbound_ip;
+		balancer->clone_outbound_ip=staged->clone_outbound_ip;
+	}
+	return changed;
+}
+
+int reload_apply(BALANCER *staged) {
+	int member_matched[MAXSERVERS];
+	int clone_matched[MAXSERVERS];
+	int members_new=0;
+	int clones_new=0;
+	int changed=0;
+	int j;
+
+	for(j=0; j < staged->nmembers; j++) {
+		if(reload_find(balancer->members, balancer->nmembers, &staged->members[j]) < 0) {
+			members_new++;
+		}
+	}
+	for(j=0; j < staged->nclones; j++) {
+		if(reload_find(balancer->clones, balancer->nclones, &staged->clones[j]) < 0) {
+			clones_new++;
+		}
+	}
+	if((members_new > reload_room(balancer->members, balancer->nmembers)) || (clones_new > reload_room(balancer->clones, balancer->nclones))) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: reload_apply: no room for %d new members and %d new clones while the removed ones are finishing, keeping the running configuration", members_new, clones_new);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		return -1;
+	}
+
+	/* everything that is going to change is logged before anything is written */
+	memset(member_matched, '\0', sizeof(member_matched));
+	memset(clone_matched, '\0', sizeof(clone_matched));
+	changed += reload_servers(balancer->members, balancer->nmembers, staged->members, staged->nmembers, "member", member_matched, 0);
+	changed += reload_servers(balancer->clones, balancer->nclones, staged->clones, staged->nclones, "clone", clone_matched, 0);
+	changed += reload_add(staged->members, staged->nmembers, SERVER_CLONE_FALSE, "member", member_matched, 0);
+	changed += reload_add(staged->clones, staged->nclones, SERVER_CLONE_TRUE, "clone", clone_matched, 0);
+	changed += reload_settings(staged, 0);
+
+	/* then published in one go */
+	memset(member_matched, '\0', sizeof(member_matched));
+	memset(clone_matched, '\0', sizeof(clone_matched));
+	SERVERS_WRITE_BEGIN();
+	reload_servers(balancer->members, balancer->nmembers, staged->members, staged->nmembers, "member", member_matched, 1);
+	reload_servers(balancer->clones, balancer->nclones, staged->clones, staged->nclones, "clone", clone_matched, 1);
+	reload_add(staged->members, staged->nmembers, SERVER_CLONE_FALSE, "member", member_matched, 1);
+	reload_add(staged->clones, staged->nclones, SERVER_CLONE_TRUE, "clone", clone_matched, 1);
+	reload_settings(staged, 1);
+	set_cloned_state();
+	/* the workers rebuild their sets of available servers from what has been applied */
+	SERVERS_CHANGED();
+	SERVERS_WRITE_END();
+
+	reload_fixed("binding_port", balancer->binding_port, staged->binding_port);
+	if(balancer->binding_ip.s_addr != staged->binding_ip.s_addr) {
+		write_log(OCTOPUS_LOG_STD, "WARNING: reload_fixed: binding_ip is unchanged, changing it needs a restart or an upgrade", SUPPRESS_OFF);
+	}
+	reload_fixed("workers", balancer->workers, staged->workers);
+	reload_fixed("session_limit", balancer->session_limit, staged->session_limit);
+	reload_fixed("shm_perms", balancer->shm_perms, staged->shm_perms);
+	reload_fixed("io_backend", balancer->io_backend, staged->io_backend);
+	reload_fixed("epoll_mode", balancer->epoll_mode, staged->epoll_mode);
+	reload_fixed("relay_mode", balancer->relay_mode, staged->relay_mode);
+	reload_fixed("http_balancing", balancer->http_balancing, staged->http_balancing);
+	reload_fixed("buffer_memory", balancer->buffer_memory, staged->buffer_memory);
+	reload_fixed("keepalive_pool", balancer->keepalive_pool, staged->keepalive_pool);
+	reload_fixed("warm_pool", balancer->warm_pool, staged->warm_pool);
+	reload_fixed("listen_fastopen", balancer->listen_fastopen, staged->listen_fastopen);
+	reload_fixed("defer_accept", balancer->defer_accept, staged->defer_accept);
+
+	snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: reload_apply: configuration reloaded, %d changes, %d members and %d clones", changed, staged->nmembers, staged->nclones);
+	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	return 0;
+}
@@ -12,6 +12,14 @@
 
 static void signal_handler(int signum) {
 	switch(signum) {
+		/* the event loop starts or joins an upgrade, see upgrade.c */
+		case SIGUSR2:
+			upgrade_signal=1;
+			break;
+		/* the master reads the configuration file again, see reload.c */
+		case SIGHUP:
+			reload_signal=1;
+			break;
 		case SIGTERM:
 			clean_exit();
 		case SIGINT:
@@ -24,15 +32,43 @@ static void signal_handler(int signum) {
 
 int clean_exit() {
 	int status;
+	int i;
 	pid_t p;
 
+#ifdef USE_IO_URING
+	/* every event-loop process lets go of its listener before it exits */
+	if(balancer->io_backend != IO_BACKEND_EPOLL) {
+		uring_exit();
+	}
+#endif
 	/* the master process will wait for the monitor to quit */
 	if(getpid() == balancer->master_pid) {
 		write_log(OCTOPUS_LOG_STD | OCTOPUS_LOG_SYSLOG, "NOTICE: signal_handler: master: received signal SIGTERM. Shutting down...", SUPPRESS_OFF);
 		balancer->alive=0;
+		/* a new binary that hasn't answered yet gives up when it finds the socket closed */
+		if(upgrade_state == UPGRADE_STARTED) {
+			close(upgrade_fd);
+		}
+
+		/* tell the other event-loop workers to shutdown */
+		for(i=1; i < balancer->workers; i++) {
+			if(balancer->worker_pids[i] > 0) {
+				kill(balancer->worker_pids[i], SIGTERM);
+			}
+		}
+		/* once the listener has been handed over the new binary owns the SHM file, and in the
+		 * foreground its master is one of our children, so we don't wait for it */
+		if(upgrade_state == UPGRADE_DRAINING) {
+			upgrade_exit();
+		}
 
-		/* wait for monitoring process to quit first */
-		p = waitpid(-1, &status, 0);
+		/* wait for monitoring process and workers to quit first */
+		while((p = waitpid(-1, &status, 0)) > 0) {
+			if(balancer->debug_level > 0) {
+				snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: signal_handler: master: child process %d exited", p);
+				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+			}
+		}
 		if((p == -1) && (errno != ECHILD)) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: signal_handler: master: waitpid error: %s", strerror(errno));
 				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
@@ -43,7 +79,7 @@ int clean_exit() {
 
 		/* remove the SHM file */
 		if(balancer->shmid != -1) {
-			status= unlink(balancer->shm_run_file);
+			status= unlink((upgrade_state == UPGRADE_TAKEOVER) ? upgrade_run_file : balancer->shm_run_file);
 			if(status != 0) {
 				snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: signal_handler: master: Unable to remove SHM file!!: %s", strerror(errno));
 				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
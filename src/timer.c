@@ -0,0 +1,257 @@
+/*
+ * Octopus Load Balancer - Session timeouts.
+ *
+ * Copyright 2008-2011 Alistair Reay <alreay1@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+/* A session can be ended when its client or its member has gone without traffic for client_timeout or
+ * member_timeout seconds, or when it has lasted for session_lifetime seconds. Otherwise a client that
+ * connects and goes quiet keeps its session, buffers and member connection for good.
+ *
+ * Traffic only stamps the session with the time of the current event batch. Each session has one timer,
+ * due no later than the first of its deadlines, on a per-worker hierarchical timer wheel. When the timer
+ * is due the deadlines are worked out again from the stamps, and the session is either ended with
+ * delete_session() or its timer is put back for the new first deadline. Adding, moving and removing a
+ * timer are O(1), so busy sessions cost nothing more than the stamps.
+ *
+ * The wheel has TIMER_LEVELS levels of TIMER_SLOTS slots. A timer due within TIMER_SLOTS ticks goes in
+ * the first level, one due later in the level whose slots are long enough. Each time the first level
+ * comes round, the timers in the next slot of the level above are spread over the levels below.
+ * The event loop waits no longer than the next tick that has timers due.
+ */
+
+/* returns a millisecond clock for the session timeouts and connect deadlines */
+long long timer_clock() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((long long)now.tv_sec * 1000) + (now.tv_nsec / 1000000);
+}
+
+/* returns the same clock in microseconds, for timing the accept to member connect path */
+long long timer_clock_us() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((long long)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+}
+
+/* sets up the worker's timer wheel */
+int initialize_timers() {
+	int i;
+
+	for(i=0; i < (TIMER_LEVELS * TIMER_SLOTS); i++) {
+		timer_wheel.slots[i]=-1;
+	}
+	timer_wheel.count=0;
+	timer_now=timer_clock();
+	timer_wheel.tick=timer_now / TIMER_TICK_MS;
+	return 0;
+}
+
+/* returns when the first of the session's timeouts is due, or -1 if none of them applies to it */
+long long timer_deadline(SESSION *session) {
+	long long deadline=-1;
+	long long when;
+
+	if(balancer->session_lifetime > 0) {
+		deadline=session->started + ((long long)balancer->session_lifetime * 1000);
+	}
+	if((balancer->client_timeout > 0) && (session->state & STATE_CLI_CONNECTED)) {
+		when=session->client_active + ((long long)balancer->client_timeout * 1000);
+		if((deadline < 0) || (when < deadline)) {
+			deadline=when;
+		}
+	}
+	/* a connect in progress has its own deadline, see connect.c */
+	if((balancer->member_timeout > 0) && (session->state & STATE_MEM_CONNECTED) && !(session->state & STATE_MEM_CONNECTING)) {
+		when=session->member_active + ((long long)balancer->member_timeout * 1000);
+		if((deadline < 0) || (when < deadline)) {
+			deadline=when;
+		}
+	}
+	return deadline;
+}
+
+/* makes sure the session's timer isn't due after its first deadline. Traffic only ever moves the deadlines
+ * later, this is needed when a new one starts, like a member being connected
+ */
+int timer_update(SESSION *session) {
+	long long deadline=timer_deadline(session);
+
+	if(deadline < 0) {
+		return 0;
+	}
+	if((session->timer_slot < 0) || ((deadline / TIMER_TICK_MS) < session->timer_tick)) {
+		timer_schedule(session, deadline);
+	}
+	return 0;
+}
+
+/* puts the session's timer on the wheel for the given time, moving it if it's already there */
+int timer_schedule(SESSION *session, long long when) {
+	long long tick=when / TIMER_TICK_MS;
+
+	timer_cancel(session);
+	/* the current tick has been handled already */
+	if(tick <= timer_wheel.tick) {
+		tick=timer_wheel.tick + 1;
+	}
+	session->timer_tick=tick;
+	return timer_insert(session);
+}
+
+/* links the session into the wheel slot for its timer_tick */
+int timer_insert(SESSION *session) {
+	long long delta=session->timer_tick - timer_wheel.tick;
+	int level=0;
+	int slot;
+
+	/* timers further off than the wheel reaches are put at its far end, they are put back when they come up */
+	if(delta >= (1LL << (TIMER_BITS * TIMER_LEVELS))) {
+		session->timer_tick=timer_wheel.tick + (1LL << (TIMER_BITS * TIMER_LEVELS)) - 1;
+		delta=session->timer_tick - timer_wheel.tick;
+	}
+	while((level < (TIMER_LEVELS - 1)) && (delta >= (1LL << (TIMER_BITS * (level + 1))))) {
+		level++;
+	}
+	slot=(level * TIMER_SLOTS) + (int)((session->timer_tick >> (TIMER_BITS * level)) & TIMER_MASK);
+	session->timer_slot=slot;
+	session->timer_prev=-1;
+	session->timer_next=timer_wheel.slots[slot];
+	if(session->timer_next >= 0) {
+		sessions[session->timer_next].timer_prev=session->id;
+	}
+	timer_wheel.slots[slot]=session->id;
+	timer_wheel.count++;
+	return 0;
+}
+
+/* takes the session's timer off the wheel, if it's on it */
+int timer_cancel(SESSION *session) {
+	if(session->timer_slot < 0) {
+		return 0;
+	}
+	if(session->timer_prev >= 0) {
+		sessions[session->timer_prev].timer_next=session->timer_next;
+	}
+	else {
+		timer_wheel.slots[session->timer_slot]=session->timer_next;
+	}
+	if(session->timer_next >= 0) {
+		sessions[session->timer_next].timer_prev=session->timer_prev;
+	}
+	session->timer_slot=-1;
+	session->timer_prev=-1;
+	session->timer_next=-1;
+	timer_wheel.count--;
+	return 0;
+}
+
+/* handles the ticks up to the given time, firing the timers that are due.
+ * returns the number of timers fired
+ */
+int timer_advance(long long now) {
+	long long target=now / TIMER_TICK_MS;
+	SESSION *session;
+	int fired=0;
+	int level;
+	int slot;
+
+	while(timer_wheel.tick < target) {
+		/* nothing to do for the ticks of an empty wheel */
+		if(timer_wheel.count == 0) {
+			timer_wheel.tick=target;
+			break;
+		}
+		timer_wheel.tick++;
+		/* each time a level comes round the next slot of the level above is spread over the levels below */
+		for(level=1; level < TIMER_LEVELS; level++) {
+			if(timer_wheel.tick & ((1LL << (TIMER_BITS * level)) - 1)) {
+				break;
+			}
+			slot=(level * TIMER_SLOTS) + (int)((timer_wheel.tick >> (TIMER_BITS * level)) & TIMER_MASK);
+			while(timer_wheel.slots[slot] >= 0) {
+				session=&sessions[timer_wheel.slots[slot]];
+				timer_cancel(session);
+				timer_insert(session);
+			}
+		}
+		slot=(int)(timer_wheel.tick & TIMER_MASK);
+		while(timer_wheel.slots[slot] >= 0) {
+			session=&sessions[timer_wheel.slots[slot]];
+			timer_cancel(session);
+			timer_fire(session);
+			fired++;
+		}
+	}
+	return fired;
+}
+
+/* a session's timer is due. The session is ended if one of its timeouts has been reached, otherwise its
+ * timer is put back for the first deadline it has now
+ */
+int timer_fire(SESSION *session) {
+	long long deadline=timer_deadline(session);
+	const char *what;
+	int seconds;
+
+	if(deadline < 0) {
+		return 0;
+	}
+	if(deadline > timer_now) {
+		return timer_schedule(session, deadline);
+	}
+	/* the same checks as timer_deadline(), to tell which timeout it was */
+	if((balancer->session_lifetime > 0) && ((session->started + ((long long)balancer->session_lifetime * 1000)) <= timer_now)) {
+		worker_stats->lifetime_timeouts++;
+		what="the session has lasted";
+		seconds=balancer->session_lifetime;
+	}
+	else if((balancer->client_timeout > 0) && (session->state & STATE_CLI_CONNECTED) && ((session->client_active + ((long long)balancer->client_timeout * 1000)) <= timer_now)) {
+		worker_stats->client_timeouts++;
+		what="its client has been idle";
+		seconds=balancer->client_timeout;
+	}
+	else {
+		worker_stats->member_timeouts++;
+		what="its member has been idle";
+		seconds=balancer->member_timeout;
+	}
+	if(balancer->debug_level > 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: timer_fire: ending session with clientfd %d as %s for %d seconds", session->clientfd, what, seconds);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+	}
+	/* an idle HTTP member connection that is between messages still goes back to the keep-alive pool */
+	delete_session(session);
+	return 0;
+}
+
+/* returns the milliseconds until the next tick with timers due, for the event loop to wait no longer than
+ * that, or -1 if the wheel is empty. Timers in the higher levels are only looked at when they come down
+ */
+int timer_wait_time(long long now) {
+	long long tick;
+	long long wait;
+
+	if(timer_wheel.count == 0) {
+		return -1;
+	}
+	for(tick=timer_wheel.tick + 1; tick <= (timer_wheel.tick + TIMER_SLOTS); tick++) {
+		/* the first level coming round brings timers down from the level above */
+		if(((tick & TIMER_MASK) == 0) || (timer_wheel.slots[tick & TIMER_MASK] >= 0)) {
+			break;
+		}
+	}
+	wait=(tick * TIMER_TICK_MS) - now;
+	if(wait < 0) {
+		return 0;
+	}
+	return (int)wait;
+}
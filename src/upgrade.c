@@ -0,0 +1,523 @@
+/*
+ * Octopus Load Balancer - Binary upgrade.
+ *
+ * Copyright 2008-2011 Alistair Reay <alreay1@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+/* A new server binary can take over from a running one without the listening port ever being closed.
+ *
+ * SIGUSR2 to the master (or the admin 'upgrade' command) makes it execute the binary it was started from
+ * again, with the same arguments, and hand it one end of a UNIX socket. Over the socket the new process
+ * is sent an UPGRADE_HELLO naming the running instance's SHM segment, then every worker's listener with
+ * SCM_RIGHTS. The master has its own and takes copies of the other workers' with pidfd_getfd(). The new
+ * process copies the balancer state (the members and clones with their counters and settings, the hash
+ * table, the admin settings and the worker statistics) into a SHM segment of its own, made under a
+ * temporary file name, and starts its monitor and workers on the inherited listeners. The state
+ * is adopted from any release with the same UPGRADE_LAYOUT; across a layout change the new binary starts
+ * from its configuration file with an empty hash table, but still on the same listener. Once it
+ * is running it answers over the socket and moves its SHM file over the old one, so the admin finds it.
+ *
+ * The old master then marks its segment dead, stops its monitor and tells its workers to drain. Every old
+ * worker stops accepting, takes every connection still queued on its listener, closes its copy of the
+ * listener and exits once its last session has finished, or after drain_timeout seconds. Sessions aren't
+ * moved to the new binary, their buffered data and state stay with the process that has them.
+ *
+ * A listener that the new binary has carries on taking connections for it. One it doesn't have, because
+ * the new binary runs fewer workers or a copy couldn't be taken (pidfd_getfd() needs Linux 5.6 and
+ * ptrace access to the worker), is closed by its old worker once it has been emptied. The kernel spreads
+ * new connections over every listener on the port, so one that arrives on it after it was last emptied
+ * and before it is closed is reset, unless net.ipv4.tcp_migrate_req is set to move it to another
+ * listener. The new binary's own listeners are bound before the old workers drain.
+ *
+ * If the new binary fails to start, or doesn't answer within UPGRADE_START_TIMEOUT, the old one carries on.
+ */
+
+/* remembers how the server was started. The daemon runs from / so the paths are made absolute here */
+int upgrade_init(char *prog, char *conf_file, int foreground) {
+	static char path[PATH_MAX];
+	static char conf[PATH_MAX];
+	static char level[16];
+	int n=0;
+
+	/* a bare name was found on the PATH and will be again */
+	if((strchr(prog, '/') == NULL) || (realpath(prog, path) == NULL)) {
+		strncpy(path, prog, PATH_MAX - 1);
+	}
+	upgrade_argv[n++]=path;
+	if(conf_file != NULL) {
+		if(realpath(conf_file, conf) == NULL) {
+			strncpy(conf, conf_file, PATH_MAX - 1);
+		}
+		upgrade_argv[n++]="-c";
+		upgrade_argv[n++]=conf;
+	}
+	if(foreground == FOREGROUND_ON) {
+		upgrade_argv[n++]="-f";
+	}
+	if(debug_level_override == 1) {
+		snprintf(level, sizeof(level), "%d", temporary_debug_level);
+		upgrade_argv[n++]="-d";
+		upgrade_argv[n++]=level;
+	}
+	upgrade_argv[n]=NULL;
+	return 0;
+}
+
+/* handles SIGUSR2. The master starts an upgrade, a worker of the old binary is told by it to drain */
+int upgrade_request() {
+	upgrade_signal=0;
+	if(upgrade_state == UPGRADE_NONE) {
+		if((worker_id == 0) && (balancer->alive == 1)) {
+			return upgrade_start();
+		}
+		if((worker_id > 0) && (balancer->alive == 0)) {
+			return upgrade_drain();
+		}
+	}
+	snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: upgrade_request: worker %d ignored SIGUSR2, upgrades are started by signalling the master", worker_id);
+	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	return -1;
+}
+
+/* starts the new binary and sends it the SHM segment and the listener. The master carries on as normal
+ * until the new binary answers, see upgrade_check()
+ */
+int upgrade_start() {
+	int pair[2];
+	int fds[MAXWORKERS];
+	int nfds;
+	int devnull;
+	int i;
+	pid_t pid;
+	char byte=0;
+	char fd[16];
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(int) * MAXWORKERS)];
+
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: upgrade_start: unable to create the upgrade socket: %s", strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		return -1;
+	}
+	if((pid = fork()) < 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: upgrade_start: unable to fork the new binary: %s", strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		close(pair[0]);
+		close(pair[1]);
+		return -1;
+	}
+	if(pid == 0) {
+		/* the new binary gets its end of the socket as UPGRADE_FD and none of our other fds */
+		if(pair[1] != UPGRADE_FD) {
+			dup2(pair[1], UPGRADE_FD);
+		}
+		/* a daemon has closed its terminal streams and their numbers may be sockets by now */
+		if(balancer->foreground == FOREGROUND_OFF) {
+			devnull=open("/dev/null", O_RDWR);
+			dup2(devnull, STDIN_FILENO);
+			dup2(devnull, STDOUT_FILENO);
+			dup2(devnull, STDERR_FILENO);
+		}
+		close_range(UPGRADE_FD + 1, ~0U, 0);
+		snprintf(fd, sizeof(fd), "%d", UPGRADE_FD);
+		setenv(UPGRADE_ENV, fd, 1);
+		execvp(upgrade_argv[0], upgrade_argv);
+		/* the log file has been closed, the master reports the failure when the socket closes */
+		_exit(1);
+	}
+	close(pair[1]);
+	upgrade_fd=pair[0];
+	upgrade_pid=pid;
+	upgrade_state=UPGRADE_STARTED;
+	upgrade_deadline=timer_clock() + UPGRADE_START_TIMEOUT;
+
+	memset(&upgrade_hello, '\0', sizeof(upgrade_hello));
+	upgrade_hello.magic=UPGRADE_MAGIC;
+	upgrade_hello.layout=UPGRADE_LAYOUT;
+	upgrade_hello.master_pid=getpid();
+	upgrade_hello.shmid=balancer->shmid;
+	upgrade_hello.balancer_size=sizeof(BALANCER);
+	strncpy(upgrade_hello.version, balancer->version, OCTOPUS_VERSION_LEN);
+	memcpy(upgrade_hello.run_file, balancer->shm_run_file_fullname, SHM_FILE_FULLNAME_MAX_LENGTH);
+	if(send(upgrade_fd, &upgrade_hello, sizeof(upgrade_hello), MSG_NOSIGNAL) != sizeof(upgrade_hello)) {
+		return upgrade_abandon("unable to send the SHM segment to the new binary");
+	}
+	/* the listeners go with a byte of their own, the new binary picks them up once it has forked its monitor */
+	nfds=upgrade_collect(fds);
+	memset(&msg, '\0', sizeof(msg));
+	memset(control, '\0', sizeof(control));
+	iov.iov_base=&byte;
+	iov.iov_len=1;
+	msg.msg_iov=&iov;
+	msg.msg_iovlen=1;
+	msg.msg_control=control;
+	msg.msg_controllen=CMSG_SPACE(sizeof(int) * nfds);
+	cmsg=CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level=SOL_SOCKET;
+	cmsg->cmsg_type=SCM_RIGHTS;
+	cmsg->cmsg_len=CMSG_LEN(sizeof(int) * nfds);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * nfds);
+	i=sendmsg(upgrade_fd, &msg, MSG_NOSIGNAL);
+	/* the copies of the other workers' listeners are in the message, ours is still needed */
+	while(--nfds > 0) {
+		close(fds[nfds]);
+	}
+	if(i != 1) {
+		return upgrade_abandon("unable to send the listeners to the new binary");
+	}
+	fcntl(upgrade_fd, F_SETFL, O_NONBLOCK);
+	snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: upgrade_start: started %s with pid %d to take over from this binary", upgrade_argv[0], pid);
+	write_log(OCTOPUS_LOG_STD | OCTOPUS_LOG_SYSLOG, log_string, SUPPRESS_OFF);
+	return 0;
+}
+
+/* fills fds with the listeners to hand to the new binary, in worker order, and returns how many there are.
+ * The master's is its own, the other workers' are copies taken from them. The copies stop at the first that
+ * can't be taken, as the new binary gives listeners to its workers by their position
+ */
+int upgrade_collect(int *fds) {
+	int pidfd;
+	int n;
+
+	fds[0]=listeners[0];
+	for(n=1; n < balancer->workers; n++) {
+		pidfd=(int)syscall(SYS_pidfd_open, balancer->worker_pids[n], 0);
+		if(pidfd < 0) {
+			break;
+		}
+		fds[n]=(int)syscall(SYS_pidfd_getfd, pidfd, listeners[n], 0);
+		close(pidfd);
+		if(fds[n] < 0) {
+			break;
+		}
+	}
+	if(n < balancer->workers) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: upgrade_collect: unable to take worker %d's listener for the new binary, %d of %d are handed over: %s", n, n, balancer->workers, strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	return n;
+}
+
+/* gives up on the new binary, this one carries on. Closing the socket makes the new binary give up too */
+int upgrade_abandon(char *reason) {
+	int status;
+
+	snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: upgrade abandoned, %s. Carrying on with this binary", reason);
+	write_log(OCTOPUS_LOG_STD | OCTOPUS_LOG_SYSLOG, log_string, SUPPRESS_OFF);
+	close(upgrade_fd);
+	upgrade_fd=-1;
+	if(upgrade_pid > 0) {
+		/* a daemon's first process will have exited already, in the foreground it is the new master */
+		if(waitpid(upgrade_pid, &status, WNOHANG) == 0) {
+			kill(upgrade_pid, SIGTERM);
+			waitpid(upgrade_pid, &status, 0);
+		}
+		upgrade_pid=0;
+	}
+	upgrade_state=UPGRADE_NONE;
+	upgrade_deadline=-1;
+	return -1;
+}
+
+/* called from the event loop while an upgrade is in progress. The master waits for the new binary to
+ * answer, a draining process exits once it has no sessions left
+ */
+int upgrade_check() {
+	int status;
+	int busy;
+	ssize_t n;
+	char reply;
+
+	if(upgrade_state == UPGRADE_STARTED) {
+		if((upgrade_pid > 0) && (waitpid(upgrade_pid, &status, WNOHANG) == upgrade_pid)) {
+			upgrade_pid=0;
+		}
+		n=recv(upgrade_fd, &reply, 1, 0);
+		if((n == 1) && ((reply == UPGRADE_READY) || (reply == UPGRADE_READY_RUN_FILE))) {
+			return upgrade_handover(reply);
+		}
+		if((n == 0) || ((n < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+			return upgrade_abandon("the new binary exited before it was running");
+		}
+		if(n == 1) {
+			return upgrade_abandon("the new binary gave an unexpected answer");
+		}
+		if(timer_clock() >= upgrade_deadline) {
+			return upgrade_abandon("the new binary didn't get going in time");
+		}
+	}
+	else if(upgrade_state == UPGRADE_DRAINING) {
+		busy=sessions_in_use();
+		if(busy == 0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: upgrade_check: worker %d of the old binary has finished its sessions, exiting", worker_id);
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+			upgrade_exit();
+		}
+		if((upgrade_deadline >= 0) && (timer_clock() >= upgrade_deadline)) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: upgrade_check: worker %d of the old binary is ending %d sessions after drain_timeout, exiting", worker_id, busy);
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+			upgrade_exit();
+		}
+	}
+	return 0;
+}
+
+/* the new binary is running. The old segment is marked dead and goes once the old processes have
+ * detached from it, the old monitor is stopped and the old workers are told to drain
+ */
+int upgrade_handover(char reply) {
+	int i;
+
+	upgrade_run_file_taken=(reply == UPGRADE_READY_RUN_FILE);
+	close(upgrade_fd);
+	upgrade_fd=-1;
+	balancer->alive=0;
+	if(shmctl(balancer->shmid, IPC_RMID, NULL) != 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: upgrade_handover: unable to mark the old SHM segment for deletion: %s", strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	if(balancer->monitor_pid > 0) {
+		kill(balancer->monitor_pid, SIGTERM);
+	}
+	for(i=1; i < balancer->workers; i++) {
+		if(balancer->worker_pids[i] > 0) {
+			kill(balancer->worker_pids[i], SIGUSR2);
+		}
+	}
+	snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: upgrade_handover: the new binary has taken over, the old one is finishing its sessions");
+	write_log(OCTOPUS_LOG_STD | OCTOPUS_LOG_SYSLOG, log_string, SUPPRESS_OFF);
+	return upgrade_drain();
+}
+
+/* stops this worker accepting. The listener stays open if the new binary has it, if not it is closed for good,
+ * so every connection already queued on it is taken first, however many that is
+ */
+int upgrade_drain() {
+	int listenerfd=listeners[worker_id];
+
+	upgrade_state=UPGRADE_DRAINING;
+	upgrade_deadline=-1;
+	if(balancer->drain_timeout > 0) {
+		upgrade_deadline=timer_clock() + (long long)balancer->drain_timeout * 1000;
+	}
+	if(listenerfd >= 0) {
+#ifdef USE_IO_URING
+		/* the cancel is waited for, until it is made the ring keeps the listener open after close() */
+		if(balancer->io_backend != IO_BACKEND_EPOLL) {
+			uring_exit();
+		}
+		else
+#endif
+		{
+			epoll_ctl(epfd, EPOLL_CTL_DEL, listenerfd, NULL);
+		}
+		accept_connections(listenerfd, 0);
+		close(listenerfd);
+		listeners[worker_id]=-1;
+	}
+	if(balancer->debug_level > 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "NOTICE: upgrade_drain: worker %d has stopped accepting and has %d sessions to finish", worker_id, sessions_in_use());
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	return 0;
+}
+
+/* a process of the old binary exits. Its SHM segment has been marked for deletion already, the file
+ * is left alone if the new binary has put its own in its place
+ */
+int upgrade_exit() {
+	if((worker_id == 0) && (upgrade_run_file_taken == 0)) {
+		unlink(balancer->shm_run_file);
+	}
+	exit(0);
+}
+
+/* the number of this worker's sessions that are in use */
+int sessions_in_use() {
+	int unused;
+
+	unused=(unused_session_queue.rear - unused_session_queue.head + worker_session_limit + 1) % (worker_session_limit + 1);
+	return worker_session_limit - unused;
+}
+
+/* called at startup. A binary started by upgrade_start() finds the socket to the running instance in the
+ * environment and reads which SHM segment it is to take the state from
+ */
+int upgrade_receive() {
+	char *fd;
+
+	fd=getenv(UPGRADE_ENV);
+	if(fd == NULL) {
+		return 0;
+	}
+	upgrade_fd=atoi(fd);
+	unsetenv(UPGRADE_ENV);
+	fcntl(upgrade_fd, F_SETFD, FD_CLOEXEC);
+	if((recv(upgrade_fd, &upgrade_hello, sizeof(upgrade_hello), MSG_WAITALL) != sizeof(upgrade_hello)) || (upgrade_hello.magic != UPGRADE_MAGIC)) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: upgrade_receive: nothing received from the instance being upgraded");
+		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+	}
+	upgrade_state=UPGRADE_TAKEOVER;
+	snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: upgrade_receive: taking over from the instance with master pid %d", upgrade_hello.master_pid);
+	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	return 0;
+}
+
+/* receives the running instance's listeners and gives them to the workers in the order they came, into
+ * listeners[]. They are only used if they're bound to the configured address. Any more than there are
+ * workers are closed, their old workers empty them before they close them too.
+ * returns how many listeners were taken, the rest have to be created
+ */
+int upgrade_listeners() {
+	int fds[MAXWORKERS];
+	int nfds=0;
+	int used=0;
+	int i;
+	char byte;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(int) * MAXWORKERS)];
+	struct sockaddr_in addr;
+	socklen_t size;
+
+	memset(&msg, '\0', sizeof(msg));
+	iov.iov_base=&byte;
+	iov.iov_len=1;
+	msg.msg_iov=&iov;
+	msg.msg_iovlen=1;
+	msg.msg_control=control;
+	msg.msg_controllen=sizeof(control);
+	if(recvmsg(upgrade_fd, &msg, MSG_WAITALL) == 1) {
+		cmsg=CMSG_FIRSTHDR(&msg);
+		if((cmsg != NULL) && (cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+			nfds=(cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * nfds);
+		}
+	}
+	if(nfds == 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: upgrade_listeners: the listeners weren't received from the instance being upgraded");
+		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+	}
+	for(i=0; i < nfds; i++) {
+		size=sizeof(addr);
+		if((getsockname(fds[i], (struct sockaddr *)&addr, &size) != 0) || (addr.sin_port != htons((uint16_t)balancer->binding_port)) || (addr.sin_addr.s_addr != balancer->binding_ip.s_addr)) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: upgrade_listeners: the running instance listens on another address, new listeners are created");
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+			used=0;
+			break;
+		}
+		if(i < balancer->workers) {
+			used++;
+		}
+	}
+	for(i=0; i < nfds; i++) {
+		if(i < used) {
+			listeners[i]=fds[i];
+		}
+		else {
+			close(fds[i]);
+		}
+	}
+	if(used < nfds) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: upgrade_listeners: took over %d of the running instance's %d listeners", used, nfds);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	return used;
+}
+
+/* copies the running instance's state into the BALANCER before it goes into the new SHM segment. What
+ * the old processes still have going (their sessions, pooled connections and buffers) stays with them
+ */
+int upgrade_adopt() {
+	BALANCER *old;
+	int i;
+
+	/* the release doesn't matter, only that the state is laid out the same way */
+	if((upgrade_hello.layout != UPGRADE_LAYOUT) || (upgrade_hello.balancer_size != sizeof(BALANCER))) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: upgrade_adopt: the running instance is version %.*s with SHM layout %d (this binary has %d), its state isn't adopted", OCTOPUS_VERSION_LEN, upgrade_hello.version, upgrade_hello.layout, UPGRADE_LAYOUT);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		return -1;
+	}
+	old=shmat(upgrade_hello.shmid, (void *) 0, SHM_RDONLY);
+	if(old == (BALANCER *) (-1)) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: upgrade_adopt: unable to attach to the running instance's SHM segment, its state isn't adopted: %s", strerror(errno));
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		return -1;
+	}
+	memcpy(balancer->hash_table, old->hash_table, sizeof(balancer->hash_table));
+	balancer->nmembers=old->nmembers;
+	balancer->nclones=old->nclones;
+	memcpy(balancer->members, old->members, sizeof(balancer->members));
+	memcpy(balancer->clones, old->clones, sizeof(balancer->clones));
+	balancer->algorithm=old->algorithm;
+	balancer->clone_mode=old->clone_mode;
+	balancer->overload_mode=old->overload_mode;
+	balancer->monitor_interval=old->monitor_interval;
+	balancer->hash_rebalance_threshold=old->hash_rebalance_threshold;
+	balancer->hash_rebalance_size=old->hash_rebalance_size;
+	balancer->hash_rebalance_interval=old->hash_rebalance_interval;
+	balancer->snmp_status=old->snmp_status;
+	balancer->debug_level=old->debug_level;
+	balancer->accept_budget=old->accept_budget;
+	balancer->buffer_mode=old->buffer_mode;
+	balancer->buffer_size=old->buffer_size;
+	balancer->buffer_size_max=old->buffer_size_max;
+	memcpy(balancer->worker_stats, old->worker_stats, sizeof(balancer->worker_stats));
+	shmdt((const void *)old);
+	for(i=0; i < MAXSERVERS; i++) {
+		balancer->members[i].c=0;
+		balancer->members[i].pool_idle=0;
+		balancer->members[i].warm_idle=0;
+		balancer->clones[i].c=0;
+		balancer->clones[i].pool_idle=0;
+		balancer->clones[i].warm_idle=0;
+	}
+	for(i=0; i < MAXWORKERS; i++) {
+		balancer->worker_stats[i].buffer_bytes=0;
+		balancer->worker_stats[i].buffer_blocks_used=0;
+		balancer->worker_stats[i].buffer_bytes_used=0;
+	}
+	snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: upgrade_adopt: adopted %d members, %d clones and the hash table of the running instance", balancer->nmembers, balancer->nclones);
+	write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	return 0;
+}
+
+/* called once the workers have been forked. The master tells the old binary it is running and moves its
+ * SHM file into place, every process closes the socket
+ */
+int upgrade_commit() {
+	char reply=UPGRADE_READY;
+
+	if(upgrade_state != UPGRADE_TAKEOVER) {
+		return 0;
+	}
+	if(worker_id == 0) {
+		if(strncmp(upgrade_hello.run_file, balancer->shm_run_file, SHM_FILE_FULLNAME_MAX_LENGTH) == 0) {
+			reply=UPGRADE_READY_RUN_FILE;
+		}
+		/* if the old binary has given up on us we give up too */
+		if(send(upgrade_fd, &reply, 1, MSG_NOSIGNAL) != 1) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: upgrade_commit: the instance being upgraded has gone away: %s", strerror(errno));
+			write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+		}
+		if(rename(upgrade_run_file, balancer->shm_run_file) != 0) {
+			snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: upgrade_commit: unable to move SHM file %.*s into place: %s", OCTOPUS_LOG_PATH_LEN, upgrade_run_file, strerror(errno));
+			write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+		}
+		snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: upgrade_commit: took over from the instance with master pid %d", upgrade_hello.master_pid);
+		write_log(OCTOPUS_LOG_STD | OCTOPUS_LOG_SYSLOG, log_string, SUPPRESS_OFF);
+	}
+	close(upgrade_fd);
+	upgrade_fd=-1;
+	upgrade_state=UPGRADE_NONE;
+	return 0;
+}
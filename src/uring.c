@@ -0,0 +1,756 @@
+/*
+ * Octopus Load Balancer - io_uring event backend.
+ *
+ * Copyright 2008-2011 Alistair Reay <alreay1@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+/* The io_uring backends replace epoll_wait/epoll_ctl/accept4 with requests on a per-worker ring.
+ *
+ *  - the listener has a multishot accept outstanding, each completion carries a new client socket.
+ *  - nothing is sent to the kernel when a request is queued. Everything queued while handling a batch goes
+ *    in with the io_uring_enter call that waits for the next batch, so a busy worker makes one system call
+ *    per batch for all of its event handling.
+ *
+ * io_uring_poll is a readiness backend: io_uring tells the worker which sockets are ready, the handlers move
+ * the data with their own readv/writev/splice calls and member connects are made with connect().
+ *
+ *  - every session socket has a poll request outstanding with its current interest. In level-triggered mode
+ *    the polls are one-shot and re-armed after each batch of events, with a poll update submitted when the
+ *    interest changes while a poll is outstanding. In edge-triggered mode one multishot poll is made when
+ *    the socket is added and left alone, which gives the same edge semantics as EPOLLET.
+ *
+ * io_uring is a completion backend: the reads, writes and connects themselves are submitted to the ring.
+ *
+ *  - the handlers keep the interest of each socket up to date as they do for epoll, which only marks the
+ *    session. uring_sync() goes through the marked sessions after the batch and submits a READV into the
+ *    free space of the buffer a socket is read into while it is wanted for reading, a WRITEV of the data
+ *    waiting for it while it is wanted for writing, and the connect of a new member or clone socket. A
+ *    socket has at most one of each in flight, and the read of a clone goes to the waste buffer.
+ *  - a completion is accounted for in the buffer as it arrives (see buffer.c) and reported to the event loop
+ *    as EPOLLIN or EPOLLOUT. The handler's buffer_read() or buffer_write() hands it the result instead of
+ *    making the system call, so the session state machine is the one the other backends run.
+ *  - a socket that is closed has its requests cancelled. Their buffers stay attached, and no new request of
+ *    the same kind is made for the session's socket in that role, until the cancelled one has completed.
+ *  - kernels that return EAGAIN for a non-blocking socket rather than waiting for it get a poll first, and
+ *    the read or write is made again when it completes.
+ *
+ * The data is copied through the session buffers in level-triggered mode, relay_mode splice and epoll_mode
+ * edge are refused with this backend. Inline writes and member Fast Open have no effect. As a socket that is
+ * wanted for reading always has a read in flight, an idle session holds a buffer array for each of its
+ * sockets it reads from, where the other backends hand them back.
+ *
+ * Poll and data completions are translated into the same epoll_event array the epoll backend fills, so the
+ * session handlers are shared. No buffers are registered with the ring. The ring is driven with the raw system
+ * calls so no extra library is required.
+ */
+
+#ifdef USE_IO_URING
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *params) {
+	return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags, void *arg, size_t argsz) {
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+/* creates the worker's ring and maps its queues */
+int uring_init(int maxevents) {
+	struct io_uring_params params;
+	char *sq_ring;
+	char *cq_ring;
+	size_t sq_ring_size;
+	size_t cq_ring_size;
+
+	memset(&params, '\0', sizeof(params));
+	uring.fd=io_uring_setup(URING_ENTRIES, &params);
+	if(uring.fd < 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: uring_init: unable to create io_uring instance: %s", strerror(errno));
+		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+	}
+	if(!(params.features & IORING_FEAT_NODROP)) {
+		write_log(OCTOPUS_LOG_EXIT, "ERROR: uring_init: the kernel's io_uring is too old, use io_backend=epoll", SUPPRESS_OFF);
+	}
+	sq_ring_size=params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	cq_ring_size=params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	/* the two rings share one mapping on any kernel new enough to have IORING_FEAT_NODROP */
+	if(cq_ring_size > sq_ring_size) {
+		sq_ring_size=cq_ring_size;
+	}
+	sq_ring=mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQ_RING);
+	if(sq_ring == MAP_FAILED) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: uring_init: unable to map io_uring queues: %s", strerror(errno));
+		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+	}
+	cq_ring=sq_ring;
+	uring.sqes=mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring.fd, IORING_OFF_SQES);
+	if(uring.sqes == MAP_FAILED) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: uring_init: unable to map io_uring submissions: %s", strerror(errno));
+		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+	}
+	uring.sq_head=(unsigned int *)(sq_ring + params.sq_off.head);
+	uring.sq_tail=(unsigned int *)(sq_ring + params.sq_off.tail);
+	uring.sq_mask=(unsigned int *)(sq_ring + params.sq_off.ring_mask);
+	uring.sq_array=(unsigned int *)(sq_ring + params.sq_off.array);
+	uring.sq_entries=params.sq_entries;
+	uring.sq_local_tail=*uring.sq_tail;
+	uring.sq_pending=0;
+	uring.cq_head=(unsigned int *)(cq_ring + params.cq_off.head);
+	uring.cq_tail=(unsigned int *)(cq_ring + params.cq_off.tail);
+	uring.cq_mask=(unsigned int *)(cq_ring + params.cq_off.ring_mask);
+	uring.cqes=(struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+	/* every completion handled in a batch can leave at most one socket to re-arm */
+	uring.rearm=malloc(sizeof(uint64_t) * maxevents);
+	if(uring.rearm == NULL) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: uring_init: unable to allocate memory - %s", strerror(errno));
+		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+	}
+	uring.rearm_count=0;
+	/* a session is only ever on the list once */
+	uring.dirty=malloc(sizeof(unsigned int) * worker_session_limit);
+	if(uring.dirty == NULL) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "ERROR: uring_init: unable to allocate memory - %s", strerror(errno));
+		write_log(OCTOPUS_LOG_EXIT, log_string, SUPPRESS_OFF);
+	}
+	uring.dirty_count=0;
+	uring.accept_multishot=1;
+	uring.ext_arg=(params.features & IORING_FEAT_EXT_ARG) ? 1 : 0;
+	if((uring.ext_arg == 0) && (worker_id == 0)) {
+		write_log(OCTOPUS_LOG_STD, "WARNING: uring_init: the kernel's io_uring can't wait with a timeout, member connect timeouts are only checked as other events arrive", SUPPRESS_OFF);
+	}
+	if(worker_id == 0) {
+		snprintf(log_string, OCTOPUS_LOG_LEN, "STARTUP: uring_init: using io_uring with %u submission and %u completion entries", params.sq_entries, params.cq_entries);
+		write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_OFF);
+	}
+	return 0;
+}
+
+/* returns a cleared submission queue entry, handing the queued submissions to the kernel first if the queue is full */
+struct io_uring_sqe *uring_get_sqe() {
+	struct io_uring_sqe *sqe;
+	unsigned int index;
+
+	if((uring.sq_local_tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE)) >= uring.sq_entries) {
+		uring_submit();
+		if((uring.sq_local_tail - __atomic_load_n(uring.sq_head, __ATOMIC_ACQUIRE)) >= uring.sq_entries) {
+			return NULL;
+		}
+	}
+	index=uring.sq_local_tail & *uring.sq_mask;
+	sqe=&uring.sqes[index];
+	memset(sqe, '\0', sizeof(struct io_uring_sqe));
+	uring.sq_array[index]=index;
+	uring.sq_local_tail++;
+	uring.sq_pending++;
+	worker_stats->uring_sqes++;
+	return sqe;
+}
+
+/* hands the queued submissions to the kernel without waiting for completions */
+int uring_submit() {
+	int submitted;
+
+	if(uring.sq_pending == 0) {
+		return 0;
+	}
+	__atomic_store_n(uring.sq_tail, uring.sq_local_tail, __ATOMIC_RELEASE);
+	worker_stats->event_syscalls++;
+	submitted=io_uring_enter(uring.fd, uring.sq_pending, 0, 0, NULL, 0);
+	if(submitted > 0) {
+		uring.sq_pending -= submitted;
+	}
+	return submitted;
+}
+
+/* submits everything queued and waits for completions, for no more than timeout milliseconds unless it's -1.
+ * Poll completions, and the io_uring backend's read, write and connect completions, are written to events[]
+ * in the form epoll_wait would have returned them, accepts are handled here. Returns the number of events or -1
+ */
+int uring_wait(int maxevents, int timeout) {
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned int flags;
+	struct io_uring_cqe *cqe;
+	unsigned int head;
+	unsigned int tail;
+	unsigned int min_complete;
+	unsigned long long user_data;
+	EVENT_REG *reg;
+	uint32_t ready;
+	int submitted;
+	int accepted=0;
+	int nfds=0;
+
+	__atomic_store_n(uring.sq_tail, uring.sq_local_tail, __ATOMIC_RELEASE);
+	head=*uring.cq_head;
+	/* only block when there's nothing already waiting to be handled */
+	min_complete=(head == __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE)) ? 1 : 0;
+	if((min_complete > 0) || (uring.sq_pending > 0)) {
+		worker_stats->event_syscalls++;
+		flags=min_complete ? IORING_ENTER_GETEVENTS : 0;
+		if((min_complete > 0) && (timeout >= 0) && (uring.ext_arg == 1)) {
+			memset(&arg, '\0', sizeof(arg));
+			ts.tv_sec=timeout / 1000;
+			ts.tv_nsec=(long long)(timeout % 1000) * 1000000;
+			arg.ts=(uint64_t)(uintptr_t)&ts;
+			submitted=io_uring_enter(uring.fd, uring.sq_pending, min_complete, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+		}
+		else {
+			submitted=io_uring_enter(uring.fd, uring.sq_pending, min_complete, flags, NULL, 0);
+		}
+		/* the wait timed out without anything having been submitted */
+		if((submitted < 0) && (errno == ETIME)) {
+			submitted=0;
+		}
+		if(submitted < 0) {
+			return -1;
+		}
+		uring.sq_pending -= submitted;
+	}
+	timer_now=timer_clock();
+	tail=__atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+	while((head != tail) && (nfds < maxevents) && (uring.rearm_count < maxevents)) {
+		cqe=&uring.cqes[head & *uring.cq_mask];
+		head++;
+		user_data=cqe->user_data;
+		/* poll updates and removals */
+		if(user_data & URING_TAG_IGNORE) {
+			continue;
+		}
+		/* a new client from the listener's accept request */
+		if(user_data & URING_TAG_ACCEPT) {
+			if(cqe->res >= 0) {
+				accepted++;
+				accept_session(cqe->res, NULL);
+			}
+			else if((cqe->res == -EINVAL) && (uring.accept_multishot == 1)) {
+				write_log(OCTOPUS_LOG_STD, "WARNING: uring_wait: kernel doesn't support multishot accept, accepting one connection per request", SUPPRESS_OFF);
+				uring.accept_multishot=0;
+			}
+			else if(cqe->res == -EMFILE) {
+				write_log(OCTOPUS_LOG_STD, "WARNING: cannot accept new connection, file descriptor limit reached!", SUPPRESS_CONN_REJECT);
+			}
+			else if((cqe->res != -EAGAIN) && (cqe->res != -ECONNABORTED) && (cqe->res != -EINTR) && (cqe->res != -ECANCELED)) {
+				snprintf(log_string, OCTOPUS_LOG_LEN, "WARNING: error accepting new connection: %s", strerror(-cqe->res));
+				write_log(OCTOPUS_LOG_STD, log_string, SUPPRESS_CONN_REJECT);
+			}
+			if(!(cqe->flags & IORING_CQE_F_MORE) && (uring.listenerfd >= 0)) {
+				uring_accept(uring.listenerfd);
+			}
+			continue;
+		}
+		if(balancer->io_backend == IO_BACKEND_URING) {
+			ready=uring_complete(user_data, cqe->res);
+			if(ready != 0) {
+				events[nfds].data.u64=user_data & ~URING_TAG_OP(3);
+				events[nfds].events=ready;
+				nfds++;
+			}
+			continue;
+		}
+		reg=&sessions[EVENT_TAG_ID(user_data)].reg[EVENT_TAG_ROLE(user_data)];
+		/* the socket has been closed (and the session maybe reused) since the poll was made */
+		if((reg->tag != user_data) || (reg->events == 0)) {
+			continue;
+		}
+		if(!(cqe->flags & IORING_CQE_F_MORE)) {
+			reg->armed=0;
+			uring.rearm[uring.rearm_count++]=user_data;
+		}
+		if(cqe->res == -ECANCELED) {
+			continue;
+		}
+		events[nfds].data.u64=user_data;
+		/* the interest may have been changed after the poll completed, in the same batch as the poll was
+		 * made for example. Like epoll_wait() only what is still wanted is reported */
+		events[nfds].events=(cqe->res < 0) ? EPOLLERR : ((uint32_t)cqe->res & (reg->events | EPOLLERR | EPOLLHUP));
+		if(events[nfds].events == 0) {
+			continue;
+		}
+		nfds++;
+	}
+	__atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+	if(accepted > 0) {
+		worker_stats->accept_wakeups++;
+		worker_stats->accepts += accepted;
+	}
+	return nfds;
+}
+
+/* queues a poll request for one of a session's sockets with its current interest */
+int uring_poll_add(SESSION *session, int role) {
+	struct io_uring_sqe *sqe;
+	EVENT_REG *reg=&session->reg[role];
+
+	sqe=uring_get_sqe();
+	if(sqe == NULL) {
+		errno=EBUSY;
+		return -1;
+	}
+	sqe->opcode=IORING_OP_POLL_ADD;
+	sqe->fd=session_fd(session, role);
+	sqe->poll32_events=reg->events & ~EPOLLET;
+	/* edge-triggered sockets keep one poll for their whole life */
+	if(balancer->epoll_mode == EPOLL_MODE_EDGE) {
+		sqe->len=IORING_POLL_ADD_MULTI;
+	}
+	sqe->user_data=reg->tag;
+	reg->armed=1;
+	return 0;
+}
+
+/* queues a change of interest for a socket's outstanding poll. If its poll has already completed it will be
+ * re-armed with the new interest after the current batch anyway
+ */
+int uring_poll_update(SESSION *session, int role) {
+	struct io_uring_sqe *sqe;
+	EVENT_REG *reg=&session->reg[role];
+
+	if(reg->armed == 0) {
+		return 0;
+	}
+	sqe=uring_get_sqe();
+	if(sqe == NULL) {
+		errno=EBUSY;
+		return -1;
+	}
+	sqe->opcode=IORING_OP_POLL_REMOVE;
+	sqe->fd=-1;
+	sqe->addr=reg->tag;
+	sqe->poll32_events=reg->events & ~EPOLLET;
+	sqe->len=IORING_POLL_UPDATE_EVENTS;
+	sqe->user_data=URING_TAG_IGNORE;
+	return 0;
+}
+
+/* cancels the outstanding poll of a socket that is about to be closed. Any completion still to be handled
+ * for it won't match the session's tag once epoll_del() has cleared it
+ */
+int uring_poll_remove(SESSION *session, int role) {
+	struct io_uring_sqe *sqe;
+	EVENT_REG *reg=&session->reg[role];
+
+	if(reg->armed == 1) {
+		sqe=uring_get_sqe();
+		if(sqe != NULL) {
+			sqe->opcode=IORING_OP_POLL_REMOVE;
+			sqe->fd=-1;
+			sqe->addr=reg->tag;
+			sqe->user_data=URING_TAG_IGNORE;
+		}
+	}
+	reg->armed=0;
+	return 0;
+}
+
+/* queues an accept request on the listener. Multishot accepts keep delivering clients until they fail */
+int uring_accept(int listenerfd) {
+	struct io_uring_sqe *sqe;
+
+	uring.listenerfd=listenerfd;
+	sqe=uring_get_sqe();
+	if(sqe == NULL) {
+		errno=EBUSY;
+		return -1;
+	}
+	sqe->opcode=IORING_OP_ACCEPT;
+	sqe->fd=listenerfd;
+	sqe->accept_flags=SOCK_NONBLOCK | SOCK_CLOEXEC;
+	if(uring.accept_multishot == 1) {
+		sqe->ioprio=IORING_ACCEPT_MULTISHOT;
+	}
+	sqe->user_data=URING_TAG_ACCEPT | (unsigned int)listenerfd;
+	return 0;
+}
+
+/* cancels the accept request when the worker stops accepting for an upgrade. Clients it accepts until the
+ * cancel has been handled are still given sessions
+ */
+int uring_accept_cancel() {
+	struct io_uring_sqe *sqe;
+
+	if(uring.listenerfd < 0) {
+		return 0;
+	}
+	sqe=uring_get_sqe();
+	if(sqe == NULL) {
+		errno=EBUSY;
+		return -1;
+	}
+	sqe->opcode=IORING_OP_ASYNC_CANCEL;
+	sqe->fd=-1;
+	sqe->addr=URING_TAG_ACCEPT | (unsigned int)uring.listenerfd;
+	sqe->user_data=URING_TAG_IGNORE;
+	uring.listenerfd=-1;
+	return 0;
+}
+
+/* called by clean_exit() and upgrade_drain(). The kernel tears a ring down some time after its process has gone,
+ * and until the accept request has been dropped the listener stays open and takes connections that no one will
+ * accept. The accept is cancelled here and the cancel waited for, so the listener closes with the process or when
+ * the draining worker closes it
+ */
+int uring_exit() {
+	if((uring.sqes == NULL) || (uring.listenerfd < 0)) {
+		return 0;
+	}
+	if(uring_accept_cancel() < 0) {
+		return -1;
+	}
+	__atomic_store_n(uring.sq_tail, uring.sq_local_tail, __ATOMIC_RELEASE);
+	if(io_uring_enter(uring.fd, uring.sq_pending, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+		return -1;
+	}
+	uring.sq_pending=0;
+	return 0;
+}
+
+/* called after a batch of events has been handled. Makes a new poll for every socket whose poll completed in
+ * the batch and which is still open, with whatever interest the handlers left it with
+ */
+int uring_rearm() {
+	int i;
+	SESSION *session;
+	int role;
+
+	for(i=0; i<uring.rearm_count; i++) {
+		session=&sessions[EVENT_TAG_ID(uring.rearm[i])];
+		role=EVENT_TAG_ROLE(uring.rearm[i]);
+		if((session->reg[role].tag == uring.rearm[i]) && (session->reg[role].events != 0) && (session->reg[role].armed == 0)) {
+			uring_poll_add(session, role);
+		}
+	}
+	uring.rearm_count=0;
+	return 0;
+}
+
+/* io_uring backend: puts a session on the list uring_sync() looks at after the batch */
+int uring_mark(SESSION *session) {
+	if(session->ring_dirty == 0) {
+		session->ring_dirty=1;
+		uring.dirty[uring.dirty_count++]=session->id;
+	}
+	return 0;
+}
+
+/* io_uring backend: cancels the requests in flight for a socket that is about to be closed or pooled, and
+ * drops the ones still to be made. The cancels don't need the fd, they find the requests by their user_data
+ */
+int uring_cancel(SESSION *session, int role) {
+	struct io_uring_sqe *sqe;
+	EVENT_REG *reg=&session->reg[role];
+	int op;
+
+	for(op=URING_OP_POLL; op <= URING_OP_CONNECT; op++) {
+		if(!(reg->ring & URING_BUSY(op))) {
+			continue;
+		}
+		sqe=uring_get_sqe();
+		if(sqe == NULL) {
+			continue;
+		}
+		sqe->opcode=IORING_OP_ASYNC_CANCEL;
+		sqe->fd=-1;
+		sqe->addr=reg->tag | URING_TAG_OP(op);
+		sqe->user_data=URING_TAG_IGNORE;
+	}
+	reg->ring &= ~(URING_WANT_CONNECT | URING_WAIT_READ | URING_WAIT_WRITE | URING_READ_DONE);
+	return 0;
+}
+
+/* io_uring backend: has the connect of a socket that has just been registered submitted after the batch */
+int uring_connect(SESSION *session, int role, struct sockaddr_in *addr) {
+	EVENT_REG *reg=&session->reg[role];
+
+	reg->addr=*addr;
+	reg->ring |= URING_WANT_CONNECT;
+	return uring_mark(session);
+}
+
+/* the buffer a read or write for one of a session's sockets uses, NULL for the others */
+BUFFER *uring_buffer(SESSION *session, int role, int op) {
+	if(op == URING_OP_READ) {
+		if(role == EVENT_ROLE_CLIENT) {
+			return &session->client_buffer;
+		}
+		if(role == EVENT_ROLE_MEMBER) {
+			return &session->member_buffer;
+		}
+	}
+	if(op == URING_OP_WRITE) {
+		if(role == EVENT_ROLE_CLIENT) {
+			return &session->member_buffer;
+		}
+		if(role == EVENT_ROLE_MEMBER) {
+			return &session->client_buffer;
+		}
+		return &session->clone_buffer;
+	}
+	return NULL;
+}
+
+/* io_uring backend: accounts for the completion of a request for a session socket.
+ * returns the events to report to the handlers, 0 if there is nothing for them to do
+ */
+uint32_t uring_complete(uint64_t user_data, int res) {
+	SESSION *session=&sessions[EVENT_TAG_ID(user_data)];
+	int role=EVENT_TAG_ROLE(user_data);
+	int op=URING_TAG_OP_OF(user_data);
+	EVENT_REG *reg=&session->reg[role];
+	BUFFER *buffer=uring_buffer(session, role, op);
+
+	reg->ring &= ~URING_BUSY(op);
+	if(buffer != NULL) {
+		buffer->ring &= ~((op == URING_OP_READ) ? BUFFER_RING_READ : BUFFER_RING_WRITE);
+	}
+	/* the socket's next request, or the first of the socket registered in its place, can be made */
+	uring_mark(session);
+	/* the socket has been closed since and the request cancelled. The array only kept for it goes back */
+	if((reg->tag != (user_data & ~URING_TAG_OP(3))) || (res == -ECANCELED)) {
+		if(buffer != NULL) {
+			buffer_release(buffer);
+		}
+		return 0;
+	}
+	switch(op) {
+	case URING_OP_POLL:
+		/* the read or write that got EAGAIN is made again */
+		reg->ring &= ~(URING_WAIT_READ | URING_WAIT_WRITE);
+		if((role == EVENT_ROLE_MEMBER) && (session->state & STATE_MEM_CONNECTING)) {
+			reg->result=URING_RESULT_ASK;
+			return EPOLLOUT;
+		}
+		return 0;
+	case URING_OP_CONNECT:
+		/* the kernel left the connect in progress, it is seen through with a poll */
+		if((res == -EINPROGRESS) || (res == -EALREADY) || (res == -EAGAIN)) {
+			reg->ring |= URING_WAIT_WRITE;
+			return 0;
+		}
+		reg->result=res;
+		if(role == EVENT_ROLE_MEMBER) {
+			return EPOLLOUT;
+		}
+		return (res < 0) ? EPOLLERR : 0;
+	case URING_OP_READ:
+		if(res == -EAGAIN) {
+			reg->ring |= URING_WAIT_READ;
+			if(buffer != NULL) {
+				buffer_release(buffer);
+			}
+			return 0;
+		}
+		if(buffer == NULL) {
+			reg->result=res;
+			reg->ring |= URING_READ_DONE;
+			return EPOLLIN;
+		}
+		if(res > 0) {
+			buffer_commit(buffer, res);
+		}
+		else {
+			buffer_release(buffer);
+		}
+		buffer->ring_read=res;
+		buffer->ring |= BUFFER_RING_READ_DONE;
+		return EPOLLIN;
+	case URING_OP_WRITE:
+		if(res == -EAGAIN) {
+			reg->ring |= URING_WAIT_WRITE;
+			return 0;
+		}
+		if(res > 0) {
+			buffer_consume(buffer, res);
+		}
+		buffer->ring_write=res;
+		buffer->ring |= BUFFER_RING_WRITE_DONE;
+		return EPOLLOUT;
+	}
+	return 0;
+}
+
+/* io_uring backend: hands a handler the result of a read or write the ring has completed, the way the
+ * system call would have returned it. Without one the handler is told the socket would have blocked
+ */
+ssize_t uring_result(int *ring, int flag, int result) {
+	if(!(*ring & flag)) {
+		errno=EAGAIN;
+		return -1;
+	}
+	*ring &= ~flag;
+	if(result < 0) {
+		errno=-result;
+		return -1;
+	}
+	return result;
+}
+
+/* io_uring backend: queues a read for a session socket, into the free space of its buffer or for a clone
+ * the waste buffer. When the buffer pool is exhausted the handler is run with ENOBUFS, which puts the session
+ * on the wait list
+ */
+int uring_read(SESSION *session, int role) {
+	struct io_uring_sqe *sqe;
+	EVENT_REG *reg=&session->reg[role];
+	BUFFER *buffer=uring_buffer(session, role, URING_OP_READ);
+	int iovcnt=1;
+
+	if(buffer == NULL) {
+		reg->iov[0].iov_base=waste_buffer;
+		reg->iov[0].iov_len=MESSAGE_SIZE_LIMIT;
+	}
+	else {
+		if(buffer_acquire(buffer) != 0) {
+			buffer->ring_read=-ENOBUFS;
+			buffer->ring |= BUFFER_RING_READ_DONE;
+			return (role == EVENT_ROLE_CLIENT) ? client_read(session) : member_read(session);
+		}
+		iovcnt=buffer_space_iov(buffer, session->buffer_limit, reg->iov);
+		if(iovcnt == 0) {
+			buffer_release(buffer);
+			return 0;
+		}
+	}
+	sqe=uring_get_sqe();
+	if(sqe == NULL) {
+		if(buffer != NULL) {
+			buffer_release(buffer);
+		}
+		errno=EBUSY;
+		return -1;
+	}
+	sqe->opcode=IORING_OP_READV;
+	sqe->fd=session_fd(session, role);
+	sqe->addr=(uint64_t)(uintptr_t)reg->iov;
+	sqe->len=iovcnt;
+	sqe->user_data=reg->tag | URING_TAG_OP(URING_OP_READ);
+	reg->ring |= URING_BUSY(URING_OP_READ);
+	if(buffer != NULL) {
+		buffer->ring |= BUFFER_RING_READ;
+	}
+	return 0;
+}
+
+/* io_uring backend: queues a write of the data waiting for a session socket, if there is any */
+int uring_write(SESSION *session, int role) {
+	struct io_uring_sqe *sqe;
+	EVENT_REG *reg=&session->reg[role];
+	BUFFER *buffer=uring_buffer(session, role, URING_OP_WRITE);
+	int iovcnt;
+
+	iovcnt=buffer_data_iov(buffer, &reg->iov[2]);
+	if(iovcnt == 0) {
+		return 0;
+	}
+	sqe=uring_get_sqe();
+	if(sqe == NULL) {
+		errno=EBUSY;
+		return -1;
+	}
+	sqe->opcode=IORING_OP_WRITEV;
+	sqe->fd=session_fd(session, role);
+	sqe->addr=(uint64_t)(uintptr_t)&reg->iov[2];
+	sqe->len=iovcnt;
+	sqe->user_data=reg->tag | URING_TAG_OP(URING_OP_WRITE);
+	reg->ring |= URING_BUSY(URING_OP_WRITE);
+	buffer->ring |= BUFFER_RING_WRITE;
+	return 0;
+}
+
+/* io_uring backend: queues the requests one of a session's sockets is waiting for. Nothing else is made for a
+ * socket that is connecting, otherwise a read while it is wanted for reading and a write while it is wanted
+ * for writing, or a poll for the ones the kernel said would block
+ */
+int uring_sync_socket(SESSION *session, int role) {
+	struct io_uring_sqe *sqe;
+	EVENT_REG *reg=&session->reg[role];
+	uint32_t poll=0;
+
+	if(reg->tag == 0) {
+		return 0;
+	}
+	if(reg->ring & URING_WANT_CONNECT) {
+		if(reg->ring & URING_BUSY(URING_OP_CONNECT)) {
+			return 0;
+		}
+		sqe=uring_get_sqe();
+		if(sqe == NULL) {
+			errno=EBUSY;
+			return -1;
+		}
+		sqe->opcode=IORING_OP_CONNECT;
+		sqe->fd=session_fd(session, role);
+		sqe->addr=(uint64_t)(uintptr_t)&reg->addr;
+		sqe->off=sizeof(reg->addr);
+		sqe->user_data=reg->tag | URING_TAG_OP(URING_OP_CONNECT);
+		reg->ring &= ~URING_WANT_CONNECT;
+		reg->ring |= URING_BUSY(URING_OP_CONNECT);
+		return 0;
+	}
+	if(reg->ring & URING_BUSY(URING_OP_CONNECT)) {
+		return 0;
+	}
+	if((role == EVENT_ROLE_MEMBER) && (session->state & STATE_MEM_CONNECTING)) {
+		poll=POLLOUT;
+	}
+	else {
+		if((reg->events & EPOLLIN) && !(reg->ring & URING_BUSY(URING_OP_READ))) {
+			if(reg->ring & URING_WAIT_READ) {
+				poll |= POLLIN;
+			}
+			else {
+				uring_read(session, role);
+			}
+		}
+		if((reg->events & EPOLLOUT) && !(reg->ring & URING_BUSY(URING_OP_WRITE))) {
+			if(reg->ring & URING_WAIT_WRITE) {
+				poll |= POLLOUT;
+			}
+			else {
+				uring_write(session, role);
+			}
+		}
+	}
+	if((poll == 0) || (reg->ring & URING_BUSY(URING_OP_POLL))) {
+		return 0;
+	}
+	sqe=uring_get_sqe();
+	if(sqe == NULL) {
+		errno=EBUSY;
+		return -1;
+	}
+	sqe->opcode=IORING_OP_POLL_ADD;
+	sqe->fd=session_fd(session, role);
+	sqe->poll32_events=poll;
+	sqe->user_data=reg->tag | URING_TAG_OP(URING_OP_POLL);
+	reg->ring |= URING_BUSY(URING_OP_POLL);
+	return 0;
+}
+
+/* io_uring backend: called after a batch of events has been handled, and everything else the event loop does
+ * after it. Queues the requests the sockets of the marked sessions are waiting for. A handler run here may mark
+ * another session, which is looked at in the same pass
+ */
+int uring_sync() {
+	SESSION *session;
+	int role;
+	int i;
+
+	for(i=0; i < uring.dirty_count; i++) {
+		session=&sessions[uring.dirty[i]];
+		session->ring_dirty=0;
+		for(role=EVENT_ROLE_CLIENT; (role < EVENT_ROLES) && (session->state != STATE_UNUSED); role++) {
+			uring_sync_socket(session, role);
+		}
+	}
+	uring.dirty_count=0;
+	return 0;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#!/usr/bin/ruby
+
+#HASH balancing with and without defer_accept: reports the median accept to member connect time from the admin
+#info and checks that requests are read on accept when the accept is deferred. Then uploads request bodies
+#larger than a session buffer under each I/O backend the server was built with: the first read on accept
+#fills the client buffer, and a poll result from before it filled must not be taken for the end of the stream,
+#nor with io_uring a read submitted for more than the room left in it
+#assumes a clean build and that nothing else listens on ports 18480-18482
+
+require_relative 'helper'
+
+MEMBERS = memberConf("A", 18481) + memberConf("B", 18482)
+CLIENTS = 10
+REQUESTS = 30
+
+def request(path, body="")
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	if body.empty?
+		s.write("GET #{path} HTTP/1.0\r\n\r\n")
+	else
+		s.write("GET #{path} HTTP/1.0\r\nContent-Length: #{body.bytesize}\r\n\r\n" + body)
+	end
+	ret=s.read
+	s.close
+	return ret
+rescue SystemCallError => e
+	return e.message
+end
+
+def runRequests(tag)
+	failures=[]
+	threads=(1..CLIENTS).map do |k|
+		Thread.new do
+			REQUESTS.times do |i|
+				path="/#{tag}#{k}_#{i}"
+				ret=request(path)
+				failures << "#{path}: #{ret.inspect[0, 200]}" unless ret.include?("path #{path}\n")
+			end
+		end
+	end
+	threads.each { |t| t.join }
+	if !failures.empty?
+		error("#{failures.length} requests failed, eg. #{failures[0]}")
+	end
+end
+
+def testDeferAccept(seconds, lines=[])
+	pid=startServer(["algorithm=HASH", "defer_accept=#{seconds}"] + lines + MEMBERS)
+	runRequests("d")
+	median=infoValue("Accept to connect")
+	deferred=infoValue("Deferred accept")
+	#a client that sends its request late is still served
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	sleep 1.2
+	s.write("GET /late HTTP/1.0\r\n\r\n")
+	late=s.read
+	s.close
+	killServer(pid)
+	puts "	defer_accept=#{seconds} #{lines.join(" ")}: accept to connect #{median}, deferred accept: #{deferred}"
+	if !late.include?("path /late\n")
+		error("the late request was not served")
+	end
+	#io_uring submits the read with the next wait rather than reading on accept
+	if seconds > 0 && !lines.include?("io_backend=io_uring") && deferred.split(", ")[1].to_i == 0
+		error("no request was read on accept")
+	end
+end
+
+def testUploads(lines)
+	pid=startServer(["algorithm=HASH"] + lines + MEMBERS)
+	body=Random.new(1).bytes(200000)
+	failures=0
+	threads=(1..CLIENTS).map do |k|
+		Thread.new do
+			3.times do |i|
+				failures += 1 unless request("/post#{k}_#{i}", body).include?("path /post#{k}_#{i}\n")
+			end
+		end
+	end
+	threads.each { |t| t.join }
+	killServer(pid)
+	puts "	#{lines.join(" ")}: #{CLIENTS * 3 - failures}/#{CLIENTS * 3} uploads of 200000 bytes answered"
+	if failures > 0
+		error("uploads were cut short")
+	end
+end
+
+a=startMember(18481, :http)
+b=startMember(18482, :http)
+backends=["io_backend=epoll"]
+if serverAccepts(["io_backend=io_uring_poll"] + MEMBERS)
+	backends << "io_backend=io_uring_poll"
+else
+	puts "io_backend=io_uring_poll is not built in, only epoll is tested"
+end
+#the io_uring backend is level-triggered only
+modes={ "io_backend=io_uring" => ["level"] }
+if backends.length > 1
+	backends << "io_backend=io_uring"
+end
+
+puts "Deferred accept, #{CLIENTS * REQUESTS} requests from #{CLIENTS} clients"
+backends.each do |backend|
+	modes.fetch(backend, ["level", "edge"]).each do |mode|
+		testDeferAccept(0, [backend, "epoll_mode=#{mode}"])
+		testDeferAccept(5, [backend, "epoll_mode=#{mode}"])
+	end
+end
+puts ""
+
+puts "Uploads larger than the session buffer, read on accept"
+backends.each do |backend|
+	modes.fetch(backend, ["level", "edge"]).each do |mode|
+		testUploads([backend, "epoll_mode=#{mode}", "defer_accept=5"])
+	end
+end
+stopMember(a)
+stopMember(b)
+
+puts ""
+puts "SUCCESS! All tests passed"
+exit
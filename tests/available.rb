@@ -0,0 +1,48 @@
+#!/usr/bin/ruby
+
+#available server sets: the worker builds the set of members a session may be sent to once, and again only when
+#something it depends on has changed. Sessions on their own must not build it again, disabling and enabling a
+#member has to, and the sessions after each change have to go to the new set
+#assumes a clean build and that nothing else listens on ports 18480-18482
+
+require_relative 'helper'
+
+MEMBER_PORTS = [18481, 18482]
+REQUESTS = 20
+
+#the member ports that answered REQUESTS requests, and how many times the set was built while they were made
+def requests()
+	builds=infoValue("Server set rebuilds").to_i
+	ports=(0...REQUESTS).map do |i|
+		s=TCPSocket.new("127.0.0.1", BIND_PORT)
+		s.write("GET /r#{i} HTTP/1.0\r\n\r\n")
+		reply=s.read
+		s.close
+		if !reply.end_with?("path /r#{i}\n")
+			error("request #{i}: #{reply.inspect}")
+		end
+		reply[/port (\d+) /, 1].to_i
+	end
+	return ports.uniq.sort, infoValue("Server set rebuilds").to_i - builds
+end
+
+members=MEMBER_PORTS.map { |p| startMember(p, :http) }
+pid=startServer(["algorithm=RR", "monitor_interval=120"] + memberConf("web1", MEMBER_PORTS[0]) + memberConf("web2", MEMBER_PORTS[1]))
+
+[[nil, MEMBER_PORTS, 0], ["disable member 1", MEMBER_PORTS.first(1), 1], ["enable member 1", MEMBER_PORTS, 1]].each do |cmd, expected, rebuilds|
+	runAdminCommand(cmd) if cmd
+	ports, builds=requests()
+	puts "#{cmd || "unchanged"}: #{REQUESTS} sessions to #{ports.join(" ")}, set built #{builds} times"
+	if ports != expected
+		error("the sessions didn't go to the available members")
+	end
+	if builds != rebuilds
+		error("the set was built #{builds} times rather than #{rebuilds}")
+	end
+end
+
+killServer(pid)
+members.each { |m| stopMember(m) }
+puts ""
+puts "SUCCESS! All tests passed"
+exit
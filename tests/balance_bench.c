@@ -0,0 +1,158 @@
+/*
+ * Balancing distribution benchmark: sends simulated sessions through the round robin, least connections and power
+ * of two choices algorithms (src/algorithms.c) and measures how evenly they end up on the members. Sessions arrive
+ * in bursts whose choices are all made before any of their connections is counted, which is how the counts look
+ * to a worker handling a batch of accepts, or to several workers choosing at the same time. A session lasts an
+ * exponentially distributed time, about four per member are open at once, and each run is made again with the
+ * first member taking three times as long over its sessions.
+ *
+ * The spread is sampled after every burst: the busiest member's connections less the mean, and the busiest
+ * member's connections over the mean.
+ *
+ * usage: balance_bench [members] [burst]
+ * exits 1 if power of two choices spreads the sessions less evenly than least connections with bursts of 8 or more
+ */
+
+#include <math.h>
+#include "../src/octopus.h"
+#include "../src/logging.c"
+#include "../src/algorithms.c"
+
+int buffer_peek(BUFFER *buffer, char *dest, int len) { return 0; }
+int connect_server(SESSION *session) { return 0; }
+int keepalive_put(SESSION *session) { return 0; }
+int disconnect_member(SESSION *session) { return 0; }
+
+#define SESSIONS 200000
+#define MAX_BURST 64
+#define WHEEL_SLOTS (1 << 18)
+
+/* sessions are kept on a list for the tick they end at modulo WHEEL_SLOTS, -1 terminated */
+int wheel[WHEEL_SLOTS];
+int session_end[SESSIONS];
+int session_next[SESSIONS];
+int session_member[SESSIONS];
+unsigned int lifetime_seed;
+
+long long now_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/* uniform in (0, 1), from its own xorshift so every algorithm is given the same sessions */
+double lifetime_random() {
+	lifetime_seed ^= lifetime_seed << 13;
+	lifetime_seed ^= lifetime_seed >> 17;
+	lifetime_seed ^= lifetime_seed << 5;
+	return (lifetime_seed + 1.0) / 4294967297.0;
+}
+
+/* runs the sessions through one algorithm and returns the mean busiest member over mean connections */
+double run(int algorithm, int n, int burst, int slow) {
+	int chosen[MAX_BURST];
+	double mean_life=4.0 * n / burst;
+	double spread=0;
+	double peak=0;
+	long long choose_ns=0;
+	long long start;
+	int samples=0;
+	int started=0;
+	int *link;
+	int busiest;
+	int total;
+	int tick;
+	int i;
+	int k;
+
+	balancer->algorithm=algorithm;
+	for(i=0; i < n; i++) {
+		balancer->members[i].c=0;
+	}
+	COUNTER_ADD(balancer->server_gen, 1);
+	next_member=0;
+	p2c_seed=2654435761u;
+	lifetime_seed=12345;
+	memset(wheel, 0xff, sizeof(wheel));
+	for(tick=0; started < SESSIONS; tick++) {
+		timer_now=tick;
+		for(link=&wheel[tick % WHEEL_SLOTS]; *link >= 0; ) {
+			i=*link;
+			if(session_end[i] == tick) {
+				server_count_add(&balancer->members[session_member[i]], -1);
+				*link=session_next[i];
+			}
+			else {
+				link=&session_next[i];
+			}
+		}
+		start=now_ns();
+		for(k=0; (k < burst) && (started + k < SESSIONS); k++) {
+			choose_member(NULL);
+			chosen[k]=next_member;
+		}
+		choose_ns += now_ns() - start;
+		for(k=0; (k < burst) && (started < SESSIONS); k++, started++) {
+			session_member[started]=chosen[k];
+			session_end[started]=tick + 1 + (int)(-log(lifetime_random()) * mean_life * ((slow && (chosen[k] == 0)) ? 3 : 1));
+			session_next[started]=wheel[session_end[started] % WHEEL_SLOTS];
+			wheel[session_end[started] % WHEEL_SLOTS]=started;
+			server_count_add(&balancer->members[chosen[k]], 1);
+		}
+		/* once the first sessions have had time to end */
+		if(tick > 200) {
+			busiest=0;
+			total=0;
+			for(i=0; i < n; i++) {
+				total += balancer->members[i].c;
+				if(balancer->members[i].c > busiest) {
+					busiest=balancer->members[i].c;
+				}
+			}
+			spread += busiest - (double)total / n;
+			peak += busiest / ((double)total / n);
+			samples++;
+		}
+	}
+	printf("%-19s %3d members, bursts of %2d%s: busiest - mean %6.2f, busiest / mean %5.2f, %6.1f ns per choice\n", (algorithm == ALGORITHM_RR) ? "round robin" : (algorithm == ALGORITHM_LC) ? "least connections" : "power of two", n, burst, slow ? ", slow member" : "              ", spread / samples, peak / samples, (double)choose_ns / SESSIONS);
+	return peak / samples;
+}
+
+int main(int argc, char **argv) {
+	WORKER_STATS stats;
+	double lc_peak;
+	double p2c_peak;
+	int failed=0;
+	int burst;
+	int slow;
+	int n;
+	int i;
+
+	n=(argc > 1) ? atoi(argv[1]) : 16;
+	burst=(argc > 2) ? atoi(argv[2]) : 1;
+	if((n < 2) || (n > MAXSERVERS) || (burst < 1) || (burst > MAX_BURST)) {
+		printf("ERROR: members must be 2 to %d and bursts 1 to %d\n", MAXSERVERS, MAX_BURST);
+		return 1;
+	}
+	memset(&stats, '\0', sizeof(stats));
+	worker_stats=&stats;
+	balancer=calloc(1, sizeof(BALANCER));
+	for(i=0; i < n; i++) {
+		balancer->members[i].id=i;
+		balancer->members[i].status=SERVER_STATE_ENABLED;
+		balancer->members[i].maxc=1000000;
+		balancer->members[i].weight=1;
+	}
+	balancer->nmembers=n;
+
+	for(slow=0; slow <= 1; slow++) {
+		run(ALGORITHM_RR, n, burst, slow);
+		lc_peak=run(ALGORITHM_LC, n, burst, slow);
+		p2c_peak=run(ALGORITHM_P2C, n, burst, slow);
+		if((burst >= 8) && (p2c_peak >= lc_peak)) {
+			printf("ERROR: power of two choices didn't spread the bursts better than least connections\n");
+			failed=1;
+		}
+	}
+	return failed;
+}
@@ -0,0 +1,63 @@
+#!/usr/bin/ruby
+
+#builds the microbenchmarks in this directory against ../src and runs them
+#needs a C compiler, no octopus server is started
+
+require 'fileutils'
+require 'tmpdir'
+
+CC = ENV["CC"] || "cc"
+BUILD_DIR = Dir.mktmpdir("octopuslb-bench")
+
+def error(text)
+	puts "ERROR DETECTED!\n"
+	puts text
+	exit(1)
+end
+
+def build(name)
+	ret=`#{CC} -O2 -w -o #{BUILD_DIR}/#{name} #{name}.c -lm 2>&1`
+	if $? != 0
+		error(ret)
+	end
+end
+
+def run(name, args="")
+	ret=`#{BUILD_DIR}/#{name} #{args}`
+	print ret
+	if $? != 0
+		error("#{name} #{args} failed")
+	end
+	return ret
+end
+
+def benchBuffers
+	puts "Session buffers, 1 byte written at a time"
+	build("buffer_bench")
+	run("buffer_bench", "262144 4096")
+	run("buffer_bench", "262144 65536")
+end
+
+def benchLeastConnections
+	puts "Least connections, one choice per new session"
+	build("lc_bench")
+	[2, 16, 64, 256, 512].each { |n| run("lc_bench", "#{n} 200000") }
+end
+
+def benchBalancing
+	puts "Session distribution, bursts of choices made before their connections are counted"
+	build("balance_bench")
+	[1, 8, 32].each { |burst| run("balance_bench", "16 #{burst}") }
+	run("balance_bench", "256 8")
+end
+
+benchBuffers
+puts ""
+benchLeastConnections
+puts ""
+benchBalancing
+puts ""
+
+FileUtils.rm_rf(BUILD_DIR)
+puts "SUCCESS! All benchmarks ran"
+exit
@@ -0,0 +1,172 @@
+/*
+ * Session buffer microbenchmark: forwards a stream through one session buffer (src/buffer.c) to a reader that only
+ * ever takes one byte per write, and counts the bytes the buffer code copies on the way. The same stream is then
+ * forwarded through a linear buffer that moves what is left to the front after each partial write, as the session
+ * buffers did before they were made circular.
+ *
+ * usage: buffer_bench [bytes] [buffer_size]
+ * exits 1 if the data arrives changed or the circular buffer copied anything
+ */
+
+#include "../src/octopus.h"
+#include "../src/logging.c"
+
+/* the buffer code reads and writes through these, and its copies are counted */
+ssize_t bench_readv(int fd, const struct iovec *iov, int iovcnt);
+ssize_t bench_writev(int fd, const struct iovec *iov, int iovcnt);
+void *bench_memcpy(void *dest, const void *src, size_t n);
+void *bench_memmove(void *dest, const void *src, size_t n);
+#define readv bench_readv
+#define writev bench_writev
+#define memcpy bench_memcpy
+#define memmove bench_memmove
+#include "../src/buffer.c"
+#undef memcpy
+#undef memmove
+
+int epoll_mod(SESSION *session, int role, struct epoll_event *ev) { return 0; }
+int session_pump(SESSION *session) { return 0; }
+
+char *source;
+char *sink;
+long long source_len;
+long long source_pos;
+long long sink_pos;
+long long copied;
+long long writes;
+
+/* the client socket: hands over as much of the stream as fits */
+ssize_t bench_readv(int fd, const struct iovec *iov, int iovcnt) {
+	ssize_t total=0;
+	size_t n;
+	int i;
+
+	for(i=0; i < iovcnt; i++) {
+		n=iov[i].iov_len;
+		if(n > (size_t)(source_len - source_pos)) {
+			n=source_len - source_pos;
+		}
+		__builtin_memcpy(iov[i].iov_base, source + source_pos, n);
+		source_pos += n;
+		total += n;
+	}
+	if(total == 0) {
+		errno=EAGAIN;
+		return -1;
+	}
+	return total;
+}
+
+/* the slow member socket: takes a single byte each time */
+ssize_t bench_writev(int fd, const struct iovec *iov, int iovcnt) {
+	int i;
+
+	writes++;
+	for(i=0; i < iovcnt; i++) {
+		if(iov[i].iov_len > 0) {
+			sink[sink_pos++]=*(char *)iov[i].iov_base;
+			return 1;
+		}
+	}
+	errno=EAGAIN;
+	return -1;
+}
+
+void *bench_memcpy(void *dest, const void *src, size_t n) {
+	copied += n;
+	return __builtin_memcpy(dest, src, n);
+}
+
+void *bench_memmove(void *dest, const void *src, size_t n) {
+	copied += n;
+	return __builtin_memmove(dest, src, n);
+}
+
+long long now_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/* what a session buffer used to do: read to the end of the data, write from the front, then move the rest down */
+long long compact_forward(int size) {
+	char *buf=malloc(size);
+	long long moved=0;
+	int used=0;
+	int n;
+
+	while(sink_pos < source_len) {
+		n=size - used;
+		if(n > source_len - source_pos) {
+			n=source_len - source_pos;
+		}
+		__builtin_memcpy(buf + used, source + source_pos, n);
+		source_pos += n;
+		used += n;
+		sink[sink_pos++]=buf[0];
+		writes++;
+		used--;
+		__builtin_memmove(buf, buf + 1, used);
+		moved += used;
+	}
+	free(buf);
+	return moved;
+}
+
+int main(int argc, char **argv) {
+	WORKER_STATS stats;
+	BUFFER buffer;
+	long long start;
+	long long elapsed;
+	long long moved;
+	long long i;
+	int size;
+	int failed=0;
+
+	source_len=(argc > 1) ? atoll(argv[1]) : 262144;
+	size=(argc > 2) ? atoi(argv[2]) : DEFAULT_BUFFER_SIZE;
+	memset(&stats, '\0', sizeof(stats));
+	worker_stats=&stats;
+	balancer=calloc(1, sizeof(BALANCER));
+	balancer->buffer_size=size;
+	balancer->buffer_size_max=size;
+	balancer->buffer_mode=BUFFER_MODE_FIXED;
+	source=malloc(source_len);
+	sink=malloc(source_len);
+	for(i=0; i < source_len; i++) {
+		source[i]=(char)(i * 131 + (i >> 8));
+	}
+
+	memset(&buffer, '\0', sizeof(buffer));
+	start=now_ns();
+	while(sink_pos < source_len) {
+		if(source_pos < source_len) {
+			buffer_read(&buffer, 0, size);
+		}
+		buffer_write(&buffer, 0);
+	}
+	elapsed=now_ns() - start;
+	printf("circular buffer:   %lld bytes forwarded in %lld writes, %lld bytes copied (%.2f per byte forwarded), %.1f ns per write\n", source_len, writes, copied, (double)copied / source_len, (double)elapsed / writes);
+	if(memcmp(source, sink, source_len) != 0) {
+		printf("ERROR: the data forwarded through the circular buffer was changed\n");
+		failed=1;
+	}
+	if(copied != 0) {
+		printf("ERROR: the circular buffer copied data on partial writes\n");
+		failed=1;
+	}
+
+	source_pos=0;
+	sink_pos=0;
+	writes=0;
+	memset(sink, '\0', source_len);
+	start=now_ns();
+	moved=compact_forward(size);
+	elapsed=now_ns() - start;
+	printf("compacting buffer: %lld bytes forwarded in %lld writes, %lld bytes copied (%.2f per byte forwarded), %.1f ns per write\n", source_len, writes, moved, (double)moved / source_len, (double)elapsed / writes);
+	if(memcmp(source, sink, source_len) != 0) {
+		printf("ERROR: the data forwarded through the compacting buffer was changed\n");
+		failed=1;
+	}
+	return failed;
+}
@@ -0,0 +1,99 @@
+#!/usr/bin/ruby
+
+#connect failover: a member that refuses connections and one that never answers its connects are each put next to a
+#live member, and every request has to be answered by the live one. Then the two failed members are put together
+#and a session has to try both before it is ended. The failed connects have to be counted against the members
+#that failed them
+#assumes a clean build and that nothing else listens on ports 18480-18483
+
+require_relative 'helper'
+
+LIVE_PORT = 18481
+REFUSED_PORT = 18482
+BLACKHOLE_PORT = 18483
+REQUESTS = 6
+CONNECT_TIMEOUT = 1
+
+#a listener whose backlog is kept full, so the SYNs of further connects are dropped and the connects time out
+def startBlackhole(port)
+	server=Socket.new(:INET, :STREAM)
+	server.setsockopt(Socket::SOL_SOCKET, Socket::SO_REUSEADDR, 1)
+	server.bind(Addrinfo.tcp("127.0.0.1", port))
+	server.listen(0)
+	fillers=(1..4).map do
+		s=Socket.new(:INET, :STREAM)
+		begin
+			s.connect_nonblock(Addrinfo.tcp("127.0.0.1", port))
+		rescue IO::WaitWritable
+		end
+		s
+	end
+	return [server] + fillers
+end
+
+#a request, returns the reply and how long it took
+def request(path)
+	start=Process.clock_gettime(Process::CLOCK_MONOTONIC)
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	s.write("GET #{path} HTTP/1.0\r\n\r\n")
+	reply=s.read
+	s.close
+	return reply, Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+end
+
+#the members' failed connects, by name
+def failedConnects(names)
+	return names.map { |n| memberValue(n, "connect_failures") + memberValue(n, "connect_timeouts") }
+end
+
+#sends REQUESTS requests one after the other through the failed member and the live one. Round robin sends every
+#other session to the failed member first
+def failToLive(name, port)
+	pid=startServer(["algorithm=RR", "connect_timeout=#{CONNECT_TIMEOUT}", "monitor_interval=120"] + memberConf(name, port) + memberConf("live", LIVE_PORT))
+	failed_before, live_before=failedConnects([name, "live"])
+	failovers_before=infoValue("Connect failovers").to_i
+	slowest=0
+	REQUESTS.times do |i|
+		reply, took=request("/#{name}#{i}")
+		if !reply.include?("port #{LIVE_PORT} path /#{name}#{i}\n")
+			error("request #{i} with #{name} and live members: #{reply.inspect}")
+		end
+		slowest=[slowest, took].max
+	end
+	failed_after, live_after=failedConnects([name, "live"])
+	failovers=infoValue("Connect failovers").to_i - failovers_before
+	killServer(pid)
+	printf("%-9s and live: %d requests answered, slowest %.2fs, %d failed connects to %s, %d failovers\n", name, REQUESTS, slowest, failed_after - failed_before, name, failovers)
+	if (failed_after - failed_before) < REQUESTS / 2 || live_after != live_before
+		error("the failed connects weren't counted against #{name}")
+	end
+	if failovers != failed_after - failed_before
+		error("not every failed connect was failed over")
+	end
+	return slowest
+end
+
+live=startMember(LIVE_PORT, :http)
+blackhole=startBlackhole(BLACKHOLE_PORT)
+failToLive("refused", REFUSED_PORT)
+if failToLive("blackhole", BLACKHOLE_PORT) < CONNECT_TIMEOUT
+	error("no connect was given up on after connect_timeout")
+end
+
+#with no member left to try the client is closed without an answer
+pid=startServer(["algorithm=RR", "connect_timeout=#{CONNECT_TIMEOUT}", "monitor_interval=120"] + memberConf("refused", REFUSED_PORT) + memberConf("blackhole", BLACKHOLE_PORT))
+sleep(CONNECT_TIMEOUT + 0.5)
+before=failedConnects(["refused", "blackhole"])
+reply, took=request("/none")
+after=failedConnects(["refused", "blackhole"])
+killServer(pid)
+printf("refused and blackhole: closed after %.2fs with %d bytes answered, %d and %d failed connects\n", took, reply.bytesize, after[0] - before[0], after[1] - before[1])
+if reply.bytesize != 0 || after[0] != before[0] + 1 || after[1] != before[1] + 1
+	error("the session wasn't tried on both members before it was ended")
+end
+
+stopMember(live)
+blackhole.each { |s| s.close }
+puts ""
+puts "SUCCESS! All tests passed"
+exit
@@ -0,0 +1,88 @@
+#!/usr/bin/ruby
+
+#TCP Fast Open: clients that have a cookie send their request with the SYN and the listener has to count them, and
+#the member connects are put off until the request can go with their SYN, which the member has to take. Then the
+#time a request takes is compared with Fast Open off and on. On loopback the round trips cost next to nothing, run
+#with "netem" (as root, with tc) to delay every packet on lo by NETEM_DELAY and see what the saved round trips are
+#worth; the delay is taken off again when the test ends
+#assumes a clean build, net.ipv4.tcp_fastopen set to 3 and that nothing else listens on ports 18480-18481
+
+require_relative 'helper'
+
+MEMBER_PORT = 18481
+REQUESTS = 50
+NETEM_DELAY = "10ms"
+#not defined by every ruby
+TCP_FASTOPEN_CONNECT = 30
+
+#a request, returns how long it took. With fastopen the connect is put off until the request can go with the SYN
+def request(path, fastopen)
+	start=Process.clock_gettime(Process::CLOCK_MONOTONIC)
+	s=Socket.new(:INET, :STREAM)
+	s.setsockopt(Socket::IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1) if fastopen
+	s.connect(Addrinfo.tcp("127.0.0.1", BIND_PORT))
+	s.write("GET #{path} HTTP/1.0\r\n\r\n")
+	reply=s.read
+	s.close
+	if !reply.include?("port #{MEMBER_PORT} path #{path}\n")
+		error("#{path}: #{reply.inspect}")
+	end
+	return Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+end
+
+#the clients the listener took data with the SYN from
+def fastopenAccepts()
+	return infoValue("Listener Fast Open")[/(\d+) clients/, 1].to_i
+end
+
+#the median time of count requests, and the Fast Open counters they moved
+def run(fastopen, count)
+	lines=fastopen ? ["listen_fastopen=16", "member_fastopen=enabled"] : []
+	pid=startServer(lines + ["monitor_interval=120"] + memberConf("web", MEMBER_PORT))
+	#the first connects are given the cookies
+	request("/cookie", fastopen)
+	accepts=fastopen ? fastopenAccepts() : 0
+	sent=memberValue("web", "fastopen_sent")
+	acked=memberValue("web", "fastopen_acked")
+	times=(0...count).map { |i| request("/r#{i}", fastopen) }
+	accepts=fastopen ? fastopenAccepts() - accepts : 0
+	sent=memberValue("web", "fastopen_sent") - sent
+	acked=memberValue("web", "fastopen_acked") - acked
+	killServer(pid)
+	return median(times), accepts, sent, acked
+end
+
+if File.read("/proc/sys/net/ipv4/tcp_fastopen").to_i & 3 != 3
+	error("net.ipv4.tcp_fastopen has to allow Fast Open on clients and servers (3)")
+end
+member=startMember(MEMBER_PORT, :http, 16)
+netem=(ARGV[0] == "netem")
+if netem
+	if !system("tc qdisc add dev lo root netem delay #{NETEM_DELAY}")
+		error("unable to add a netem delay to lo")
+	end
+	at_exit { system("tc qdisc del dev lo root netem") }
+end
+count=netem ? REQUESTS / 5 : REQUESTS
+
+plain, accepts, sent, acked=run(false, count)
+printf("Fast Open off: median %.2fms per request\n", plain * 1000)
+if sent != 0
+	error("member connects were put off with Fast Open disabled")
+end
+fast, accepts, sent, acked=run(true, count)
+printf("Fast Open on:  median %.2fms per request, %d of %d clients sent data with the SYN, %d member connects sent it and %d were taken\n", fast * 1000, accepts, count, sent, acked)
+if accepts != count
+	error("the listener didn't count the clients that sent data with the SYN")
+end
+if sent != count || acked != count
+	error("the member connects didn't send the request with the SYN")
+end
+if netem && fast >= plain
+	error("Fast Open saved no time with #{NETEM_DELAY} on every packet")
+end
+
+stopMember(member)
+puts ""
+puts "SUCCESS! All tests passed"
+exit
@@ -0,0 +1,215 @@
+#shared by the test scripts that run a server: starts octopuslb-server in the foreground on a configuration
+#written to a temporary directory, with member servers forked from the script itself
+#assumes a clean build and that nothing else listens on the ports used
+
+require 'socket'
+require 'fileutils'
+require 'tmpdir'
+
+ADMIN ="../octopuslb-admin"
+SERVER ="../octopuslb-server"
+BIND_PORT = 18480
+RUN_DIR = Dir.mktmpdir("octopuslb-test")
+#the admin asks which instance to use when the SHM run directory holds more than one file
+SHM_DIR = "#{RUN_DIR}/run"
+#process groups still to be killed if a test fails part way
+$children = []
+
+def error(text)
+	puts "ERROR DETECTED!\n"
+	puts text
+	exit(1)
+end
+
+#starts the server with these configuration lines added to the test's own. Returns its pid once it is listening,
+#or nil if it exited
+def spawnServer(lines)
+	conf="#{RUN_DIR}/test.conf"
+	FileUtils.mkdir_p(SHM_DIR)
+	File.open(conf, "w") do |f|
+		f.puts "binding_ip=127.0.0.1"
+		f.puts "binding_port=#{BIND_PORT}"
+		f.puts "shm_run_dir=#{SHM_DIR}"
+		f.puts "log_file=#{RUN_DIR}/octopuslb.log"
+		f.puts "monitor_interval=1"
+		lines.each { |l| f.puts l }
+	end
+	pid=spawn("#{SERVER} -c #{conf} -f", [:out, :err] => "#{RUN_DIR}/server.out", :pgroup => true)
+	$children << pid
+	50.times do
+		begin
+			TCPSocket.new("127.0.0.1", BIND_PORT).close
+			return pid
+		rescue SystemCallError
+			if Process.wait(pid, Process::WNOHANG)
+				$children.delete(pid)
+				return nil
+			end
+			sleep 0.1
+		end
+	end
+	error("server did not start listening")
+end
+
+def startServer(lines)
+	pid=spawnServer(lines)
+	if pid == nil
+		error(File.read("#{RUN_DIR}/server.out"))
+	end
+	return pid
+end
+
+#false if the server refuses the configuration, eg. for a backend it was built without
+def serverAccepts(lines)
+	pid=spawnServer(lines)
+	if pid == nil
+		return false
+	end
+	killServer(pid)
+	return true
+end
+
+def killServer(pid)
+	runAdminCommand("kill")
+	Process.wait(pid)
+	$children.delete(pid)
+end
+
+#flags go before the command, eg. "-m" for the machine-readable output
+def runAdminCommand(cmd, flags="")
+	ret=`#{ADMIN} #{flags} -d #{SHM_DIR}/ -e "#{cmd}" 2>&1 < /dev/null`
+	if $? != 0
+		error(ret)
+	end
+	return ret
+end
+
+#a value from the admin info output, eg. infoValue("Event loop syscalls")
+def infoValue(name)
+	runAdminCommand("info").each_line do |line|
+		if line.start_with?(name + ":")
+			return line.split(":", 2)[1].strip
+		end
+	end
+	return nil
+end
+
+#the fields of a member's line in the admin's machine-readable show output
+MEMBER_FIELDS = ["type", "id", "name", "status", "standby", "ip", "port", "c", "maxc", "completed_c", "bsent", "brecv",
+	"load", "maxl", "e_load", "pool_idle", "pool_hits", "pool_misses", "connect_failures", "connect_timeouts", "warm_idle",
+	"warm_hits", "warm_misses", "warm_stale", "fastopen_sent", "fastopen_acked", "weight"]
+
+#a member's value from the admin's show output, eg. memberValue("web", "connect_failures"). Numbers are
+#returned as integers, nil if there is no such member
+def memberValue(name, field)
+	runAdminCommand("show", "-m").each_line do |line|
+		values=line.strip.split(",")
+		if values[0] == "Member" && values[2] == name
+			value=values[MEMBER_FIELDS.index(field)]
+			return (value =~ /\A\d+\z/) ? value.to_i : value
+		end
+	end
+	return nil
+end
+
+#reads a request's headers and its Content-Length body. Returns the method and path, nil once the client has closed
+def readRequest(c)
+	line=c.gets
+	return nil if line == nil
+	method, path=line.split(" ")
+	length=0
+	while (line=c.gets) && line != "\r\n"
+		length=line.split(":")[1].to_i if line.downcase.start_with?("content-length:")
+	end
+	c.read(length) if length > 0
+	return method, path
+end
+
+#answers HTTP/1.1 requests on a kept-alive connection with "port N conn K path P", K counting the member's
+#connections. HEAD is answered with the headers alone, CONNECT and /upgrade are switched to echoing whatever follows,
+#and /close is answered without a Content-Length, which leaves the connection open as the client can't tell the end
+def serveKeepalive(c, port, conn)
+	while (request=readRequest(c))
+		method, path=request
+		body="port #{port} conn #{conn} path #{path}\n"
+		if method == "CONNECT" || path == "/upgrade"
+			c.write((method == "CONNECT") ? "HTTP/1.1 200 Connection established\r\n\r\n" : "HTTP/1.1 101 Switching Protocols\r\nUpgrade: echo\r\nConnection: Upgrade\r\n\r\n")
+			while (data=c.readpartial(65536))
+				c.write(data)
+			end
+		elsif method == "HEAD"
+			c.write("HTTP/1.1 200 OK\r\nContent-Length: #{body.bytesize}\r\n\r\n")
+		elsif path == "/close"
+			c.write("HTTP/1.1 200 OK\r\n\r\n#{body}")
+		else
+			c.write("HTTP/1.1 200 OK\r\nContent-Length: #{body.bytesize}\r\n\r\n#{body}")
+		end
+	end
+end
+
+#a member server in its own process. Echo members answer every read with the same number of bytes, HTTP members
+#answer each request (and its Content-Length body) with "port N path P" and close, keep-alive members answer as
+#serveKeepalive() does. A fastopen queue length turns TCP Fast Open on for the member's listener
+def startMember(port, kind, fastopen=0)
+	server=TCPServer.new("127.0.0.1", port)
+	server.setsockopt(Socket::IPPROTO_TCP, Socket::TCP_FASTOPEN, fastopen) if fastopen > 0
+	pid=fork do
+		Process.setpgid(0, 0)
+		#the script's at_exit cleanup is not for the member to run
+		at_exit { exit!(0) }
+		conns=0
+		loop do
+			client=server.accept
+			client.setsockopt(Socket::IPPROTO_TCP, Socket::TCP_NODELAY, 1)
+			conns += 1
+			Thread.new(client, conns) do |c, conn|
+				begin
+					if kind == :echo
+						while (data=c.readpartial(65536))
+							c.write("r" * data.bytesize)
+						end
+					elsif kind == :keepalive
+						serveKeepalive(c, port, conn)
+					else
+						#the monitor's checks connect and close without a request
+						request=readRequest(c)
+						raise EOFError if request == nil
+						path=request[1]
+						body="port #{port} path #{path}\n"
+						c.write("HTTP/1.0 200 OK\r\nContent-Length: #{body.bytesize}\r\n\r\n#{body}")
+					end
+				rescue EOFError, SystemCallError
+				end
+				c.close
+			end
+		end
+	end
+	server.close
+	$children << pid
+	return pid
+end
+
+def stopMember(pid)
+	Process.kill("KILL", pid)
+	Process.wait(pid)
+	$children.delete(pid)
+end
+
+def memberConf(name, port)
+	return ["[#{name}]", "ip=127.0.0.1", "port=#{port}", "[/]"]
+end
+
+def median(values)
+	sorted=values.sort
+	return sorted[sorted.length / 2]
+end
+
+def percentile(values, p)
+	sorted=values.sort
+	return sorted[(sorted.length * p / 100).to_i]
+end
+
+at_exit do
+	$children.each { |pid| Process.kill("KILL", -pid) rescue nil }
+	FileUtils.rm_rf(RUN_DIR)
+end
@@ -0,0 +1,86 @@
+#!/usr/bin/ruby
+
+#keep-alive pool: a member connection whose requests have all been answered is kept when the client goes away, and
+#the next session is given it instead of connecting. Responses the parser can't follow to their end have to leave
+#the connection out of the pool: one framed by the connection closing, the answer to a HEAD, a CONNECT tunnel and a
+#101 upgrade
+#assumes a clean build and that nothing else listens on ports 18480-18481
+
+require_relative 'helper'
+
+MEMBER_PORT = 18481
+
+#reads a response's headers and, unless told there's none, the body its Content-Length gives
+def readResponse(s, body=true)
+	head=""
+	while (line=s.gets) && line != "\r\n"
+		head << line
+	end
+	length=head[/^content-length:\s*(\d+)/i, 1].to_i
+	return head + ((body && length > 0) ? s.read(length) : "")
+end
+
+#a client connection that makes one request, lets block do what follows, and closes. Returns the member connection
+#the request went to and the change in the member's pool hits
+def session(method, path, body=true)
+	hits=memberValue("web", "pool_hits")
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	s.write("#{method} #{path} HTTP/1.1\r\nHost: test\r\n\r\n")
+	reply=readResponse(s, body)
+	yield s, reply if block_given?
+	s.close
+	#the server puts the connection back once it has read the close
+	sleep 0.2
+	return reply[/ conn (\d+) /, 1].to_i, memberValue("web", "pool_hits") - hits
+end
+
+#a request that should leave the member connection out of the pool, then one that has to be given a new connection
+def notPooled(what, method, path, body=true, &block)
+	session(method, path, body, &block)
+	idle=memberValue("web", "pool_idle")
+	conn, hits=session("GET", "/after")
+	puts "#{what}: #{idle} idle connections after it, next session on connection #{conn} with #{hits} pool hits"
+	if idle != 0 || hits != 0
+		error("the member connection was pooled after #{what}")
+	end
+	#the new connection is pooled as usual
+	if memberValue("web", "pool_idle") != 1
+		error("the member connection wasn't pooled after the request that followed #{what}")
+	end
+	#so that the next check starts from an empty pool
+	session("GET", "/close") { |s, reply| s.gets }
+end
+
+member=startMember(MEMBER_PORT, :keepalive)
+pid=startServer(["keepalive_pool=4", "monitor_interval=120"] + memberConf("web", MEMBER_PORT))
+
+first, hits=session("GET", "/a")
+idle=memberValue("web", "pool_idle")
+second, hits=session("GET", "/b")
+puts "reuse: connection #{first} then #{second}, #{idle} idle in between, #{hits} pool hits"
+if idle != 1 || first != second || hits != 1
+	error("the second session wasn't given the first one's member connection")
+end
+#the pool holds the connection again and the client of /close has been answered, so it is left with an empty pool
+session("GET", "/close") { |s, reply| s.gets }
+
+notPooled("a close-delimited response", "GET", "/close") do |s, reply|
+	if !s.gets.start_with?("port #{MEMBER_PORT} conn")
+		error("close-delimited response: #{reply.inspect}")
+	end
+end
+notPooled("a HEAD", "HEAD", "/head", false)
+[["a CONNECT tunnel", "CONNECT", "test:443"], ["a 101 upgrade", "GET", "/upgrade"]].each do |what, method, path|
+	notPooled(what, method, path) do |s, reply|
+		s.write("ping\n")
+		if s.gets != "ping\n"
+			error("#{what} wasn't relayed: #{reply.inspect}")
+		end
+	end
+end
+
+killServer(pid)
+stopMember(member)
+puts ""
+puts "SUCCESS! All tests passed"
+exit
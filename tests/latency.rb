@@ -0,0 +1,57 @@
+#!/usr/bin/ruby
+
+#request/response latency through the balancer with and without inline_writes: a client sends 64 byte requests
+#one at a time on one connection to an echo member and times each round trip. With inline writes the event
+#loop makes fewer system calls per round trip, which is checked; the latencies are reported
+#assumes a clean build and that nothing else listens on ports 18480-18481
+
+require_relative 'helper'
+
+MEMBER_PORT = 18481
+TRIPS = 20000
+
+def pingPong(trips)
+	times=[]
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	s.setsockopt(Socket::IPPROTO_TCP, Socket::TCP_NODELAY, 1)
+	request="q" * 64
+	trips.times do
+		start=Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+		s.write(request)
+		got=0
+		while got < 64
+			got += s.readpartial(64 - got).bytesize
+		end
+		times << (Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond) - start) / 1000.0
+	end
+	s.close
+	return times
+end
+
+def runLatency(mode)
+	pid=startServer(["inline_writes=#{mode}"] + memberConf("echo", MEMBER_PORT))
+	pingPong(1000)
+	before=infoValue("Event loop syscalls").to_i
+	times=pingPong(TRIPS)
+	syscalls=(infoValue("Event loop syscalls").to_i - before).to_f / TRIPS
+	inline=infoValue("Inline write attempts").to_i
+	killServer(pid)
+	printf("inline_writes=%-9s p50 %6.1fus  p90 %6.1fus  p99 %6.1fus  %5.2f event loop syscalls per round trip  %d inline writes\n", mode, median(times), percentile(times, 90), percentile(times, 99), syscalls, inline)
+	return syscalls, inline
+end
+
+member=startMember(MEMBER_PORT, :echo)
+puts "#{TRIPS} round trips of 64 bytes through one member"
+enabled_syscalls, enabled_inline=runLatency("enabled")
+disabled_syscalls, disabled_inline=runLatency("disabled")
+stopMember(member)
+
+if enabled_inline == 0 || disabled_inline != 0
+	error("inline writes were not made as configured")
+end
+if enabled_syscalls >= disabled_syscalls
+	error("inline writes did not save any event loop system calls")
+end
+puts ""
+puts "SUCCESS! All tests passed"
+exit
@@ -0,0 +1,125 @@
+/*
+ * Least connections microbenchmark: times the choice of a member for a new session with the tournament tree
+ * index (lc_choose() in src/algorithms.c) and with the linear scan it replaced, which built the available members
+ * again and walked all of them on every choice. Every session stays on its member until there are four per
+ * member, after which each new one ends the oldest, and the clock moves a millisecond every PICKS_PER_MS choices
+ * so the index is also rebuilt as often as it would be at that rate.
+ *
+ * usage: lc_bench [members] [choices]
+ * exits 1 if either way chose a member that didn't have the fewest connections
+ */
+
+#include "../src/octopus.h"
+#include "../src/logging.c"
+#include "../src/algorithms.c"
+
+int buffer_peek(BUFFER *buffer, char *dest, int len) { return 0; }
+int connect_server(SESSION *session) { return 0; }
+int keepalive_put(SESSION *session) { return 0; }
+int disconnect_member(SESSION *session) { return 0; }
+
+#define PICKS_PER_MS 100
+
+#define MODE_INDEX 0
+#define MODE_SCAN 1
+
+int *live;
+
+long long now_ns() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/* the member with the fewest connections, for checking a choice */
+int fewest(int n) {
+	int min=INT_MAX;
+	int i;
+
+	for(i=0; i < n; i++) {
+		if(balancer->members[i].c < min) {
+			min=balancer->members[i].c;
+		}
+	}
+	return min;
+}
+
+/* makes choices choices, checking each one against the members' counts when check is set. Returns the time taken,
+ * or -1 if a choice wasn't a member with the fewest connections
+ */
+long long run(int mode, int n, int choices, int check) {
+	long long start;
+	int oldest=0;
+	int count=0;
+	int i;
+
+	for(i=0; i < n; i++) {
+		balancer->members[i].c=0;
+	}
+	COUNTER_ADD(balancer->server_gen, 1);
+	next_member=0;
+	timer_now=0;
+	start=now_ns();
+	for(i=0; i < choices; i++) {
+		if((i % PICKS_PER_MS) == 0) {
+			timer_now++;
+		}
+		if(mode == MODE_INDEX) {
+			lc_choose();
+		}
+		else {
+			build_available_servers();
+			get_available_servers();
+			set_lc_list();
+		}
+		if(check && (balancer->members[next_member].c != fewest(n))) {
+			printf("ERROR: choice %d went to member %d with %d connections, the fewest was %d\n", i, next_member, balancer->members[next_member].c, fewest(n));
+			return -1;
+		}
+		if(count == 4 * n) {
+			server_count_add(&balancer->members[live[oldest]], -1);
+			oldest=(oldest + 1) % (4 * n);
+			count--;
+		}
+		live[(oldest + count) % (4 * n)]=next_member;
+		count++;
+		server_count_add(&balancer->members[next_member], 1);
+	}
+	return now_ns() - start;
+}
+
+int main(int argc, char **argv) {
+	WORKER_STATS stats;
+	long long index_ns;
+	long long scan_ns;
+	int choices;
+	int n;
+	int i;
+
+	n=(argc > 1) ? atoi(argv[1]) : MAXSERVERS;
+	choices=(argc > 2) ? atoi(argv[2]) : 1000000;
+	if((n < 1) || (n > MAXSERVERS)) {
+		printf("ERROR: members must be 1 to %d\n", MAXSERVERS);
+		return 1;
+	}
+	memset(&stats, '\0', sizeof(stats));
+	worker_stats=&stats;
+	balancer=calloc(1, sizeof(BALANCER));
+	balancer->algorithm=ALGORITHM_LC;
+	for(i=0; i < n; i++) {
+		balancer->members[i].id=i;
+		balancer->members[i].status=SERVER_STATE_ENABLED;
+		balancer->members[i].maxc=1000000;
+		balancer->members[i].weight=1;
+	}
+	balancer->nmembers=n;
+	live=malloc(sizeof(int) * 4 * n);
+
+	if((run(MODE_INDEX, n, choices / 10, 1) < 0) || (run(MODE_SCAN, n, choices / 10, 1) < 0)) {
+		return 1;
+	}
+	index_ns=run(MODE_INDEX, n, choices, 0);
+	scan_ns=run(MODE_SCAN, n, choices, 0);
+	printf("%3d members: tournament tree %7.1f ns per choice, linear scan %8.1f ns per choice\n", n, (double)index_ns / choices, (double)scan_ns / choices);
+	return 0;
+}
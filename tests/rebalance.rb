@@ -0,0 +1,88 @@
+#!/usr/bin/ruby
+
+#per-request balancing: the requests a client sends one after the other on a kept-alive connection are each given
+#to the member round robin picks, so they alternate between the two members, and the connections they leave behind
+#go to the keep-alive pool for the next switch. Pipelined requests stay with the member that has the earlier ones.
+#With http_balancing=connection every request stays with the member the client was first given
+#assumes a clean build and that nothing else listens on ports 18480-18482
+
+require_relative 'helper'
+
+MEMBER_PORTS = [18481, 18482]
+REQUESTS = 6
+
+#reads a response's headers and the body its Content-Length gives
+def readResponse(s)
+	head=""
+	while (line=s.gets) && line != "\r\n"
+		head << line
+	end
+	return s.read(head[/^content-length:\s*(\d+)/i, 1].to_i)
+end
+
+#the member ports that answered each of the requests, sent count at a time on one client connection
+def requests(count)
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	ports=[]
+	(REQUESTS / count).times do |i|
+		s.write((0...count).map { |k| "GET /r#{i}-#{k} HTTP/1.1\r\nHost: test\r\n\r\n" }.join)
+		count.times do |k|
+			body=readResponse(s)
+			if !body.end_with?("path /r#{i}-#{k}\n")
+				error("request #{i}-#{k}: #{body.inspect}")
+			end
+			ports << body[/port (\d+) /, 1].to_i
+		end
+	end
+	s.close
+	return ports
+end
+
+def poolHits()
+	return ["web1", "web2"].map { |n| memberValue(n, "pool_hits") }.sum
+end
+
+def startBalancing(mode)
+	return startServer(["algorithm=RR", "http_balancing=#{mode}", "keepalive_pool=4", "monitor_interval=120"] +
+		memberConf("web1", MEMBER_PORTS[0]) + memberConf("web2", MEMBER_PORTS[1]))
+end
+
+members=MEMBER_PORTS.map { |p| startMember(p, :keepalive) }
+
+pid=startBalancing("request")
+hits=poolHits()
+ports=requests(1)
+hits=poolHits() - hits
+rebalanced=infoValue("Requests rebalanced").to_i
+switches=infoValue("Member switches").to_i
+puts "one at a time: members #{ports.join(" ")}, #{rebalanced} requests rebalanced, #{switches} member switches, #{hits} pool hits"
+if (1...REQUESTS).any? { |i| ports[i] == ports[i - 1] }
+	error("the requests weren't each given to the next member")
+end
+if rebalanced != REQUESTS - 1 || switches != REQUESTS - 1
+	error("the rebalanced requests and switches weren't counted")
+end
+#only the first request to each member connects
+if hits != REQUESTS - 2
+	error("the switches didn't reuse the connections left in the pool")
+end
+
+ports=requests(2)
+puts "in pairs: members #{ports.join(" ")}"
+if (0...REQUESTS).step(2).any? { |i| ports[i] != ports[i + 1] } || (2...REQUESTS).step(2).any? { |i| ports[i] == ports[i - 1] }
+	error("pipelined requests were split, or the pairs weren't balanced")
+end
+killServer(pid)
+
+pid=startBalancing("connection")
+ports=requests(1)
+puts "by connection: members #{ports.join(" ")}"
+if ports.uniq.length != 1
+	error("the requests on one client connection went to different members")
+end
+killServer(pid)
+
+members.each { |m| stopMember(m) }
+puts ""
+puts "SUCCESS! All tests passed"
+exit
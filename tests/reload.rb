@@ -0,0 +1,98 @@
+#!/usr/bin/ruby
+
+#configuration reload: SIGHUP to the master reads the file again while the server runs. A member that is no longer
+#listed is removed, a new one is added and takes sessions, and one that stays keeps its counters and takes its new
+#maxc and weight. A file with an error is not applied and the running configuration carries on as it was
+#assumes a clean build and that nothing else listens on ports 18480-18483
+
+require_relative 'helper'
+
+PORTS = { "a" => 18481, "b" => 18482, "c" => 18483 }
+REQUESTS = 6
+
+#the member that answered a request
+def request(path)
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	s.write("GET #{path} HTTP/1.0\r\n\r\n")
+	reply=s.read
+	s.close
+	if !reply.end_with?("path #{path}\n")
+		error("#{path}: #{reply.inspect}")
+	end
+	return PORTS.key(reply[/port (\d+) /, 1].to_i)
+end
+
+#the names of the members that answered REQUESTS requests
+def members()
+	return (0...REQUESTS).map { |i| request("/r#{i}") }.uniq.sort
+end
+
+#replaces the members of the test's configuration with these lines and signals the master, then waits for it
+#to log that it applied the file or found errors in it
+def reload(pid, lines)
+	conf="#{RUN_DIR}/test.conf"
+	File.write(conf, File.read(conf).sub(/^\[.*/m, "") + lines.join("\n") + "\n")
+	done=File.read("#{RUN_DIR}/server.out").scan(/configuration reloaded|has errors/).length
+	Process.kill("HUP", pid)
+	50.times do
+		outcomes=File.read("#{RUN_DIR}/server.out").scan(/configuration reloaded|has errors/)
+		if outcomes.length > done
+			return (outcomes.last == "has errors") ? :rejected : :applied
+		end
+		sleep 0.1
+	end
+	error("the reload didn't finish:\n" + File.read("#{RUN_DIR}/server.out"))
+end
+
+#waits for a member to be gone from the show output, the monitor removes it once its sessions have finished
+def waitRemoved(name)
+	30.times do
+		return if memberValue(name, "id") == nil
+		sleep 0.1
+	end
+	error("member #{name} wasn't removed")
+end
+
+def memberLines(name, extra=[])
+	return memberConf(name, PORTS[name]).insert(3, *extra)
+end
+
+started=PORTS.values.map { |p| startMember(p, :http) }
+pid=startServer(["algorithm=RR"] + memberLines("a", ["maxc=10"]) + memberLines("b"))
+if members() != ["a", "b"]
+	error("the requests didn't go to both members")
+end
+completed=memberValue("a", "completed_c")
+
+#b goes, c comes and a changes
+if reload(pid, memberLines("a", ["maxc=20", "weight=3"]) + memberLines("c")) != :applied
+	error("the reload was rejected:\n" + File.read("#{RUN_DIR}/server.out"))
+end
+waitRemoved("b")
+maxc=memberValue("a", "maxc")
+weight=memberValue("a", "weight")
+puts "reloaded: members #{members().join(" ")}, a has maxc #{maxc} and weight #{weight}, #{completed} sessions completed before"
+if members() != ["a", "c"]
+	error("the requests didn't go to the reloaded members")
+end
+if maxc != 20 || weight != 3
+	error("member a didn't take its new settings")
+end
+if memberValue("a", "completed_c") < completed + REQUESTS / 2
+	error("member a lost its counters")
+end
+
+#an error anywhere in the file keeps the running configuration
+if reload(pid, memberLines("a", ["maxc=30"]) + memberLines("b") + ["[broken]", "ip=127.0.0.1", "port=notaport", "[/]"]) != :rejected
+	error("the broken file was applied")
+end
+puts "broken file rejected: members #{members().join(" ")}, a has maxc #{memberValue("a", "maxc")}"
+if members() != ["a", "c"] || memberValue("a", "maxc") != 20 || memberValue("b", "id") != nil
+	error("the broken file changed the running configuration")
+end
+
+killServer(pid)
+started.each { |m| stopMember(m) }
+puts ""
+puts "SUCCESS! All tests passed"
+exit
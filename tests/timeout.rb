@@ -0,0 +1,64 @@
+#!/usr/bin/ruby
+
+#session timeouts from the timer wheel: a client that goes quiet has to be closed after client_timeout, one whose
+#member doesn't answer after member_timeout, and one that keeps trickling its request in after session_lifetime.
+#Each session has to end within a second of its time, be counted, and its connection has to come off its member
+#assumes a clean build and that nothing else listens on ports 18480-18481
+
+require_relative 'helper'
+
+MEMBER_PORT = 18481
+TIMEOUT = 2
+
+#starts the server with the setting, opens a client and hands it to the block once its session has a member
+#connection, then waits for the balancer to close it. label is the setting's line in the admin info
+def closedAfter(setting, label)
+	pid=startServer(["#{setting}=#{TIMEOUT}"] + memberConf("http", MEMBER_PORT))
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	start=Process.clock_gettime(Process::CLOCK_MONOTONIC)
+	20.times do
+		break if memberValue("http", "c") == 1
+		sleep 0.05
+	end
+	if memberValue("http", "c") != 1
+		error("#{setting}: the session didn't connect to the member")
+	end
+	feeder=Thread.new { yield s }
+	begin
+		s.read
+	rescue SystemCallError
+	end
+	took=Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+	feeder.kill
+	s.close
+	sleep 0.1
+	c=memberValue("http", "c")
+	ended=infoValue(label)
+	killServer(pid)
+	printf("%-16s %d: closed after %.2fs, member connections %d, %s\n", setting, TIMEOUT, took, c, ended)
+	if took < TIMEOUT || took >= TIMEOUT + 1
+		error("#{setting}: the session wasn't ended on time")
+	end
+	if c != 0 || ended !~ /, 1 sessions ended/
+		error("#{setting}: the session wasn't counted or its member connection wasn't let go")
+	end
+end
+
+member=startMember(MEMBER_PORT, :http)
+#the client sends nothing
+closedAfter("client_timeout", "Client timeout") { |s| sleep }
+#the member waits for the end of the request, which never comes
+closedAfter("member_timeout", "Member timeout") { |s| s.write("GET /slow HTTP/1.0\r\n"); sleep }
+#the request goes on for ever, a header at a time
+closedAfter("session_lifetime", "Session lifetime") do |s|
+	s.write("GET /trickle HTTP/1.0\r\n")
+	loop do
+		sleep 0.2
+		s.write("X-Trickle: 1\r\n")
+	end
+end
+stopMember(member)
+
+puts ""
+puts "SUCCESS! All tests passed"
+exit
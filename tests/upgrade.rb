@@ -0,0 +1,95 @@
+#!/usr/bin/ruby
+
+#binary upgrades under load: clients keep making requests to a server with several workers while it is upgraded
+#to the same binary, once with as many workers and once with fewer, and every request has to be answered. The
+#new binary has to take over the running instance's listeners
+#assumes a clean build and that nothing else listens on ports 18480-18481
+
+require_relative 'helper'
+
+MEMBER_PORT = 18481
+CLIENTS = 8
+
+#requests made one after the other by CLIENTS threads until stop is set. Returns how many were made and the failures
+def startLoad(stop)
+	counts=Array.new(CLIENTS, 0)
+	failures=[]
+	threads=(0...CLIENTS).map do |k|
+		Thread.new do
+			until stop[0]
+				path="/c#{k}r#{counts[k]}"
+				begin
+					s=TCPSocket.new("127.0.0.1", BIND_PORT)
+					s.write("GET #{path} HTTP/1.0\r\n\r\n")
+					reply=s.read
+					s.close
+					failures << "#{path}: #{reply.inspect}" unless reply.include?("path #{path}\n")
+				rescue SystemCallError, IOError => e
+					failures << "#{path}: #{e}"
+				end
+				counts[k] += 1
+			end
+		end
+	end
+	return threads, counts, failures
+end
+
+#upgrades the server and waits until the new binary has taken over and the old one has exited
+def upgrade(old_master)
+	taken=File.read("#{RUN_DIR}/server.out").scan("upgrade_commit: took over").length
+	runAdminCommand("upgrade")
+	100.times do
+		if File.read("#{RUN_DIR}/server.out").scan("upgrade_commit: took over").length > taken
+			if old_master == nil || Process.wait(old_master, Process::WNOHANG)
+				$children.delete(old_master)
+				return
+			end
+		end
+		sleep 0.1
+	end
+	error("the upgrade didn't finish:\n" + File.read("#{RUN_DIR}/server.out"))
+end
+
+def setWorkers(n)
+	conf="#{RUN_DIR}/test.conf"
+	File.write(conf, File.read(conf).sub(/^workers=\d+$/, "workers=#{n}"))
+end
+
+member=startMember(MEMBER_PORT, :http)
+pid=startServer(["workers=4", "drain_timeout=10"] + memberConf("http", MEMBER_PORT))
+stop=[false]
+threads, counts, failures=startLoad(stop)
+sleep 0.5
+upgrade(pid)
+sleep 0.5
+setWorkers(2)
+upgrade(nil)
+sleep 0.5
+stop[0]=true
+threads.each { |t| t.join }
+log=File.read("#{RUN_DIR}/server.out")
+#the new master isn't a child of this script, it is gone once the port is closed
+runAdminCommand("kill")
+50.times do
+	begin
+		TCPSocket.new("127.0.0.1", BIND_PORT).close
+		sleep 0.1
+	rescue SystemCallError
+		break
+	end
+end
+stopMember(member)
+
+puts "#{counts.sum} requests through two upgrades of a server with 4 workers, the second to 2 workers: #{failures.length} failed"
+if failures.length > 0
+	error(failures.first(5).join("\n"))
+end
+if log.include?("upgrade_collect: unable")
+	error("the old master couldn't take its workers' listeners:\n" + log)
+end
+if !log.include?("took over 2 of the running instance's 4 listeners")
+	error("the new binary didn't take over the running instance's listeners:\n" + log)
+end
+puts ""
+puts "SUCCESS! All tests passed"
+exit
@@ -0,0 +1,113 @@
+#!/usr/bin/ruby
+
+#system calls per round trip under each I/O backend the server was built with. A client and an echo member pass a
+#message back and forth on one session, then short HTTP sessions are made one after the other. With epoll every
+#read, write and connect is a system call of its own on top of epoll_wait and epoll_ctl, io_uring_poll only moves
+#the event handling onto the ring, and io_uring submits the reads, writes and connects too so that the worker makes
+#no session I/O system calls at all. Then a member that refuses connections is failed over from under io_uring
+#assumes a clean build and that nothing else listens on ports 18480-18483
+
+require_relative 'helper'
+
+ECHO_PORT = 18481
+HTTP_PORT = 18482
+DEAD_PORT = 18483
+TRIPS = 2000
+SESSIONS = 200
+MESSAGE = "m" * 100
+
+#the worker's event loop and session I/O system calls
+def syscalls()
+	return infoValue("Event loop syscalls").to_i, infoValue("Session I/O syscalls").to_i
+end
+
+#TRIPS round trips on one session. Returns the system calls per trip and the median trip time
+def pingPong()
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	s.setsockopt(Socket::IPPROTO_TCP, Socket::TCP_NODELAY, 1)
+	#the first trip connects the member
+	s.write(MESSAGE)
+	s.read(MESSAGE.bytesize)
+	events, io=syscalls()
+	times=(0...TRIPS).map do
+		start=Process.clock_gettime(Process::CLOCK_MONOTONIC)
+		s.write(MESSAGE)
+		reply=s.read(MESSAGE.bytesize)
+		if reply != "r" * MESSAGE.bytesize
+			error("round trip: #{reply.inspect}")
+		end
+		Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+	end
+	events_after, io_after=syscalls()
+	s.close
+	return (events_after - events).to_f / TRIPS, (io_after - io).to_f / TRIPS, median(times)
+end
+
+#SESSIONS HTTP sessions one after the other. Returns the system calls per session
+def sessions()
+	events, io=syscalls()
+	SESSIONS.times do |i|
+		s=TCPSocket.new("127.0.0.1", BIND_PORT)
+		s.write("GET /s#{i} HTTP/1.0\r\n\r\n")
+		reply=s.read
+		s.close
+		if !reply.end_with?("port #{HTTP_PORT} path /s#{i}\n")
+			error("session #{i}: #{reply.inspect}")
+		end
+	end
+	events_after, io_after=syscalls()
+	return (events_after - events).to_f / SESSIONS, (io_after - io).to_f / SESSIONS
+end
+
+members=[startMember(ECHO_PORT, :echo), startMember(HTTP_PORT, :http)]
+backends=["epoll"]
+["io_uring_poll", "io_uring"].each do |backend|
+	if serverAccepts(["io_backend=#{backend}"] + memberConf("echo", ECHO_PORT))
+		backends << backend
+	else
+		puts "io_backend=#{backend} is not built in"
+	end
+end
+
+results={}
+backends.each do |backend|
+	pid=startServer(["io_backend=#{backend}", "monitor_interval=120"] + memberConf("echo", ECHO_PORT))
+	events, io, trip=pingPong()
+	killServer(pid)
+	pid=startServer(["io_backend=#{backend}", "monitor_interval=120"] + memberConf("web", HTTP_PORT))
+	session_events, session_io=sessions()
+	killServer(pid)
+	results[backend]=[events + io, session_events + session_io]
+	printf("%-14s %d round trips: %.2f event loop + %.2f session I/O = %.2f syscalls per trip, median %.3fms\n", backend, TRIPS, events, io, events + io, trip * 1000)
+	printf("%-14s %d HTTP sessions: %.2f event loop + %.2f session I/O = %.2f syscalls per session\n", backend, SESSIONS, session_events, session_io, session_events + session_io)
+	if backend == "io_uring" && (io > 0 || session_io > 0)
+		error("io_uring made session I/O system calls")
+	end
+end
+if results["io_uring"]
+	if results["io_uring"][0] >= results["epoll"][0] || results["io_uring"][1] >= results["epoll"][1]
+		error("io_uring made no fewer system calls than epoll")
+	end
+
+	#connects that fail on the ring are failed over like the others
+	pid=startServer(["io_backend=io_uring", "algorithm=RR", "monitor_interval=120"] + memberConf("dead", DEAD_PORT) + memberConf("web", HTTP_PORT))
+	failed=0
+	10.times do |i|
+		s=TCPSocket.new("127.0.0.1", BIND_PORT)
+		s.write("GET /f#{i} HTTP/1.0\r\n\r\n")
+		failed += 1 if !s.read.end_with?("port #{HTTP_PORT} path /f#{i}\n")
+		s.close
+	end
+	failures=memberValue("dead", "connect_failures")
+	killServer(pid)
+	puts ""
+	puts "io_uring with a member that refuses connections: #{10 - failed}/10 sessions answered, #{failures} connect failures"
+	if failed > 0 || failures == 0
+		error("the refused connects weren't failed over")
+	end
+end
+
+members.each { |m| stopMember(m) }
+puts ""
+puts "SUCCESS! All tests passed"
+exit
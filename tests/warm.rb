@@ -0,0 +1,76 @@
+#!/usr/bin/ruby
+
+#warm pool: the worker keeps warm_pool connections to the member made in advance, every session is given one of them
+#and the pool is topped up again behind it. Connections the member has closed are thrown away as stale when they
+#are looked at and the session connects as usual, and a disabled member's connections are closed
+#assumes a clean build and that nothing else listens on ports 18480-18481
+
+require_relative 'helper'
+
+MEMBER_PORT = 18481
+WARM_POOL = 2
+REQUESTS = 4
+
+def request(path)
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	s.write("GET #{path} HTTP/1.0\r\n\r\n")
+	reply=s.read
+	s.close
+	if !reply.include?("port #{MEMBER_PORT} path #{path}\n")
+		error("#{path}: #{reply.inspect}")
+	end
+end
+
+#the member's warm pool counters
+def warm()
+	return ["warm_idle", "warm_hits", "warm_misses", "warm_stale"].map { |f| memberValue("web", f) }
+end
+
+#waits for the pool to hold this many connections, the pools are topped up after each event batch and at least
+#once a second
+def waitIdle(idle, what)
+	30.times do
+		return if memberValue("web", "warm_idle") == idle
+		sleep 0.1
+	end
+	error("#{what}: the pool held #{memberValue("web", "warm_idle")} connections rather than #{idle}")
+end
+
+member=startMember(MEMBER_PORT, :http)
+pid=startServer(["warm_pool=#{WARM_POOL}", "monitor_interval=120"] + memberConf("web", MEMBER_PORT))
+waitIdle(WARM_POOL, "after startup")
+
+idle, hits, misses, stale=warm()
+REQUESTS.times do |i|
+	request("/warm#{i}")
+	waitIdle(WARM_POOL, "after request #{i}")
+end
+idle, hits_after, misses_after, stale_after=warm()
+puts "#{REQUESTS} requests: #{hits_after - hits} warm hits, #{misses_after - misses} misses, #{idle} idle after each"
+if hits_after - hits != REQUESTS || misses_after != misses || stale_after != stale
+	error("the sessions weren't each given a warm connection")
+end
+
+#a restarted member has closed the connections the pool holds
+stopMember(member)
+member=startMember(MEMBER_PORT, :http)
+idle, hits, misses, stale=warm()
+request("/restarted")
+idle, hits_after, misses_after, stale_after=warm()
+puts "member restarted: #{stale_after - stale} stale, #{misses_after - misses} misses, #{hits_after - hits} hits"
+if stale_after - stale != WARM_POOL || misses_after - misses != 1 || hits_after != hits
+	error("the closed connections weren't thrown away before connecting")
+end
+waitIdle(WARM_POOL, "after the member restarted")
+
+runAdminCommand("disable member 0")
+waitIdle(0, "after the member was disabled")
+runAdminCommand("enable member 0")
+waitIdle(WARM_POOL, "after the member was enabled")
+puts "member disabled and enabled: the pool was emptied and refilled"
+
+killServer(pid)
+stopMember(member)
+puts ""
+puts "SUCCESS! All tests passed"
+exit
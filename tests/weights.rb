@@ -0,0 +1,68 @@
+#!/usr/bin/ruby
+
+#weighted balancing: under WRR the members are sent sessions in proportion to their weights, spread through the
+#round rather than each taking its weight in a row, and under WLC the sessions that stay open end up on the members
+#in proportion to their weights
+#assumes a clean build and that nothing else listens on ports 18480-18483
+
+require_relative 'helper'
+
+WEIGHTS = { "w1" => 1, "w2" => 2, "w4" => 4 }
+PORTS = { "w1" => 18481, "w2" => 18482, "w4" => 18483 }
+ROUNDS = 10
+
+def startWeighted(algorithm)
+	lines=WEIGHTS.map { |name, weight| memberConf(name, PORTS[name]).insert(3, "weight=#{weight}") }.flatten
+	return startServer(["algorithm=#{algorithm}", "monitor_interval=120"] + lines)
+end
+
+#true if every member's share is its weight's within one session
+def proportional(counts)
+	return WEIGHTS.all? { |name, weight| (counts[name] - weight * ROUNDS).abs <= 1 }
+end
+
+members=PORTS.values.map { |p| startMember(p, :http) }
+sessions=WEIGHTS.values.sum * ROUNDS
+
+pid=startWeighted("WRR")
+order=(0...sessions).map do |i|
+	s=TCPSocket.new("127.0.0.1", BIND_PORT)
+	s.write("GET /r#{i} HTTP/1.0\r\n\r\n")
+	reply=s.read
+	s.close
+	if !reply.end_with?("path /r#{i}\n")
+		error("request #{i}: #{reply.inspect}")
+	end
+	PORTS.key(reply[/port (\d+) /, 1].to_i)
+end
+killServer(pid)
+counts=WEIGHTS.keys.to_h { |name| [name, order.count(name)] }
+longest=order.chunk { |name| name }.map { |name, run| run.length }.max
+puts "WRR: #{sessions} sessions, #{counts.map { |name, n| "#{name} #{n}" }.join(", ")}, longest run #{longest}"
+if !proportional(counts)
+	error("the sessions weren't sent in proportion to the weights")
+end
+#the weight 4 member has to be given its sessions between the others'
+if longest > 2
+	error("the members' sessions weren't spread through the round")
+end
+
+pid=startWeighted("WLC")
+open=(0...sessions).map { TCPSocket.new("127.0.0.1", BIND_PORT) }
+counts={}
+50.times do
+	counts=WEIGHTS.keys.to_h { |name| [name, memberValue(name, "c")] }
+	break if counts.values.sum == sessions
+	sleep 0.1
+end
+puts "WLC: #{sessions} open sessions, #{counts.map { |name, n| "#{name} #{n}" }.join(", ")}"
+if !proportional(counts)
+	error("the open sessions weren't in proportion to the weights")
+end
+open.each { |s| s.close }
+killServer(pid)
+
+members.each { |m| stopMember(m) }
+puts ""
+puts "SUCCESS! All tests passed"
+exit